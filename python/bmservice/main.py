@@ -2,10 +2,12 @@ import os
 import ctypes as ct
 import numpy as np
 import time
-import threading
+import select
+import asyncio
 
 BMTypeTuple = (
    (np.float32, 0),
+   (np.float16, 1),
    (np.int32, 6),
    (np.uint32, 7),
    (np.int8, 2),
@@ -14,6 +16,8 @@ BMTypeTuple = (
 def bmlen(t):
     if t in [2,3]:
         return 1
+    elif t in [1,8]:
+        return 2
     elif t in [0,6,7]:
         return 4
 
@@ -25,6 +29,10 @@ def nptype(t):
     for nt, bt in BMTypeTuple: 
         if t == bt:
             return nt
+    if t == 8:
+        # numpy has no bfloat16, keep the raw bits
+        return np.uint16
+    raise TypeError("unsupported bm data type {}".format(t))
 
 class BMTensor(ct.Structure):
     _fields_ = [
@@ -43,6 +51,17 @@ class BMTensor(ct.Structure):
         buffer = data_ptr
         return np.frombuffer(buffer, dtype = dtype).reshape(shape)
         
+    def as_numpy(self, owner):
+        # a view of the data without copying, owner keeps the data alive
+        shape = self.shape[0:self.dims]
+        dtype = nptype(self.dtype)
+        mem_size = int(np.prod(shape))*bmlen(self.dtype)
+        if mem_size == 0:
+            return np.empty(shape, dtype=dtype)
+        buffer = (ct.c_byte*mem_size).from_address(self.data)
+        buffer._owner = owner
+        return np.frombuffer(buffer, dtype = dtype).reshape(shape)
+
     def from_numpy(self, data):
         self.dims = ct.c_uint32(len(data.shape))
         for i in range(self.dims):
@@ -50,16 +69,60 @@ class BMTensor(ct.Structure):
         self.dtype = ct.c_uint32(bmtype(data.dtype))
         self.data = data.ctypes.data_as(ct.c_void_p)
 
+class OutputBlock:
+    # the outputs of a task are in one C block, released after all the arrays viewing it are collected
+    def __init__(self, lib, num, tensors):
+        self.lib = lib
+        self.num = num
+        self.tensors = tensors
+
+    def __del__(self):
+        self.lib.runner_release_output(self.num, self.tensors)
+
+class AcquiredInput:
+    def __init__(self, tensors, num, arrays):
+        self.tensors = tensors
+        self.num = num
+        self.arrays = arrays
+
 class BlobInfo(ct.Structure):
     _fields_ = [
         ("name", ct.c_char_p),
         ("dims_num", ct.c_int),
         ("dims", ct.c_int * 8)]
 
+CompletionCallback = ct.CFUNCTYPE(None, ct.c_uint32, ct.c_void_p)
+
+class OutputReducer(ct.Structure):
+    _fields_ = [
+        ("kind", ct.c_uint32),
+        ("params", ct.c_float*3),
+    ]
+
+# OUTPUT_REDUCER_* of interface.h
+ReducerKinds = {"none": 0, "topk": 1, "argmax": 2, "threshold": 3, "detect": 4}
+
+class ImageSpec(ct.Structure):
+    _fields_ = [
+        ("resize_mode", ct.c_uint32),
+        ("crop_factor", ct.c_float),
+        ("pad_color", ct.c_uint8*3),
+        ("layout", ct.c_uint32),
+        ("bgr", ct.c_int),
+        ("mean", ct.c_float*3),
+        ("scale", ct.c_float*3),
+    ]
+
+# BM_ENCODED_IMAGE, IMAGE_RESIZE_* and IMAGE_LAYOUT_* of interface.h
+BM_ENCODED_IMAGE = 100
+ResizeModes = {"stretch": 0, "aspect_pad": 1, "central_crop": 2}
+ImageLayouts = {"auto": 0, "nchw": 1, "nhwc": 2}
+
 class BMService:
     __lib = None
      
-    def __init__(self, bmodel_path, batch=1, devices=None):
+    def __init__(self, bmodel_path, batch=1, devices=None, warmup=-1, plugin=None, plugin_config=""):
+        # plugin is the path of a library with native pre/post hooks, see bmservice_plugin.h
         self.bmodel_path = bmodel_path
         if self.__class__.__lib is None:
             lib_path = os.path.join(os.path.dirname(__file__), "lib/libbmservice.so")
@@ -69,11 +132,21 @@ class BMService:
             device_ids = (ct.c_int*len(devices))(*devices)
             device_num = ct.c_int(len(devices))
             self.__lib.runner_use_devices(device_ids, device_num)
-        self.runner_id = self.__lib.runner_start_with_batch(ct.c_char_p(bytes(bmodel_path, encoding='utf-8')), batch)
+        if plugin is None:
+            self.runner_id = self.__lib.runner_start_with_warmup(ct.c_char_p(bytes(bmodel_path, encoding='utf-8')), batch, warmup)
+        else:
+            self.runner_id = self.__lib.runner_start_with_plugin(ct.c_char_p(bytes(bmodel_path, encoding='utf-8')), batch, warmup,
+                                                                 ct.c_char_p(bytes(plugin, encoding='utf-8')),
+                                                                 ct.c_char_p(bytes(plugin_config, encoding='utf-8')))
         self.bm_inputs_kv = {}
         if devices is not None:
             device_num = ct.c_int(0)
             self.__lib.runner_use_devices(device_ids, device_num)
+        # INVALID_RUNNER_ID as a c_int
+        if self.runner_id == -1:
+            if plugin is None:
+                raise RuntimeError("cannot start {}".format(bmodel_path))
+            raise RuntimeError("cannot start {} with plugin {}".format(bmodel_path, plugin))
 
     @classmethod
     def available_devices(cls):
@@ -85,6 +158,30 @@ class BMService:
         real_num = cls.__lib.available_devices(devices, max_num)
         return tuple(devices[i] for i in range(real_num))
 
+    @classmethod
+    def __load_lib(cls):
+        if cls.__lib is None:
+            lib_path = os.path.join(os.path.dirname(__file__), "lib/libbmservice.so")
+            cls.__lib = ct.cdll.LoadLibrary(lib_path)
+        return cls.__lib
+
+    @classmethod
+    def get_metrics(cls):
+        lib = cls.__load_lib()
+        lib.get_metrics_text.restype = ct.POINTER(ct.c_char)
+        text = lib.get_metrics_text()
+        result = ct.string_at(text).decode()
+        lib.release_metrics_text(text)
+        return result
+
+    @classmethod
+    def start_metrics_http(cls, port=0):
+        return cls.__load_lib().metrics_start_http(port)
+
+    @classmethod
+    def start_metrics_dump(cls, path, interval_ms=5000):
+        cls.__load_lib().metrics_start_file_dump(ct.c_char_p(bytes(path, encoding='utf-8')), interval_ms)
+
     def get_input_info(self):
         num = ct.c_uint32(0)
         self.__lib.get_input_info.restype = ct.POINTER(BlobInfo)
@@ -98,26 +195,142 @@ class BMService:
     def __del__(self):
         self.__lib.runner_stop(self.runner_id)
 
-    def put(self, *inputs):
+    def put(self, *inputs, timeout=None):
+        # the task is skipped if it is still waiting after timeout seconds, and comes out as an invalid one
         if not inputs:
             self.__lib.runner_join(self.runner_id)
             return
         input_num = ct.c_int(len(inputs))
         bm_inputs = (BMTensor*len(inputs))()
-        inputs = [i if i.data.c_contiguous else np.ascontiguousarray(i) for i in inputs]
+        # no copy for C-contiguous arrays, the arrays are kept until the task is got
+        inputs = [np.ascontiguousarray(i) for i in inputs]
         for i in range(len(inputs)):
             bm_inputs[i].from_numpy(inputs[i])
         # do not copy tensor
-        task_id = self.__lib.runner_put_input(self.runner_id, input_num, bm_inputs, 0)
-        self.bm_inputs_kv[task_id] = bm_inputs
+        if timeout is None:
+            task_id = self.__lib.runner_put_input(self.runner_id, input_num, bm_inputs, 0)
+        else:
+            task_id = self.__lib.runner_put_input_with_timeout(self.runner_id, input_num, bm_inputs, 0, max(int(timeout*1000), 1))
+        self.bm_inputs_kv[task_id] = (bm_inputs, inputs)
         return task_id
+
+    def put_images(self, *images, timeout=None):
+        # images are the encoded bytes(jpeg, png, ...) of a batch, decoded and preprocessed in C by set_image_input()
+        bm_inputs = (BMTensor*len(images))()
+        arrays = [np.frombuffer(image, dtype=np.uint8) for image in images]
+        for i in range(len(arrays)):
+            bm_inputs[i].from_numpy(arrays[i])
+            bm_inputs[i].dtype = BM_ENCODED_IMAGE
+        if timeout is None:
+            task_id = self.__lib.runner_put_input(self.runner_id, len(images), bm_inputs, 0)
+        else:
+            task_id = self.__lib.runner_put_input_with_timeout(self.runner_id, len(images), bm_inputs, 0, max(int(timeout*1000), 1))
+        self.bm_inputs_kv[task_id] = (bm_inputs, arrays)
+        return task_id
+
+    def acquire_input(self):
+        # arrays of a pooled input block with the full batch shapes, fill them in place and pass them to submit_acquired()
+        num = ct.c_uint32(0)
+        self.__lib.runner_acquire_input.restype = ct.POINTER(BMTensor)
+        tensors = self.__lib.runner_acquire_input(self.runner_id, ct.byref(num))
+        return AcquiredInput(tensors, num.value, [tensors[i].as_numpy(None) for i in range(num.value)])
+
+    def submit_acquired(self, acquired, batch=None):
+        # only the first batch samples of the arrays are used, the arrays must not be used afterwards
+        if batch is not None:
+            for i in range(acquired.num):
+                acquired.tensors[i].shape[0] = batch
+        acquired.arrays = []
+        return self.__lib.runner_submit_acquired(self.runner_id, acquired.num, acquired.tensors)
+
+    def cancel(self, task_id):
+        # the stages not started yet are skipped, returns False if the task has been got
+        return self.__lib.runner_cancel(self.runner_id, task_id) == 0
         
+    def put_many(self, tasks):
+        # tasks is a list of input tuples, all of them are put in one call, returns their task ids
+        tasks = [[np.ascontiguousarray(i) for i in inputs] for inputs in tasks]
+        input_nums = (ct.c_uint32*len(tasks))(*[len(inputs) for inputs in tasks])
+        bm_inputs = (BMTensor*sum(input_nums))()
+        k = 0
+        for inputs in tasks:
+            for i in inputs:
+                bm_inputs[k].from_numpy(i)
+                k += 1
+        task_ids = (ct.c_uint32*len(tasks))()
+        # do not copy tensor, the tensors and arrays are kept until the tasks are got
+        num = self.__lib.runner_put_inputs(self.runner_id, len(tasks), input_nums, bm_inputs, 0, task_ids)
+        for task_id in task_ids[:num]:
+            self.bm_inputs_kv[task_id] = (bm_inputs, tasks)
+        return list(task_ids[:num])
+
+    def get_many(self, max_tasks, wait=True):
+        # returns a list of (task_id, outputs, valid) of the finished tasks, at most max_tasks
+        task_ids = (ct.c_uint32*max_tasks)()
+        output_nums = (ct.c_uint32*max_tasks)()
+        output_valids = (ct.c_uint32*max_tasks)()
+        output_tensors = (ct.POINTER(BMTensor)*max_tasks)()
+        num = self.__lib.runner_get_outputs(self.runner_id, max_tasks, int(wait), task_ids, output_nums, output_valids, output_tensors)
+        results = []
+        for t in range(num):
+            outputs = self.__take_outputs(task_ids[t], output_nums[t], output_tensors[t], output_valids[t])
+            results.append((task_ids[t], outputs, bool(output_valids[t])))
+        return results
+
     def get(self):
         return self.__get(self.__lib.runner_get_output)
 
     def try_get(self):
         return self.__get(self.__lib.runner_try_to_get_output)
 
+    def completion_fd(self):
+        # readable when outputs are queued, see runner_completion_fd
+        fd = self.__lib.runner_completion_fd(self.runner_id)
+        if fd < 0:
+            raise OSError("cannot create the completion fd")
+        return fd
+
+    def __reset_completion(self, fd):
+        try:
+            os.read(fd, 8)
+        except BlockingIOError:
+            pass
+
+    def wait_get(self, timeout=None):
+        # like get(), but waits on the completion fd, returns (0, [], 0) on timeout or when stopped
+        fd = self.completion_fd()
+        deadline = None if timeout is None else time.monotonic() + timeout
+        while True:
+            # reset before trying, so an output queued after the try wakes up select
+            self.__reset_completion(fd)
+            result = self.try_get()
+            if result[0] != 0 or self.stopped():
+                return result
+            remaining = None if deadline is None else max(deadline - time.monotonic(), 0)
+            if not select.select([fd], [], [], remaining)[0] and deadline is not None:
+                return 0, [], 0
+
+    async def get_async(self):
+        # awaitable get() for asyncio, the event loop watches the completion fd
+        loop = asyncio.get_running_loop()
+        fd = self.completion_fd()
+        while True:
+            self.__reset_completion(fd)
+            result = self.try_get()
+            if result[0] != 0 or self.stopped():
+                return result
+            readable = loop.create_future()
+            loop.add_reader(fd, lambda: readable.done() or readable.set_result(None))
+            try:
+                await readable
+            finally:
+                loop.remove_reader(fd)
+
+    def set_completion_callback(self, func):
+        # func(runner_id) is called in the post-process threads when an output is queued, None removes it
+        self.completion_callback = CompletionCallback(lambda runner_id, _: func(runner_id)) if func else None
+        self.__lib.runner_set_completion_callback(self.runner_id, self.completion_callback, None)
+
     def stopped(self):
         return self.__lib.runner_all_stopped(self.runner_id)
         
@@ -125,50 +338,36 @@ class BMService:
         return self.__lib.runner_empty(self.runner_id)
 
     def infer_all(self, samples, key_func=None, out_func=None, in_func=None):
-        self.sample_count = len(samples)
-        if self.sample_count == 0:
+        # runs all the samples in one runner_infer_all call, the outputs are in the order of samples
+        if len(samples) == 0:
             return
-        self.map_lock = threading.Lock()
-        self.finish_cond = threading.Condition()
-        self.task_map = {}
-        self.sample_index = {}
-        self.out_func = out_func
-        self.wait_thread = threading.Thread(target=self.__wait_result)
-        self.wait_thread.start()
+        sample_ids = []
+        tasks = []
         for i, sample in enumerate(samples):
-            sample_id = key_func(i, sample) if key_func else i
+            sample_ids.append(key_func(i, sample) if key_func else i)
             if in_func is not None:
                 sample = in_func(sample)
-            task_id = self.put(*sample)
-            self.map_lock.acquire()
-            self.sample_index[sample_id] = len(self.task_map)
-            self.task_map[task_id] = sample_id
-            self.map_lock.release()
-        self.wait_thread.join()
-        return self.final_outputs
-
-    def __wait_result(self):
-        cached_outputs = []
-        while self.sample_count>0:
-            task_id, outputs, valid = self.try_get()
-            if task_id == 0:
-                time.sleep(0.0001)
-                continue
-
-            self.map_lock.acquire()
-            sample_id = self.task_map[task_id]
-            del self.task_map[task_id]
-            self.map_lock.release()
-
-            if self.out_func is not None:
-                outputs = self.out_func(sample_id, outputs)
-            cached_outputs.append((sample_id, outputs))
-            self.sample_count -= 1
-
-        self.final_outputs = [None]*len(cached_outputs)
-        for id, out in cached_outputs:
-            self.final_outputs[self.sample_index[id]] = out
-
+            tasks.append([np.ascontiguousarray(s) for s in sample])
+        input_nums = (ct.c_uint32*len(tasks))(*[len(inputs) for inputs in tasks])
+        bm_inputs = (BMTensor*sum(input_nums))()
+        k = 0
+        for inputs in tasks:
+            for i in inputs:
+                bm_inputs[k].from_numpy(i)
+                k += 1
+        output_nums = (ct.c_uint32*len(tasks))()
+        output_valids = (ct.c_uint32*len(tasks))()
+        output_tensors = (ct.POINTER(BMTensor)*len(tasks))()
+        # the GIL is released by ctypes during the whole call
+        self.__lib.runner_infer_all(self.runner_id, len(tasks), input_nums, bm_inputs,
+                                    output_tensors, output_nums, output_valids)
+        final_outputs = []
+        for t, sample_id in enumerate(sample_ids):
+            outputs = self.__take_outputs(0, output_nums[t], output_tensors[t], output_valids[t])
+            if out_func is not None:
+                outputs = out_func(sample_id, outputs)
+            final_outputs.append(outputs)
+        return final_outputs
 
     def __get(self, func):
         output_num= ct.c_uint32(0)
@@ -178,23 +377,40 @@ class BMService:
         output_tensors = func(self.runner_id, ct.byref(task_id), ct.byref(output_num), ct.byref(output_valid))
         if(task_id.value == 0):
             return 0, [], 0
-        outputs = []
-        if output_valid.value == 0:
-            return task_id.value, [], False
-        for i in range(output_num.value):
-            outputs.append(output_tensors[i].to_numpy())
-        self.__lib.runner_release_output(output_num, output_tensors)
-        try:
-            self.bm_inputs_kv.pop(task_id.value)
-        except KeyError:
-            pass
-        return task_id.value, outputs, True
+        outputs = self.__take_outputs(task_id.value, output_num.value, output_tensors, output_valid.value)
+        return task_id.value, outputs, bool(output_valid.value)
+
+    def __take_outputs(self, task_id, output_num, output_tensors, valid):
+        # the arrays are views of the C outputs, no copy
+        self.bm_inputs_kv.pop(task_id, None)
+        if not output_tensors:
+            return []
+        block = OutputBlock(self.__lib, output_num, output_tensors)
+        return [output_tensors[i].as_numpy(block) for i in range(output_num)] if valid else []
+
+    def __wait_task(self, task_id, timeout_ms):
+        output_tensors = ct.POINTER(BMTensor)()
+        output_num = ct.c_uint32(0)
+        output_valid = ct.c_uint32(0)
+        res = self.__lib.runner_wait_task(self.runner_id, task_id, timeout_ms, ct.byref(output_tensors),
+                                          ct.byref(output_num), ct.byref(output_valid))
+        if res != 0:
+            return None, False
+        outputs = self.__take_outputs(task_id, output_num.value, output_tensors, output_valid.value)
+        return outputs, bool(output_valid.value)
+
+    def wait_task(self, task_id, timeout=None):
+        # waits for the outputs of task_id only, returns (None, False) on timeout or if the task is not in flight
+        # the tasks are kept by task id from then on, do not mix with get()/try_get()/wait_get()/get_into() on the same runner
+        # at most 4096 finished tasks nobody waited for yet are kept, the oldest ones are dropped beyond that
+        return self.__wait_task(task_id, -1 if timeout is None else int(timeout*1000))
+
+    def poll_task(self, task_id):
+        return self.__wait_task(task_id, 0)
 
     def infer_one(self, *inputs):
-        in_task_id = self.put(*inputs)
-        out_task_id, outputs, valid = self.get()
-        assert in_task_id == out_task_id
-        return outputs, valid
+        # safe with other threads sharing the runner
+        return self.wait_task(self.put(*inputs))
 
     def wait_to_stop(self):
         while not self.stopped():
@@ -209,6 +425,97 @@ class BMService:
         self.__lib.release_unsigned_pointer(durations);
         return result
 
+    def get_percentiles(self, device_id=-1):
+        num = ct.c_uint32(0)
+        self.__lib.get_runner_percentiles.restype = ct.POINTER(ct.c_uint32)
+        values = self.__lib.get_runner_percentiles(self.runner_id, device_id, ct.byref(num))
+        result = [values[i] for i in range(num.value)]
+        self.__lib.release_unsigned_pointer(values)
+        phases = ["preprocess", "forward", "postprocess", "total"]
+        keys = ["p50", "p90", "p99", "p99.9"]
+        return {phase: dict(zip(keys, result[i*len(keys):(i+1)*len(keys)])) for i, phase in enumerate(phases) if result}
+
+    def set_watchdog(self, timeout_ms, action=1):
+        # action: 0-report only, 1-fail the stalled task, 2-fail the device until the stalled stage returns
+        self.__lib.runner_set_watchdog(self.runner_id, timeout_ms, action)
+
+    def select_outputs(self, *indices):
+        # only these outputs are returned by get(), in this order, no indices returns all of them
+        c_indices = (ct.c_uint32*len(indices))(*indices)
+        if self.__lib.runner_select_outputs(self.runner_id, c_indices, len(indices)) != 0:
+            raise ValueError("invalid output indices {}".format(indices))
+
+    def set_output_reducers(self, *reducers):
+        # reducers[i] is None or (kind, *params) for the network output i, see OUTPUT_REDUCER_* in interface.h:
+        # ("topk", k), ("argmax",), ("threshold", value), ("detect", score_thresh, iou_thresh, max_boxes)
+        c_reducers = (OutputReducer*len(reducers))()
+        for i, reducer in enumerate(reducers):
+            reducer = reducer or ("none",)
+            c_reducers[i].kind = ReducerKinds[reducer[0]]
+            for p, param in enumerate(reducer[1:]):
+                c_reducers[i].params[p] = param
+        if self.__lib.runner_set_output_reducers(self.runner_id, c_reducers, len(reducers)) != 0:
+            raise ValueError("invalid output reducers {}".format(reducers))
+
+    def set_image_input(self, resize="stretch", mean=(0, 0, 0), scale=(1, 1, 1), bgr=False, layout="auto",
+                        crop_factor=0.875, pad_color=(114, 114, 114)):
+        # how put_images() fills the input: resized, then (pixel - mean) * scale in the channel order of the input
+        spec = ImageSpec()
+        spec.resize_mode = ResizeModes[resize]
+        spec.crop_factor = crop_factor
+        spec.layout = ImageLayouts[layout]
+        spec.bgr = int(bgr)
+        for c in range(3):
+            spec.pad_color[c] = pad_color[c]
+            spec.mean[c] = mean[c]
+            spec.scale[c] = scale[c]
+        if self.__lib.runner_set_image_input(self.runner_id, ct.byref(spec)) != 0:
+            raise ValueError("invalid image input resize={} layout={} crop_factor={}".format(resize, layout, crop_factor))
+
+    def use_output_pool(self, enable=True):
+        # released outputs are recycled instead of freed
+        self.__lib.runner_use_output_pool(self.runner_id, int(enable))
+
+    def alloc_outputs(self):
+        # flat arrays large enough for the selected outputs of any task, to be reused by get_into()
+        num = ct.c_uint32(0)
+        self.__lib.get_output_sizes.restype = ct.POINTER(ct.c_uint32)
+        sizes = self.__lib.get_output_sizes(self.runner_id, ct.byref(num))
+        outputs = []
+        for i in range(num.value):
+            dtype = sizes[2*i+1]
+            outputs.append(np.empty(sizes[2*i]//bmlen(dtype), dtype=nptype(dtype)))
+        self.__lib.release_unsigned_pointer(sizes)
+        return outputs
+
+    def get_into(self, outputs):
+        # like get(), but the outputs are copied from device straight into the arrays from alloc_outputs(),
+        # returns views of them, do not mix with wait_task() on the same runner
+        bm_outputs = (BMTensor*len(outputs))()
+        capacities = (ct.c_uint32*len(outputs))()
+        for i, out in enumerate(outputs):
+            bm_outputs[i].data = out.ctypes.data_as(ct.c_void_p)
+            capacities[i] = out.nbytes
+        task_id = ct.c_uint32(0)
+        output_valid = ct.c_uint32(0)
+        output_num = self.__lib.runner_get_output_into(self.runner_id, ct.byref(task_id), ct.byref(output_valid),
+                                                       bm_outputs, capacities, len(outputs))
+        if output_num == -2:
+            raise ValueError("{} arrays are less than the outputs".format(len(outputs)))
+        if output_num == -3:
+            self.bm_inputs_kv.pop(task_id.value, None)
+            raise ValueError("the outputs of task {} do not fit in the arrays".format(task_id.value))
+        if output_num < 0 or task_id.value == 0:
+            return 0, [], 0
+        self.bm_inputs_kv.pop(task_id.value, None)
+        if output_valid.value == 0:
+            return task_id.value, [], False
+        views = []
+        for i in range(output_num):
+            shape = tuple(bm_outputs[i].shape[0:bm_outputs[i].dims])
+            views.append(outputs[i][:int(np.prod(shape))].reshape(shape))
+        return task_id.value, views, True
+
     def show(self):
         self.__lib.runner_show_status(self.runner_id)
 
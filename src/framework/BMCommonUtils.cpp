@@ -3,6 +3,7 @@
 #include<ctime>
 #include<iomanip>
 #include<sstream>
+#include<cmath>
 #include <sys/stat.h>
 #include <dirent.h>
 #include <functional>
@@ -65,6 +66,78 @@ size_t usBetween(const std::chrono::steady_clock::time_point &start,
 TimeRecorder::~TimeRecorder(){
 }
 
+const size_t LatencyHistogram::SUB_BITS;
+const size_t LatencyHistogram::MAX_BITS;
+const size_t LatencyHistogram::BUCKET_NUM;
+
+LatencyHistogram::LatencyHistogram(): totalCount(0), totalSum(0), maxValue(0) {
+    for(auto& c: counts){
+        c.store(0, std::memory_order_relaxed);
+    }
+}
+
+size_t LatencyHistogram::bucketIndex(uint64_t value) {
+    const uint64_t limit = (1ull<<MAX_BITS) - 1;
+    if(value > limit) value = limit;
+    if(value < (1ull<<SUB_BITS)) return value;
+    size_t msb = 63 - __builtin_clzll(value);
+    size_t shift = msb - SUB_BITS;
+    size_t sub = (value >> shift) - (1ull<<SUB_BITS);
+    return ((shift + 1) << SUB_BITS) + sub;
+}
+
+uint64_t LatencyHistogram::bucketValue(size_t index) {
+    size_t group = index >> SUB_BITS;
+    uint64_t sub = index & ((1ull<<SUB_BITS) - 1);
+    if(group == 0) return sub;
+    size_t shift = group - 1;
+    uint64_t lower = ((1ull<<SUB_BITS) + sub) << shift;
+    return lower + (1ull<<shift) - 1;
+}
+
+void LatencyHistogram::record(uint64_t value) {
+    // single writer: plain load and store are enough, and cheaper than atomic increments
+    auto& c = counts[bucketIndex(value)];
+    c.store(c.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    totalSum.store(totalSum.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    if(value > maxValue.load(std::memory_order_relaxed)){
+        maxValue.store(value, std::memory_order_relaxed);
+    }
+    totalCount.store(totalCount.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+void LatencyHistogram::merge(const LatencyHistogram &other) {
+    totalCount.fetch_add(other.totalCount.load(std::memory_order_acquire), std::memory_order_relaxed);
+    for(size_t i=0; i<BUCKET_NUM; i++){
+        auto c = other.counts[i].load(std::memory_order_relaxed);
+        if(c) counts[i].fetch_add(c, std::memory_order_relaxed);
+    }
+    totalSum.fetch_add(other.totalSum.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    auto otherMax = other.maxValue.load(std::memory_order_relaxed);
+    if(otherMax > maxValue.load(std::memory_order_relaxed)){
+        maxValue.store(otherMax, std::memory_order_relaxed);
+    }
+}
+
+uint64_t LatencyHistogram::percentile(double p) const {
+    uint64_t total = 0;
+    for(auto& c: counts){
+        total += c.load(std::memory_order_relaxed);
+    }
+    if(total == 0) return 0;
+    uint64_t target = (uint64_t)std::ceil(p/100.0*total);
+    if(target < 1) target = 1;
+    if(target > total) target = total;
+    uint64_t accum = 0;
+    for(size_t i=0; i<BUCKET_NUM; i++){
+        accum += counts[i].load(std::memory_order_relaxed);
+        if(accum >= target){
+            return std::min(bucketValue(i), max());
+        }
+    }
+    return max();
+}
+
 std::size_t strReplaceAll(std::string &inout, const std::string &what, const std::string &with)
 {
     std::size_t count{};
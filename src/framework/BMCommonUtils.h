@@ -9,6 +9,8 @@
 #include <vector>
 #include <algorithm>
 #include <functional>
+#include <atomic>
+#include <cstdint>
 
 namespace bm {
 
@@ -39,6 +41,34 @@ public:
     ~TimeRecorder();
 };
 
+// Log-linear buckets like HdrHistogram: values below 2^SUB_BITS are exact, larger values
+// keep SUB_BITS significant bits, so the relative error is below 1/2^SUB_BITS.
+// record() must be called from a single thread, reading and merging are safe from any thread.
+class LatencyHistogram: public Uncopiable {
+public:
+    static const size_t SUB_BITS = 5;
+    static const size_t MAX_BITS = 36;
+    static const size_t BUCKET_NUM = (MAX_BITS - SUB_BITS + 1) << SUB_BITS;
+
+    LatencyHistogram();
+    void record(uint64_t value);
+    void merge(const LatencyHistogram& other);
+    uint64_t count() const { return totalCount.load(std::memory_order_relaxed); }
+    uint64_t sum() const { return totalSum.load(std::memory_order_relaxed); }
+    uint64_t max() const { return maxValue.load(std::memory_order_relaxed); }
+    // p is in [0, 100], returns the highest value equivalent to the bucket
+    uint64_t percentile(double p) const;
+
+    static size_t bucketIndex(uint64_t value);
+    static uint64_t bucketValue(size_t index);
+
+private:
+    std::atomic<uint64_t> counts[BUCKET_NUM];
+    std::atomic<uint64_t> totalCount;
+    std::atomic<uint64_t> totalSum;
+    std::atomic<uint64_t> maxValue;
+};
+
 template <typename T>
 std::set<T> stringToSet(const std::string &s)
 {
@@ -0,0 +1,611 @@
+#include <cstring>
+#include "BMDataConvert.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define BM_SIMD_X86
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#define BM_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+namespace bm {
+
+// kernels convert the aligned body, the scalar loop finishes the tail,
+// so each element goes through exactly one int->float conversion and one multiply
+template<typename T>
+static void dequantizeScalar(const T* src, float* dst, size_t num, float scale) {
+    for(size_t i=0; i<num; i++){
+        dst[i] = src[i] * scale;
+    }
+}
+
+#ifdef BM_SIMD_X86
+template<bool SIGNED>
+__attribute__((target("sse4.1")))
+static size_t dequantizeSSE4(const uint8_t* src, float* dst, size_t num, float scale) {
+    auto vscale = _mm_set1_ps(scale);
+    size_t i = 0;
+    for(; i+16<=num; i+=16){
+        auto v = _mm_loadu_si128((const __m128i*)(src+i));
+        for(int k=0; k<4; k++){
+            auto part = k==0? v: k==1? _mm_srli_si128(v, 4): k==2? _mm_srli_si128(v, 8): _mm_srli_si128(v, 12);
+            auto ints = SIGNED? _mm_cvtepi8_epi32(part): _mm_cvtepu8_epi32(part);
+            _mm_storeu_ps(dst+i+4*k, _mm_mul_ps(_mm_cvtepi32_ps(ints), vscale));
+        }
+    }
+    return i;
+}
+
+template<bool SIGNED>
+__attribute__((target("avx2")))
+static size_t dequantizeAVX2(const uint8_t* src, float* dst, size_t num, float scale) {
+    auto vscale = _mm256_set1_ps(scale);
+    size_t i = 0;
+    for(; i+16<=num; i+=16){
+        auto v = _mm_loadu_si128((const __m128i*)(src+i));
+        auto lo = SIGNED? _mm256_cvtepi8_epi32(v): _mm256_cvtepu8_epi32(v);
+        auto hi = SIGNED? _mm256_cvtepi8_epi32(_mm_srli_si128(v, 8)): _mm256_cvtepu8_epi32(_mm_srli_si128(v, 8));
+        _mm256_storeu_ps(dst+i, _mm256_mul_ps(_mm256_cvtepi32_ps(lo), vscale));
+        _mm256_storeu_ps(dst+i+8, _mm256_mul_ps(_mm256_cvtepi32_ps(hi), vscale));
+    }
+    return i;
+}
+
+template<bool SIGNED>
+__attribute__((target("avx512f")))
+static size_t dequantizeAVX512(const uint8_t* src, float* dst, size_t num, float scale) {
+    auto vscale = _mm512_set1_ps(scale);
+    size_t i = 0;
+    for(; i+32<=num; i+=32){
+        auto v0 = _mm_loadu_si128((const __m128i*)(src+i));
+        auto v1 = _mm_loadu_si128((const __m128i*)(src+i+16));
+        auto i0 = SIGNED? _mm512_cvtepi8_epi32(v0): _mm512_cvtepu8_epi32(v0);
+        auto i1 = SIGNED? _mm512_cvtepi8_epi32(v1): _mm512_cvtepu8_epi32(v1);
+        _mm512_storeu_ps(dst+i, _mm512_mul_ps(_mm512_cvtepi32_ps(i0), vscale));
+        _mm512_storeu_ps(dst+i+16, _mm512_mul_ps(_mm512_cvtepi32_ps(i1), vscale));
+    }
+    return i;
+}
+#endif
+
+#ifdef BM_SIMD_NEON
+template<bool SIGNED>
+static size_t dequantizeNEON(const uint8_t* src, float* dst, size_t num, float scale) {
+    auto vscale = vdupq_n_f32(scale);
+    size_t i = 0;
+    for(; i+16<=num; i+=16){
+        int32x4_t ints[4];
+        if(SIGNED){
+            auto v = vld1q_s8((const int8_t*)src+i);
+            auto lo = vmovl_s8(vget_low_s8(v)), hi = vmovl_s8(vget_high_s8(v));
+            ints[0] = vmovl_s16(vget_low_s16(lo)); ints[1] = vmovl_s16(vget_high_s16(lo));
+            ints[2] = vmovl_s16(vget_low_s16(hi)); ints[3] = vmovl_s16(vget_high_s16(hi));
+        } else {
+            auto v = vld1q_u8(src+i);
+            auto lo = vmovl_u8(vget_low_u8(v)), hi = vmovl_u8(vget_high_u8(v));
+            ints[0] = vreinterpretq_s32_u32(vmovl_u16(vget_low_u16(lo)));
+            ints[1] = vreinterpretq_s32_u32(vmovl_u16(vget_high_u16(lo)));
+            ints[2] = vreinterpretq_s32_u32(vmovl_u16(vget_low_u16(hi)));
+            ints[3] = vreinterpretq_s32_u32(vmovl_u16(vget_high_u16(hi)));
+        }
+        for(int k=0; k<4; k++){
+            vst1q_f32(dst+i+4*k, vmulq_f32(vcvtq_f32_s32(ints[k]), vscale));
+        }
+    }
+    return i;
+}
+#endif
+
+static float halfToFloatScalar(uint16_t h) {
+    uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+    uint32_t exp = (h >> 10) & 0x1f;
+    uint32_t mant = h & 0x3ff;
+    uint32_t bits;
+    if(exp == 0x1f){
+        // inf, or a NaN with the quiet bit set as F16C does
+        bits = sign | 0x7f800000 | (mant << 13) | (mant? 0x400000: 0);
+    } else if(exp != 0){
+        bits = sign | ((exp + 112) << 23) | (mant << 13);
+    } else if(mant == 0){
+        bits = sign;
+    } else {
+        // subnormal half, normal float
+        uint32_t e = 113;
+        while(!(mant & 0x400)){
+            mant <<= 1;
+            e--;
+        }
+        bits = sign | (e << 23) | ((mant & 0x3ff) << 13);
+    }
+    float f;
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+static uint16_t floatToHalfScalar(float f) {
+    uint32_t x;
+    memcpy(&x, &f, sizeof(x));
+    uint16_t sign = (x >> 16) & 0x8000;
+    uint32_t absx = x & 0x7fffffff;
+    if(absx > 0x7f800000){
+        return sign | 0x7e00 | ((absx >> 13) & 0x3ff);
+    }
+    // 65520 and above round to inf
+    if(absx >= 0x477ff000){
+        return sign | 0x7c00;
+    }
+    uint32_t h, rem, halfway;
+    if(absx >= 0x38800000){
+        // normal half, rebias the exponent from 127 to 15
+        uint32_t r = absx - 0x38000000;
+        h = r >> 13;
+        rem = r & 0x1fff;
+        halfway = 0x1000;
+    } else {
+        // subnormal half in units of 2^-24, below 2^-25 always rounds to zero
+        uint32_t e = absx >> 23;
+        if(e < 102) return sign;
+        uint32_t mant = (absx & 0x7fffff) | 0x800000;
+        uint32_t shift = 126 - e;
+        h = mant >> shift;
+        rem = mant & ((1u << shift) - 1);
+        halfway = 1u << (shift - 1);
+    }
+    if(rem > halfway || (rem == halfway && (h & 1))) h++;
+    return sign | h;
+}
+
+static float bf16ToFloatScalar(uint16_t b) {
+    uint32_t bits = (uint32_t)b << 16;
+    float f;
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+static uint16_t floatToBf16Scalar(float f) {
+    uint32_t x;
+    memcpy(&x, &f, sizeof(x));
+    if((x & 0x7fffffff) > 0x7f800000){
+        return (x >> 16) | 0x40;
+    }
+    return (x + 0x7fff + ((x >> 16) & 1)) >> 16;
+}
+
+#ifdef BM_SIMD_X86
+__attribute__((target("avx2,f16c")))
+static size_t fp16ToFloatAVX2(const uint16_t* src, float* dst, size_t num) {
+    size_t i = 0;
+    for(; i+8<=num; i+=8){
+        _mm256_storeu_ps(dst+i, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)(src+i))));
+    }
+    return i;
+}
+
+__attribute__((target("avx2,f16c")))
+static size_t floatToFp16AVX2(const float* src, uint16_t* dst, size_t num) {
+    size_t i = 0;
+    for(; i+8<=num; i+=8){
+        auto h = _mm256_cvtps_ph(_mm256_loadu_ps(src+i), _MM_FROUND_TO_NEAREST_INT);
+        _mm_storeu_si128((__m128i*)(dst+i), h);
+    }
+    return i;
+}
+
+__attribute__((target("avx512f")))
+static size_t fp16ToFloatAVX512(const uint16_t* src, float* dst, size_t num) {
+    size_t i = 0;
+    for(; i+16<=num; i+=16){
+        _mm512_storeu_ps(dst+i, _mm512_cvtph_ps(_mm256_loadu_si256((const __m256i*)(src+i))));
+    }
+    return i;
+}
+
+__attribute__((target("avx512f")))
+static size_t floatToFp16AVX512(const float* src, uint16_t* dst, size_t num) {
+    size_t i = 0;
+    for(; i+16<=num; i+=16){
+        auto h = _mm512_cvtps_ph(_mm512_loadu_ps(src+i), _MM_FROUND_TO_NEAREST_INT);
+        _mm256_storeu_si256((__m256i*)(dst+i), h);
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+static size_t bf16ToFloatAVX2(const uint16_t* src, float* dst, size_t num) {
+    size_t i = 0;
+    for(; i+8<=num; i+=8){
+        auto v = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(src+i)));
+        _mm256_storeu_si256((__m256i*)(dst+i), _mm256_slli_epi32(v, 16));
+    }
+    return i;
+}
+
+// same rounding as floatToBf16Scalar, 32-bit results
+__attribute__((target("avx2")))
+static __m256i roundToBf16AVX2(__m256 f) {
+    auto x = _mm256_castps_si256(f);
+    auto lsb = _mm256_and_si256(_mm256_srli_epi32(x, 16), _mm256_set1_epi32(1));
+    auto rounded = _mm256_srli_epi32(_mm256_add_epi32(_mm256_add_epi32(x, _mm256_set1_epi32(0x7fff)), lsb), 16);
+    auto quiet = _mm256_or_si256(_mm256_srli_epi32(x, 16), _mm256_set1_epi32(0x40));
+    auto nan = _mm256_castps_si256(_mm256_cmp_ps(f, f, _CMP_UNORD_Q));
+    return _mm256_blendv_epi8(rounded, quiet, nan);
+}
+
+__attribute__((target("avx2")))
+static size_t floatToBf16AVX2(const float* src, uint16_t* dst, size_t num) {
+    size_t i = 0;
+    for(; i+16<=num; i+=16){
+        auto lo = roundToBf16AVX2(_mm256_loadu_ps(src+i));
+        auto hi = roundToBf16AVX2(_mm256_loadu_ps(src+i+8));
+        // packus interleaves 128-bit lanes, the permute restores the order
+        auto packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(lo, hi), 0xd8);
+        _mm256_storeu_si256((__m256i*)(dst+i), packed);
+    }
+    return i;
+}
+
+__attribute__((target("avx512f")))
+static size_t bf16ToFloatAVX512(const uint16_t* src, float* dst, size_t num) {
+    size_t i = 0;
+    for(; i+16<=num; i+=16){
+        auto v = _mm512_cvtepu16_epi32(_mm256_loadu_si256((const __m256i*)(src+i)));
+        _mm512_storeu_si512(dst+i, _mm512_slli_epi32(v, 16));
+    }
+    return i;
+}
+
+__attribute__((target("avx512f")))
+static size_t floatToBf16AVX512(const float* src, uint16_t* dst, size_t num) {
+    auto one = _mm512_set1_epi32(1);
+    auto bias = _mm512_set1_epi32(0x7fff);
+    auto quietBit = _mm512_set1_epi32(0x40);
+    size_t i = 0;
+    for(; i+16<=num; i+=16){
+        auto f = _mm512_loadu_ps(src+i);
+        auto x = _mm512_castps_si512(f);
+        auto lsb = _mm512_and_si512(_mm512_srli_epi32(x, 16), one);
+        auto rounded = _mm512_srli_epi32(_mm512_add_epi32(_mm512_add_epi32(x, bias), lsb), 16);
+        auto quiet = _mm512_or_si512(_mm512_srli_epi32(x, 16), quietBit);
+        auto nan = _mm512_cmp_ps_mask(f, f, _CMP_UNORD_Q);
+        auto result = _mm512_mask_blend_epi32(nan, rounded, quiet);
+        _mm256_storeu_si256((__m256i*)(dst+i), _mm512_cvtepi32_epi16(result));
+    }
+    return i;
+}
+#endif
+
+#ifdef BM_SIMD_NEON
+static size_t fp16ToFloatNEON(const uint16_t* src, float* dst, size_t num) {
+    size_t i = 0;
+    for(; i+4<=num; i+=4){
+        vst1q_f32(dst+i, vcvt_f32_f16(vreinterpret_f16_u16(vld1_u16(src+i))));
+    }
+    return i;
+}
+
+static size_t floatToFp16NEON(const float* src, uint16_t* dst, size_t num) {
+    size_t i = 0;
+    for(; i+4<=num; i+=4){
+        vst1_u16(dst+i, vreinterpret_u16_f16(vcvt_f16_f32(vld1q_f32(src+i))));
+    }
+    return i;
+}
+#endif
+
+// a group is LANES samples of the 1N tensor, rows beyond 'rows' are the padding of the last group
+template<typename T, size_t LANES>
+static void packGroupScalar(const T* src, T* dst, size_t rows, size_t inner, size_t begin) {
+    for(size_t i=begin; i<inner; i++){
+        for(size_t l=0; l<LANES; l++){
+            dst[i*LANES+l] = l<rows? src[l*inner+i]: 0;
+        }
+    }
+}
+
+template<typename T, size_t LANES>
+static void unpackGroupScalar(const T* src, T* dst, size_t rows, size_t inner, size_t begin) {
+    for(size_t i=begin; i<inner; i++){
+        for(size_t l=0; l<rows; l++){
+            dst[l*inner+i] = src[i*LANES+l];
+        }
+    }
+}
+
+#ifdef BM_SIMD_X86
+// the interleaving is bound by memory bandwidth, wider registers do not pay off,
+// so all x86 levels share these kernels
+__attribute__((target("sse4.1")))
+static size_t pack4NGroupSSE4(const uint8_t* src, uint8_t* dst, size_t rows, size_t inner) {
+    auto zero = _mm_setzero_si128();
+    size_t i = 0;
+    for(; i+16<=inner; i+=16){
+        auto a = _mm_loadu_si128((const __m128i*)(src+i));
+        auto b = rows>1? _mm_loadu_si128((const __m128i*)(src+inner+i)): zero;
+        auto c = rows>2? _mm_loadu_si128((const __m128i*)(src+2*inner+i)): zero;
+        auto d = rows>3? _mm_loadu_si128((const __m128i*)(src+3*inner+i)): zero;
+        auto abLo = _mm_unpacklo_epi8(a, b), abHi = _mm_unpackhi_epi8(a, b);
+        auto cdLo = _mm_unpacklo_epi8(c, d), cdHi = _mm_unpackhi_epi8(c, d);
+        auto out = (__m128i*)(dst+4*i);
+        _mm_storeu_si128(out, _mm_unpacklo_epi16(abLo, cdLo));
+        _mm_storeu_si128(out+1, _mm_unpackhi_epi16(abLo, cdLo));
+        _mm_storeu_si128(out+2, _mm_unpacklo_epi16(abHi, cdHi));
+        _mm_storeu_si128(out+3, _mm_unpackhi_epi16(abHi, cdHi));
+    }
+    return i;
+}
+
+__attribute__((target("sse4.1")))
+static size_t unpack4NGroupSSE4(const uint8_t* src, uint8_t* dst, size_t rows, size_t inner) {
+    // gathers the 4 bytes of every sample in a register, then a 4x4 transpose of 32-bit words
+    auto shuffle = _mm_setr_epi8(0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15);
+    size_t i = 0;
+    for(; i+16<=inner; i+=16){
+        auto in = (const __m128i*)(src+4*i);
+        auto v0 = _mm_shuffle_epi8(_mm_loadu_si128(in), shuffle);
+        auto v1 = _mm_shuffle_epi8(_mm_loadu_si128(in+1), shuffle);
+        auto v2 = _mm_shuffle_epi8(_mm_loadu_si128(in+2), shuffle);
+        auto v3 = _mm_shuffle_epi8(_mm_loadu_si128(in+3), shuffle);
+        auto t0 = _mm_unpacklo_epi32(v0, v1), t1 = _mm_unpacklo_epi32(v2, v3);
+        auto t2 = _mm_unpackhi_epi32(v0, v1), t3 = _mm_unpackhi_epi32(v2, v3);
+        _mm_storeu_si128((__m128i*)(dst+i), _mm_unpacklo_epi64(t0, t1));
+        if(rows>1) _mm_storeu_si128((__m128i*)(dst+inner+i), _mm_unpackhi_epi64(t0, t1));
+        if(rows>2) _mm_storeu_si128((__m128i*)(dst+2*inner+i), _mm_unpacklo_epi64(t2, t3));
+        if(rows>3) _mm_storeu_si128((__m128i*)(dst+3*inner+i), _mm_unpackhi_epi64(t2, t3));
+    }
+    return i;
+}
+
+__attribute__((target("sse4.1")))
+static size_t pack2NGroupSSE4(const uint16_t* src, uint16_t* dst, size_t rows, size_t inner) {
+    size_t i = 0;
+    for(; i+8<=inner; i+=8){
+        auto a = _mm_loadu_si128((const __m128i*)(src+i));
+        auto b = rows>1? _mm_loadu_si128((const __m128i*)(src+inner+i)): _mm_setzero_si128();
+        _mm_storeu_si128((__m128i*)(dst+2*i), _mm_unpacklo_epi16(a, b));
+        _mm_storeu_si128((__m128i*)(dst+2*i+8), _mm_unpackhi_epi16(a, b));
+    }
+    return i;
+}
+
+__attribute__((target("sse4.1")))
+static size_t unpack2NGroupSSE4(const uint16_t* src, uint16_t* dst, size_t rows, size_t inner) {
+    auto shuffle = _mm_setr_epi8(0, 1, 4, 5, 8, 9, 12, 13, 2, 3, 6, 7, 10, 11, 14, 15);
+    size_t i = 0;
+    for(; i+8<=inner; i+=8){
+        auto v0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(src+2*i)), shuffle);
+        auto v1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(src+2*i+8)), shuffle);
+        _mm_storeu_si128((__m128i*)(dst+i), _mm_unpacklo_epi64(v0, v1));
+        if(rows>1) _mm_storeu_si128((__m128i*)(dst+inner+i), _mm_unpackhi_epi64(v0, v1));
+    }
+    return i;
+}
+#endif
+
+#ifdef BM_SIMD_NEON
+static size_t pack4NGroupNEON(const uint8_t* src, uint8_t* dst, size_t rows, size_t inner) {
+    size_t i = 0;
+    for(; i+16<=inner; i+=16){
+        uint8x16x4_t v;
+        for(size_t l=0; l<4; l++){
+            v.val[l] = l<rows? vld1q_u8(src+l*inner+i): vdupq_n_u8(0);
+        }
+        vst4q_u8(dst+4*i, v);
+    }
+    return i;
+}
+
+static size_t unpack4NGroupNEON(const uint8_t* src, uint8_t* dst, size_t rows, size_t inner) {
+    size_t i = 0;
+    for(; i+16<=inner; i+=16){
+        auto v = vld4q_u8(src+4*i);
+        for(size_t l=0; l<rows; l++){
+            vst1q_u8(dst+l*inner+i, v.val[l]);
+        }
+    }
+    return i;
+}
+
+static size_t pack2NGroupNEON(const uint16_t* src, uint16_t* dst, size_t rows, size_t inner) {
+    size_t i = 0;
+    for(; i+8<=inner; i+=8){
+        uint16x8x2_t v;
+        v.val[0] = vld1q_u16(src+i);
+        v.val[1] = rows>1? vld1q_u16(src+inner+i): vdupq_n_u16(0);
+        vst2q_u16(dst+2*i, v);
+    }
+    return i;
+}
+
+static size_t unpack2NGroupNEON(const uint16_t* src, uint16_t* dst, size_t rows, size_t inner) {
+    size_t i = 0;
+    for(; i+8<=inner; i+=8){
+        auto v = vld2q_u16(src+2*i);
+        vst1q_u16(dst+i, v.val[0]);
+        if(rows>1) vst1q_u16(dst+inner+i, v.val[1]);
+    }
+    return i;
+}
+#endif
+
+static SimdLevel detectSimdLevel() {
+#if defined(BM_SIMD_X86)
+    __builtin_cpu_init();
+    // the fp16 kernels rely on F16C, present on every cpu with AVX2 in practice
+    bool f16c = __builtin_cpu_supports("f16c");
+    if(f16c && __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx2")) return SIMD_AVX512;
+    if(f16c && __builtin_cpu_supports("avx2")) return SIMD_AVX2;
+    if(__builtin_cpu_supports("sse4.1")) return SIMD_SSE4;
+#elif defined(BM_SIMD_NEON)
+    return SIMD_NEON;
+#endif
+    return SIMD_SCALAR;
+}
+
+SimdLevel getSimdLevel()
+{
+    static SimdLevel level = detectSimdLevel();
+    return level;
+}
+
+bool isSimdSupported(SimdLevel level)
+{
+    auto best = getSimdLevel();
+    if(level == SIMD_SCALAR) return true;
+    if(best == SIMD_NEON || level == SIMD_NEON) return level == best;
+    return level <= best;
+}
+
+const char *simdLevelName(SimdLevel level)
+{
+    static const char* names[] = {"scalar", "sse4", "avx2", "avx512", "neon"};
+    return level>=SIMD_SCALAR && level<=SIMD_NEON? names[level]: "unknown";
+}
+
+template<bool SIGNED>
+static size_t dequantizeBody(const uint8_t* src, float* dst, size_t num, float scale, SimdLevel level) {
+    switch(level){
+#ifdef BM_SIMD_X86
+    case SIMD_AVX512: return dequantizeAVX512<SIGNED>(src, dst, num, scale);
+    case SIMD_AVX2: return dequantizeAVX2<SIGNED>(src, dst, num, scale);
+    case SIMD_SSE4: return dequantizeSSE4<SIGNED>(src, dst, num, scale);
+#endif
+#ifdef BM_SIMD_NEON
+    case SIMD_NEON: return dequantizeNEON<SIGNED>(src, dst, num, scale);
+#endif
+    default: return 0;
+    }
+}
+
+void dequantize(const int8_t *src, float *dst, size_t num, float scale, SimdLevel level)
+{
+    size_t done = dequantizeBody<true>((const uint8_t*)src, dst, num, scale, level);
+    dequantizeScalar(src+done, dst+done, num-done, scale);
+}
+
+void dequantize(const uint8_t *src, float *dst, size_t num, float scale, SimdLevel level)
+{
+    size_t done = dequantizeBody<false>(src, dst, num, scale, level);
+    dequantizeScalar(src+done, dst+done, num-done, scale);
+}
+
+void fp16ToFloat(const uint16_t *src, float *dst, size_t num, SimdLevel level)
+{
+    size_t done = 0;
+    switch(level){
+#ifdef BM_SIMD_X86
+    case SIMD_AVX512: done = fp16ToFloatAVX512(src, dst, num); break;
+    case SIMD_AVX2: done = fp16ToFloatAVX2(src, dst, num); break;
+#endif
+#ifdef BM_SIMD_NEON
+    case SIMD_NEON: done = fp16ToFloatNEON(src, dst, num); break;
+#endif
+    default: break;
+    }
+    for(size_t i=done; i<num; i++) dst[i] = halfToFloatScalar(src[i]);
+}
+
+void floatToFp16(const float *src, uint16_t *dst, size_t num, SimdLevel level)
+{
+    size_t done = 0;
+    switch(level){
+#ifdef BM_SIMD_X86
+    case SIMD_AVX512: done = floatToFp16AVX512(src, dst, num); break;
+    case SIMD_AVX2: done = floatToFp16AVX2(src, dst, num); break;
+#endif
+#ifdef BM_SIMD_NEON
+    case SIMD_NEON: done = floatToFp16NEON(src, dst, num); break;
+#endif
+    default: break;
+    }
+    for(size_t i=done; i<num; i++) dst[i] = floatToHalfScalar(src[i]);
+}
+
+void bf16ToFloat(const uint16_t *src, float *dst, size_t num, SimdLevel level)
+{
+    size_t done = 0;
+    switch(level){
+#ifdef BM_SIMD_X86
+    case SIMD_AVX512: done = bf16ToFloatAVX512(src, dst, num); break;
+    case SIMD_AVX2: done = bf16ToFloatAVX2(src, dst, num); break;
+#endif
+    default: break;
+    }
+    for(size_t i=done; i<num; i++) dst[i] = bf16ToFloatScalar(src[i]);
+}
+
+void floatToBf16(const float *src, uint16_t *dst, size_t num, SimdLevel level)
+{
+    size_t done = 0;
+    switch(level){
+#ifdef BM_SIMD_X86
+    case SIMD_AVX512: done = floatToBf16AVX512(src, dst, num); break;
+    case SIMD_AVX2: done = floatToBf16AVX2(src, dst, num); break;
+#endif
+    default: break;
+    }
+    for(size_t i=done; i<num; i++) dst[i] = floatToBf16Scalar(src[i]);
+}
+
+// a group starts at sample b in both layouts, b*inner elements from the beginning
+void pack4N(const uint8_t *src, uint8_t *dst, size_t batch, size_t inner, SimdLevel level)
+{
+    for(size_t b=0; b<batch; b+=4){
+        size_t rows = batch-b<4? batch-b: 4;
+        size_t done = 0;
+#ifdef BM_SIMD_X86
+        if(level >= SIMD_SSE4 && level <= SIMD_AVX512) done = pack4NGroupSSE4(src+b*inner, dst+b*inner, rows, inner);
+#endif
+#ifdef BM_SIMD_NEON
+        if(level == SIMD_NEON) done = pack4NGroupNEON(src+b*inner, dst+b*inner, rows, inner);
+#endif
+        packGroupScalar<uint8_t, 4>(src+b*inner, dst+b*inner, rows, inner, done);
+    }
+}
+
+void unpack4N(const uint8_t *src, uint8_t *dst, size_t batch, size_t inner, SimdLevel level)
+{
+    for(size_t b=0; b<batch; b+=4){
+        size_t rows = batch-b<4? batch-b: 4;
+        size_t done = 0;
+#ifdef BM_SIMD_X86
+        if(level >= SIMD_SSE4 && level <= SIMD_AVX512) done = unpack4NGroupSSE4(src+b*inner, dst+b*inner, rows, inner);
+#endif
+#ifdef BM_SIMD_NEON
+        if(level == SIMD_NEON) done = unpack4NGroupNEON(src+b*inner, dst+b*inner, rows, inner);
+#endif
+        unpackGroupScalar<uint8_t, 4>(src+b*inner, dst+b*inner, rows, inner, done);
+    }
+}
+
+void pack2N(const uint16_t *src, uint16_t *dst, size_t batch, size_t inner, SimdLevel level)
+{
+    for(size_t b=0; b<batch; b+=2){
+        size_t rows = batch-b<2? batch-b: 2;
+        size_t done = 0;
+#ifdef BM_SIMD_X86
+        if(level >= SIMD_SSE4 && level <= SIMD_AVX512) done = pack2NGroupSSE4(src+b*inner, dst+b*inner, rows, inner);
+#endif
+#ifdef BM_SIMD_NEON
+        if(level == SIMD_NEON) done = pack2NGroupNEON(src+b*inner, dst+b*inner, rows, inner);
+#endif
+        packGroupScalar<uint16_t, 2>(src+b*inner, dst+b*inner, rows, inner, done);
+    }
+}
+
+void unpack2N(const uint16_t *src, uint16_t *dst, size_t batch, size_t inner, SimdLevel level)
+{
+    for(size_t b=0; b<batch; b+=2){
+        size_t rows = batch-b<2? batch-b: 2;
+        size_t done = 0;
+#ifdef BM_SIMD_X86
+        if(level >= SIMD_SSE4 && level <= SIMD_AVX512) done = unpack2NGroupSSE4(src+b*inner, dst+b*inner, rows, inner);
+#endif
+#ifdef BM_SIMD_NEON
+        if(level == SIMD_NEON) done = unpack2NGroupNEON(src+b*inner, dst+b*inner, rows, inner);
+#endif
+        unpackGroupScalar<uint16_t, 2>(src+b*inner, dst+b*inner, rows, inner, done);
+    }
+}
+
+}
@@ -0,0 +1,44 @@
+#ifndef BMDATACONVERT_H
+#define BMDATACONVERT_H
+#include <cstddef>
+#include <cstdint>
+
+namespace bm {
+
+// instruction sets of the host conversion kernels, selected once at runtime
+// every level gives bit-exact results with SIMD_SCALAR
+enum SimdLevel {
+    SIMD_SCALAR = 0,
+    SIMD_SSE4,
+    SIMD_AVX2,
+    SIMD_AVX512,
+    SIMD_NEON,
+};
+
+// the best level supported by the running cpu
+SimdLevel getSimdLevel();
+bool isSimdSupported(SimdLevel level);
+const char* simdLevelName(SimdLevel level);
+
+// dst[i] = src[i] * scale
+void dequantize(const int8_t* src, float* dst, size_t num, float scale, SimdLevel level = getSimdLevel());
+void dequantize(const uint8_t* src, float* dst, size_t num, float scale, SimdLevel level = getSimdLevel());
+
+// IEEE half and bfloat16, float to 16-bit rounds to nearest even and quiets NaNs
+// fp16 uses F16C from SIMD_AVX2 on, bf16 has no SSE4 or NEON kernel
+void fp16ToFloat(const uint16_t* src, float* dst, size_t num, SimdLevel level = getSimdLevel());
+void floatToFp16(const float* src, uint16_t* dst, size_t num, SimdLevel level = getSimdLevel());
+void bf16ToFloat(const uint16_t* src, float* dst, size_t num, SimdLevel level = getSimdLevel());
+void floatToBf16(const float* src, uint16_t* dst, size_t num, SimdLevel level = getSimdLevel());
+
+// BM_STORE_4N/BM_STORE_2N layouts: every 4(2) samples of the batch are interleaved element by element,
+// src/dst of 1N is [batch][inner], the packed one is [(batch+3)/4][inner][4] or [(batch+1)/2][inner][2]
+// packing fills the missing samples of the last group with zeros, unpacking writes only the batch samples
+void pack4N(const uint8_t* src, uint8_t* dst, size_t batch, size_t inner, SimdLevel level = getSimdLevel());
+void unpack4N(const uint8_t* src, uint8_t* dst, size_t batch, size_t inner, SimdLevel level = getSimdLevel());
+void pack2N(const uint16_t* src, uint16_t* dst, size_t batch, size_t inner, SimdLevel level = getSimdLevel());
+void unpack2N(const uint16_t* src, uint16_t* dst, size_t batch, size_t inner, SimdLevel level = getSimdLevel());
+
+}
+
+#endif // BMDATACONVERT_H
@@ -9,6 +9,13 @@ const char* __phaseMap[]={
     "POST-PROCESS"
 };
 
+const char* __phaseMetricMap[]={
+    "preprocess",
+    "forward",
+    "postprocess",
+    "total"
+};
+
 void *BMDeviceContext::getConfigData() const
 {
     return configData;
@@ -20,14 +27,21 @@ void BMDeviceContext::setConfigData(void *value)
 }
 
 BMDeviceContext::BMDeviceContext(DeviceId deviceId, const std::string &bmodel):
-    deviceId(deviceId), batchSize(batchSize), configData(nullptr) {
+    allocatedBytes(0), deviceId(deviceId), batchSize(batchSize), configData(nullptr) {
     batchSize = -1;
     BMLOG(INFO, "init context on device %d", deviceId);
     auto status = bm_dev_request(&handle, deviceId);
     BM_ASSERT_EQ(status, BM_SUCCESS);
     pBMRuntime = bmrt_create(handle);
     BM_ASSERT(pBMRuntime != nullptr, "cannot create bmruntime handle");
-    net = std::make_shared<BMNetwork>(pBMRuntime, bmodel);
+    try {
+        net = std::make_shared<BMNetwork>(pBMRuntime, bmodel);
+    } catch (...) {
+        // the destructor does not run for a throwing constructor
+        bmrt_destroy(pBMRuntime);
+        bm_dev_free(handle);
+        throw;
+    }
     batchSize = net->getBatchSize();
     net->showInfo();
 }
@@ -37,6 +51,7 @@ bm_device_mem_t BMDeviceContext::allocDeviceMem(size_t bytes) {
     if(bm_malloc_device_byte(handle, &mem, bytes) != BM_SUCCESS){
         BMLOG(FATAL, "cannot alloc device mem, size=%d", bytes);
     }
+    allocatedBytes += bytes;
     mem_to_free.push_back(mem);
     return mem;
 }
@@ -46,6 +61,7 @@ void BMDeviceContext::freeDeviceMem(bm_device_mem_t &mem){
             return bm_mem_get_device_addr(m) ==  bm_mem_get_device_addr(mem);
     });
     BM_ASSERT(iter != mem_to_free.end(), "cannot free mem!");
+    allocatedBytes -= bm_mem_get_device_size(*iter);
     bm_free_device(handle, mem);
     mem_to_free.erase(iter);
 }
@@ -57,12 +73,14 @@ bm_device_mem_t BMDeviceContext::getOrAllocNamedDeviceMem(const std::string& nam
         if(old_byte_size <= byte_size) {
             return mem;
         }
+        allocatedBytes -= old_byte_size;
         bm_free_device(handle, mem);
     }
     bm_device_mem_t mem;
     if(bm_malloc_device_byte(handle, &mem, byte_size) != BM_SUCCESS){
         BMLOG(FATAL, "cannot alloc device mem, size=%d", byte_size);
     }
+    allocatedBytes += byte_size;
     name_to_mem[name] = mem;
     return mem;
 }
@@ -73,6 +91,7 @@ void BMDeviceContext::freeNamedDeviceMem(const std::string& name){
         return;
     }
     auto& mem = name_to_mem.at(name);
+    allocatedBytes -= bm_mem_get_device_size(mem);
     bm_free_device(handle, mem);
     name_to_mem.erase(name);
 }
@@ -96,6 +115,17 @@ std::vector<bm_image> BMDeviceContext::allocImagesWithoutMem(
     return images;
 }
 
+static size_t __imageBytes(const std::vector<bm_image>& images) {
+    size_t bytes = 0;
+    for(auto& image: images){
+        int planeSizes[4] = {0};
+        if(bm_image_get_byte_size(image, planeSizes) != BM_SUCCESS) continue;
+        auto planeNum = std::min(bm_image_get_plane_num(image), 4);
+        for(int i=0; i<planeNum; i++) bytes += planeSizes[i];
+    }
+    return bytes;
+}
+
 std::vector<bm_image> BMDeviceContext::allocImages(int num, int height, int width, bm_image_format_ext format, bm_image_data_format_ext dtype, int align_bytes, int heap_id) {
     auto stride = calcImageStride(height, width, format, dtype, align_bytes);
     std::vector<bm_image> images;
@@ -105,6 +135,7 @@ std::vector<bm_image> BMDeviceContext::allocImages(int num, int height, int widt
         images.push_back(image);
     }
     bm_image_alloc_contiguous_mem(num, images.data(), heap_id);
+    allocatedBytes += __imageBytes(images);
     images_to_free.push_back(images);
     return images;
 }
@@ -123,6 +154,7 @@ void BMDeviceContext::freeImages(std::vector<bm_image>& images)
             return bm_mem_get_device_addr(ref_mem) ==  bm_mem_get_device_addr(mem);
     });
     if(iter == images_to_free.end()) return;
+    allocatedBytes -= __imageBytes(images);
     bm_image_free_contiguous_mem(images.size(), images.data());
     for(auto& image: images){
         bm_image_destroy(image);
@@ -152,81 +184,301 @@ BMDeviceContext::~BMDeviceContext() {
     bm_dev_free(handle);
 }
 
-void ProcessStatInfo::update(const std::shared_ptr<ProcessStatus> &status, size_t batch) {
-    if(status->valid){
-        numSamples += batch;
-        totalDuration += status->totalDuration();
-        for(size_t i = durations.size(); i<status->starts.size(); i++){
-            durations.push_back(0);
+void PhaseHistograms::record(const ProcessStatus &status, size_t batch) {
+    for(size_t i=0; i<status.phaseNum; i++){
+        phases[i].record(status.duration(i));
+    }
+    total.record(status.totalDuration());
+    samples.store(samples.load(std::memory_order_relaxed) + batch, std::memory_order_relaxed);
+}
+
+void PhaseHistograms::merge(const PhaseHistograms &other) {
+    for(size_t i=0; i<ProcessStatus::PHASE_NUM; i++){
+        phases[i].merge(other.phases[i]);
+    }
+    total.merge(other.total);
+    samples.fetch_add(other.samples.load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
+
+const size_t ProcessStatus::PHASE_NUM;
+const size_t ProcessStatInfo::PERCENTILE_NUM;
+const double ProcessStatInfo::PERCENTILES[ProcessStatInfo::PERCENTILE_NUM] = {50, 90, 99, 99.9};
+
+static std::atomic<size_t> __statInfoId(0);
+
+ProcessStatInfo::ProcessStatInfo(const std::string &name):
+    name(name), startTime(std::chrono::steady_clock::now()), id(__statInfoId++) {
+    metricsId = BMMetrics::instance().addCollector([this](MetricsWriter& writer){
+        collectMetrics(writer);
+    });
+}
+
+ProcessStatInfo::~ProcessStatInfo() {
+    BMMetrics::instance().removeCollector(metricsId);
+}
+
+void ProcessStatInfo::collectMetrics(MetricsWriter &writer) {
+    uint64_t numTimeouts;
+    auto merged = mergeStats(numTimeouts);
+    auto now = std::chrono::steady_clock::now();
+    writer.counter("bmservice_timeouts_total", "Tasks failed by the watchdog",
+                   {{"model", name}}, numTimeouts);
+    writer.counter("bmservice_expired_total", "Tasks cancelled or past their deadlines",
+                   {{"model", name}}, getExpiredNum());
+    std::lock_guard<std::mutex> guard(rateMutex);
+    for(auto& item: merged){
+        MetricLabels labels = {{"model", name}, {"device", std::to_string(item.first)}};
+        auto& hists = *item.second;
+        uint64_t samples = hists.samples;
+        auto& rate = rates[item.first];
+        if(rate.time == std::chrono::steady_clock::time_point()){
+            rate.time = startTime;
         }
-        for(size_t i=0; i<status->starts.size(); i++){
-            durations[i] += usBetween(status->starts[i], status->ends[i]);
+        auto elapsedUs = usBetween(rate.time, now);
+        if(elapsedUs >= 1000000){
+            rate.rate = (samples - rate.samples)*1e6/elapsedUs;
+            rate.samples = samples;
+            rate.time = now;
+        }
+        writer.counter("bmservice_samples_total", "Processed samples", labels, samples);
+        writer.gauge("bmservice_samples_per_second", "Processed samples per second", labels, rate.rate);
+        for(size_t i=0; i<=ProcessStatus::PHASE_NUM; i++){
+            auto& hist = i<ProcessStatus::PHASE_NUM? hists.phases[i]: hists.total;
+            std::vector<std::pair<double, double>> quantiles;
+            for(auto p: PERCENTILES){
+                quantiles.emplace_back(p/100, hist.percentile(p));
+            }
+            auto phaseLabels = labels;
+            phaseLabels.emplace_back("phase", __phaseMetricMap[i]);
+            writer.summary("bmservice_task_latency_us", "Task latency per phase in microseconds",
+                           phaseLabels, quantiles, hist.sum(), hist.count());
         }
-        deviceProcessNum[status->deviceId] += batch;
     }
 }
 
+ProcessStatInfo::ThreadStat &ProcessStatInfo::localStat() {
+    // ids are never reused, so entries of destroyed infos are never hit again
+    thread_local std::map<size_t, ThreadStat*> localStats;
+    auto iter = localStats.find(id);
+    if(iter != localStats.end()) return *iter->second;
+    std::lock_guard<std::mutex> guard(statMutex);
+    threadStats.emplace_back(new ThreadStat);
+    localStats[id] = threadStats.back().get();
+    return *threadStats.back();
+}
+
+void ProcessStatInfo::update(const ProcessStatus &status, size_t batch) {
+    if(status.warmUp) return;
+    auto& stat = localStat();
+    if(status.timeout){
+        stat.numTimeouts.fetch_add(batch, std::memory_order_relaxed);
+    }
+    if(status.expired){
+        stat.numExpired.fetch_add(batch, std::memory_order_relaxed);
+    }
+    if(!status.valid) return;
+    // only this thread inserts, readers lock the mutex to iterate
+    auto iter = stat.devices.find(status.deviceId);
+    if(iter == stat.devices.end()){
+        std::lock_guard<std::mutex> guard(stat.mutex);
+        iter = stat.devices.emplace(status.deviceId, std::unique_ptr<PhaseHistograms>(new PhaseHistograms)).first;
+    }
+    iter->second->record(status, batch);
+}
+
+std::map<DeviceId, std::unique_ptr<PhaseHistograms>> ProcessStatInfo::mergeStats(uint64_t& numTimeouts) {
+    std::map<DeviceId, std::unique_ptr<PhaseHistograms>> merged;
+    numTimeouts = 0;
+    std::lock_guard<std::mutex> guard(statMutex);
+    for(auto& stat: threadStats){
+        numTimeouts += stat->numTimeouts.load(std::memory_order_relaxed);
+        std::lock_guard<std::mutex> deviceGuard(stat->mutex);
+        for(auto& item: stat->devices){
+            auto& hist = merged[item.first];
+            if(!hist) hist.reset(new PhaseHistograms);
+            hist->merge(*item.second);
+        }
+    }
+    return merged;
+}
+
 void ProcessStatInfo::start() {
     startTime=std::chrono::steady_clock::now();
 }
 
+size_t ProcessStatInfo::getSampleNum() {
+    uint64_t numTimeouts;
+    size_t numSamples = 0;
+    for(auto& item: mergeStats(numTimeouts)){
+        numSamples += item.second->samples;
+    }
+    return numSamples;
+}
+
+uint64_t ProcessStatInfo::getExpiredNum() {
+    uint64_t numExpired = 0;
+    std::lock_guard<std::mutex> guard(statMutex);
+    for(auto& stat: threadStats){
+        numExpired += stat->numExpired.load(std::memory_order_relaxed);
+    }
+    return numExpired;
+}
+
 uint32_t *ProcessStatInfo::get_durations(unsigned *num) {
-    *num = durations.size();
-    auto data = new uint32_t[durations.size()];
-    std::copy(durations.begin(), durations.end(), data);
+    uint64_t numTimeouts;
+    auto merged = mergeStats(numTimeouts);
+    *num = merged.empty()? 0: ProcessStatus::PHASE_NUM;
+    auto data = new uint32_t[ProcessStatus::PHASE_NUM];
+    for(size_t i=0; i<ProcessStatus::PHASE_NUM; i++){
+        uint64_t sum = 0;
+        for(auto& item: merged) sum += item.second->phases[i].sum();
+        data[i] = sum;
+    }
     return data;
 }
 
+uint32_t *ProcessStatInfo::get_percentiles(int deviceId, unsigned *num) {
+    uint64_t numTimeouts;
+    auto merged = mergeStats(numTimeouts);
+    PhaseHistograms selected;
+    for(auto& item: merged){
+        if(deviceId<0 || (DeviceId)deviceId == item.first) selected.merge(*item.second);
+    }
+    *num = (ProcessStatus::PHASE_NUM + 1) * PERCENTILE_NUM;
+    auto data = new uint32_t[*num];
+    for(size_t i=0; i<=ProcessStatus::PHASE_NUM; i++){
+        auto& hist = i<ProcessStatus::PHASE_NUM? selected.phases[i]: selected.total;
+        for(size_t j=0; j<PERCENTILE_NUM; j++){
+            data[i*PERCENTILE_NUM + j] = hist.percentile(PERCENTILES[j]);
+        }
+    }
+    return data;
+}
+
+static void __showPercentiles(const char* title, const LatencyHistogram& hist) {
+    if(hist.count() == 0) return;
+    BMLOG(INFO, "  -> %s avg=%gms, p50=%gms, p90=%gms, p99=%gms, p99.9=%gms, max=%gms",
+          title, hist.sum()/1000.0/hist.count(),
+          hist.percentile(50)/1000.0, hist.percentile(90)/1000.0,
+          hist.percentile(99)/1000.0, hist.percentile(99.9)/1000.0,
+          hist.max()/1000.0);
+}
+
+static void __showPhaseHistograms(const PhaseHistograms& hists) {
+    for(size_t i=0; i<ProcessStatus::PHASE_NUM; i++){
+        __showPercentiles(__phaseMap[i], hists.phases[i]);
+    }
+    __showPercentiles("TOTAL", hists.total);
+}
+
 void ProcessStatInfo::show() {
     auto end = std::chrono::steady_clock::now();
     auto totalUs = usBetween(startTime, end);
+    uint64_t numTimeouts;
+    auto merged = mergeStats(numTimeouts);
+    PhaseHistograms all;
+    for(auto& item: merged){
+        all.merge(*item.second);
+    }
+    size_t numSamples = all.samples;
     BMLOG(INFO, "For model '%s'", name.c_str());
     BMLOG(INFO, "  num_sample=%d: total_time=%gms, avg_time=%gms, speed=%g samples/sec",
           numSamples, totalUs/1000.0, (float)totalUs/1000.0/numSamples,
           numSamples*1e6/totalUs);
-    //        BMLOG(INFO, "            serialized_time=%gms, avg_serialized_time=%gms", totalDuration/1000.0, (float)totalDuration/1000.0/numSamples);
 
+    if(numTimeouts>0){
+        BMLOG(INFO, "  num_timeout=%d", numTimeouts);
+    }
+    auto numExpired = getExpiredNum();
+    if(numExpired>0){
+        BMLOG(INFO, "  num_expired=%d", numExpired);
+    }
     BMLOG(INFO, "Samples process stat:");
-    for(auto& p: deviceProcessNum){
-        BMLOG(INFO, "  -> device #%d processes %d samples", p.first, p.second);
+    for(auto& p: merged){
+        BMLOG(INFO, "  -> device #%d processes %d samples", p.first, p.second->samples.load());
     }
     BMLOG(INFO, "Average per device:");
-    for(size_t i=0; i<durations.size(); i++){
+    for(size_t i=0; i<ProcessStatus::PHASE_NUM; i++){
+        auto sum = all.phases[i].sum();
+        if(sum == 0) continue;
         BMLOG(INFO, "  -> %s total_time=%gms, avg_time=%gms",
               __phaseMap[i],
-              durations[i]/1000.0, durations[i]/1000.0/numSamples);
+              sum/1000.0, sum/1000.0/numSamples);
+    }
+    BMLOG(INFO, "Latency per task of all devices:");
+    __showPhaseHistograms(all);
+    if(merged.size()>1){
+        for(auto& p: merged){
+            BMLOG(INFO, "Latency per task of device #%d:", p.first);
+            __showPhaseHistograms(*p.second);
+        }
+    }
+}
+
+void WarmUpStatInfo::update(const ProcessStatus &status) {
+    auto deviceId = status.deviceId;
+    if(deviceTaskNum[deviceId]++ == 0){
+        coldStatus[deviceId] = status;
+    }
+    warmStatus[deviceId] = status;
+}
+
+size_t WarmUpStatInfo::minTaskNum(const std::vector<DeviceId> &deviceIds) const {
+    size_t minNum = -1;
+    for(auto id: deviceIds){
+        auto iter = deviceTaskNum.find(id);
+        size_t num = iter == deviceTaskNum.end()? 0: iter->second;
+        minNum = std::min(minNum, num);
+    }
+    return deviceIds.empty()? 0: minNum;
+}
+
+void WarmUpStatInfo::show() {
+    BMLOG(INFO, "Warm-up stat:");
+    for(auto& p: deviceTaskNum){
+        auto& cold = coldStatus[p.first];
+        auto& warm = warmStatus[p.first];
+        BMLOG(INFO, "  -> device #%d processes %d warm-up tasks, cold_total=%gms, warm_total=%gms",
+              p.first, p.second, cold.totalDuration()/1000.0, warm.totalDuration()/1000.0);
+        auto phaseNum = std::min(cold.phaseNum, warm.phaseNum);
+        for(size_t i=0; i<phaseNum; i++){
+            BMLOG(INFO, "     %s cold_time=%gms, warm_time=%gms",
+                  __phaseMap[i], cold.duration(i)/1000.0, warm.duration(i)/1000.0);
+        }
     }
 }
 
 void ProcessStatus::reset(){
-    starts.clear();
-    ends.clear();
-    valid = false;
+    *this = ProcessStatus();
 }
 
 void ProcessStatus::start(){
-    starts.push_back(std::chrono::steady_clock::now());
-    ends.push_back(starts.back());
+    if(phaseNum >= PHASE_NUM) return;
+    starts[phaseNum] = std::chrono::steady_clock::now();
+    ends[phaseNum] = starts[phaseNum];
+    phaseNum++;
 }
 
 void ProcessStatus::end(){
-    ends.back() = std::chrono::steady_clock::now();
+    if(phaseNum == 0) return;
+    ends[phaseNum-1] = std::chrono::steady_clock::now();
 }
 
-void ProcessStatus::show() {
+void ProcessStatus::show() const {
     BMLOG(INFO, "device_id=%d, valid=%d, total=%dus", deviceId, valid, totalDuration());
-    for(size_t i=0; i<starts.size(); i++){
-        auto startStr = steadyToString(starts[i]);
-        auto endStr = steadyToString(ends[i]);
-        BMLOG(INFO, "  -> %s: duration=%dus",
-              __phaseMap[i],
-              usBetween(starts[i], ends[i]),
-              startStr.c_str(), endStr.c_str());
+    for(size_t i=0; i<phaseNum; i++){
+        BMLOG(INFO, "  -> %s: duration=%dus", __phaseMap[i], duration(i));
     }
 }
 
+size_t ProcessStatus::duration(size_t phase) const {
+    if(phase >= phaseNum) return 0;
+    return usBetween(starts[phase], ends[phase]);
+}
+
 size_t ProcessStatus::totalDuration() const {
-    return usBetween(starts.front(), ends.back());
+    if(phaseNum == 0) return 0;
+    return usBetween(starts[0], ends[phaseNum-1]);
 }
 
 }
@@ -5,15 +5,22 @@
 #include <algorithm>
 #include <exception>
 #include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include "BMEnv.h"
 #include "BMDeviceUtils.h"
 #include "BMPipelinePool.h"
 #include "BMNetwork.h"
+#include "BMMetrics.h"
 #include "bmlib_runtime.h"
 #include "bmcv_api.h"
 
 namespace bm {
 
 extern const char* __phaseMap[];
+// phase names used as metric labels
+extern const char* __phaseMetricMap[];
 class BMDeviceContext {
 private:
     std::vector<bm_device_mem_t> mem_to_free;
@@ -22,6 +29,8 @@ private:
     std::map<std::string, bm_device_mem_t> name_to_mem;
     void* preExtra;
     void* postExtra;
+    // device memory allocated through this context, for metrics
+    std::atomic_size_t allocatedBytes;
 
 public:
    using Ptr = typename std::shared_ptr<BMDeviceContext>;
@@ -41,6 +50,7 @@ public:
 
     std::shared_ptr<BMNetwork> getNetwork() { return net; }
     size_t getBatchSize(){ return batchSize; }
+    size_t getAllocatedBytes() const { return allocatedBytes.load(std::memory_order_relaxed); }
 
 
     bm_device_mem_t allocDeviceMem(size_t bytes);
@@ -92,33 +102,113 @@ public:
 
 using ContextPtr = BMDeviceContext::Ptr;
 
+// deadline and cancel flag of a task, shared by the caller and the stages
+struct TaskControl {
+    using Ptr = std::shared_ptr<TaskControl>;
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+    std::atomic_bool cancelled{false};
+    bool expired() const {
+        return cancelled || std::chrono::steady_clock::now() > deadline;
+    }
+};
+
+// timestamps of a task, carried inline through the pipeline
 struct ProcessStatus {
-    DeviceId deviceId;
-    bool valid;
-    std::vector<std::chrono::steady_clock::time_point> starts;
-    std::vector<std::chrono::steady_clock::time_point> ends;
+    static const size_t PHASE_NUM = 3;
+    DeviceId deviceId = 0;
+    bool valid = false;
+    bool warmUp = false;
+    // failed by watchdog
+    bool timeout = false;
+    // given back to other devices by a failed device
+    bool rerouted = false;
+    // the result has been replaced by a failed one, and will be discarded when it comes out
+    bool dropped = false;
+    // cancelled or past its deadline, the remaining stages are skipped
+    bool expired = false;
+    size_t phaseNum = 0;
+    std::chrono::steady_clock::time_point starts[PHASE_NUM];
+    std::chrono::steady_clock::time_point ends[PHASE_NUM];
     void reset();
     void start();
     void end();
-    void show();
+    void show() const;
+    size_t duration(size_t phase) const;
     size_t totalDuration() const;
 
 };
 
-struct ProcessStatInfo {
-    size_t totalDuration = 0;
-    size_t numSamples = 0;
-    std::map<size_t, size_t> deviceProcessNum;
-    std::vector<size_t> durations;
+// percentile(p) of the phases and the whole task
+struct PhaseHistograms {
+    LatencyHistogram phases[ProcessStatus::PHASE_NUM];
+    LatencyHistogram total;
+    std::atomic<uint64_t> samples{0};
+    void record(const ProcessStatus& status, size_t batch);
+    void merge(const PhaseHistograms& other);
+};
+
+// update() can be called from any threads, each thread records into its own histograms,
+// which are merged when reading. The stats are also exported by BMMetrics.
+class ProcessStatInfo {
+public:
+    static const size_t PERCENTILE_NUM = 4;
+    static const double PERCENTILES[PERCENTILE_NUM];
+
     std::string name;
     std::chrono::steady_clock::time_point startTime;
-    ProcessStatInfo(const std::string& name): name(name), startTime(std::chrono::steady_clock::now()){ }
-    void update(const std::shared_ptr<ProcessStatus>& status, size_t batch=1);
+    ProcessStatInfo(const std::string& name);
+    void update(const ProcessStatus& status, size_t batch=1);
     uint32_t *get_durations(unsigned *num);
+    // (p50, p90, p99, p99.9) in us of each phase and the whole task,
+    // deviceId<0 means all devices
+    uint32_t *get_percentiles(int deviceId, unsigned *num);
+    size_t getSampleNum();
+    uint64_t getExpiredNum();
     void show();
     void start();
-    ~ProcessStatInfo(){
-    }
+    ~ProcessStatInfo();
+
+private:
+    struct ThreadStat {
+        std::mutex mutex;
+        std::map<DeviceId, std::unique_ptr<PhaseHistograms>> devices;
+        std::atomic<uint64_t> numTimeouts{0};
+        std::atomic<uint64_t> numExpired{0};
+    };
+    size_t id;
+    std::mutex statMutex;
+    std::vector<std::unique_ptr<ThreadStat>> threadStats;
+    ThreadStat& localStat();
+    std::map<DeviceId, std::unique_ptr<PhaseHistograms>> mergeStats(uint64_t& numTimeouts);
+
+    // samples/sec of each device since the last scrape which is at least 1s ago
+    struct RateInfo {
+        std::chrono::steady_clock::time_point time;
+        uint64_t samples = 0;
+        double rate = 0;
+    };
+    std::mutex rateMutex;
+    std::map<DeviceId, RateInfo> rates;
+    size_t metricsId;
+    void collectMetrics(MetricsWriter& writer);
+};
+
+// keeps the first(cold) and the last(warm) warm-up task of each device
+struct WarmUpStatInfo {
+    std::map<size_t, size_t> deviceTaskNum;
+    std::map<size_t, ProcessStatus> coldStatus;
+    std::map<size_t, ProcessStatus> warmStatus;
+    void update(const ProcessStatus& status);
+    size_t minTaskNum(const std::vector<DeviceId>& deviceIds) const;
+    void show();
+};
+
+enum WatchdogAction {
+    WATCHDOG_REPORT = 0,
+    // return the stalled task as invalid, its late result is discarded
+    WATCHDOG_FAIL_TASK = 1,
+    // fail all tasks on the device and stop dispatching new tasks to it until the stalled stage returns
+    WATCHDOG_FAIL_DEVICE = 2,
 };
 
 template<typename InType, typename OutType>
@@ -126,30 +216,51 @@ class BMDevicePool {
 public:
     using ContextType = BMDeviceContext;
 
+    struct _PreInType {
+        InType in;
+        bool warmUp = false;
+        TaskControl::Ptr control;
+    };
+
     struct _PreOutType {
         InType in;
+        TaskControl::Ptr control;
         TensorVec preOut;
-        std::shared_ptr<ProcessStatus> status;
+        ProcessStatus status;
         void* extra;
     };
 
     struct _ForwardOutType {
         InType in;
+        TaskControl::Ptr control;
         TensorVec forwardOut;
-        std::shared_ptr<ProcessStatus> status;
+        ProcessStatus status;
         void* extra;
     };
 
     struct _PostOutType {
         InType in;
         OutType out;
-        std::shared_ptr<ProcessStatus> status;
+        ProcessStatus status;
     };
 
-    using RunnerType = BMPipelinePool<InType, _PostOutType, BMDeviceContext>;
+    using RunnerType = BMPipelinePool<_PreInType, _PostOutType, BMDeviceContext>;
     using RunnerPtr = std::shared_ptr<RunnerType>;
     using PreProcessFunc = std::function<bool(const InType&, const TensorVec&, ContextPtr)>;
     using PostProcessFunc = std::function<bool(const InType&, const TensorVec&, OutType&, ContextPtr)>;
+    // creates a synthetic input for warm-up, and releases its output if needed
+    using WarmUpInputFunc = std::function<InType(const bm_net_info_t*)>;
+    using WarmUpOutputFunc = std::function<void(OutType&)>;
+    // releases the results which are never returned to users, such as warm-up and dropped ones
+    using ReleaseOutputFunc = std::function<void(OutType&)>;
+    // makes the output of an expired task instead of the post-process, such as keeping its id and releasing its input
+    using ExpiredOutputFunc = std::function<void(const InType&, OutType&)>;
+    // makes the output of a task failed by the watchdog, such as keeping its id,
+    // the input is still used by the stalled stage, which releases it as usual when it returns,
+    // it is called as every stage starts while the watchdog is on, so it only copies plain values of the input
+    using FailedOutputFunc = std::function<void(const InType&, OutType&)>;
+    // tells if a task is cancelled without a TaskControl, so pushes need no allocation
+    using CancelledFunc = std::function<bool(const InType&)>;
     std::atomic_size_t atomicBatchSize;
     
     BMDevicePool(const std::string& bmodel, PreProcessFunc preProcessFunc, PostProcessFunc postProcessFunc,
@@ -158,6 +269,29 @@ public:
         if(userDeviceIds.empty()){
            deviceIds = getAvailableDevices();
         }
+        warmUpRounds = 0;
+        nativeInputStoreMode = false;
+        nativeOutputStoreMode = false;
+        auto rounds_cstr = getenv(BM_WARMUP_ROUNDS);
+        if(rounds_cstr){
+            warmUpRounds = atoi(rounds_cstr);
+        }
+        watchdogTimeoutMs = 0;
+        watchdogAction = WATCHDOG_FAIL_TASK;
+        watchdogDone = true;
+        metricsRegistered = false;
+        auto timeout_cstr = getenv(BM_WATCHDOG_TIMEOUT_MS);
+        if(timeout_cstr){
+            watchdogTimeoutMs = atoi(timeout_cstr);
+        }
+        auto action_cstr = getenv(BM_WATCHDOG_ACTION);
+        if(action_cstr){
+            watchdogAction = (WatchdogAction)atoi(action_cstr);
+        }
+        auto store_cstr = getenv(BM_NATIVE_STORE_MODE);
+        if(store_cstr){
+            nativeOutputStoreMode = atoi(store_cstr) != 0;
+        }
     }
     void __init(){
         auto localDeviceIds = deviceIds;
@@ -181,28 +315,43 @@ public:
         };
 
         pool = std::make_shared<RunnerType>(deviceNum, contextInitializer, nullptr, nameFunc);
+        for(size_t i=0; i<deviceNum; i++){
+            trackers[deviceIds[i]].reset(new _DeviceTracker(i, deviceIds[i]));
+        }
 
         auto inQueue = pool->getInputQueue();
         inQueue->setMaxNode(deviceNum*4);
 
         PreProcessFunc preCoreFunc = preProcessFunc;
         PostProcessFunc postCoreFunc = postProcessFunc;
-        std::function<bool(const InType&, _PreOutType&, ContextPtr ctx)> preFunc =
-                [this, preCoreFunc] (const InType& in, _PreOutType& out, ContextPtr ctx){
+        std::function<bool(const _PreInType&, _PreOutType&, ContextPtr ctx)> preFunc =
+                [this, preCoreFunc] (const _PreInType& in, _PreOutType& out, ContextPtr ctx){
             return preProcess(in, out, ctx, preCoreFunc);
         };
-        std::function<std::vector<_PreOutType>(ContextPtr)> preCreateFunc = createPreProcessOutput;
+        std::function<std::vector<_PreOutType>(ContextPtr)> preCreateFunc = [this](ContextPtr ctx){
+            return createPreProcessOutput(ctx, nativeInputStoreMode);
+        };
         pool->addNode(preFunc, preCreateFunc);
 
-        std::function<bool(const _PreOutType&, _ForwardOutType&, ContextPtr)> forwardFunc = forward;
-        std::function<std::vector<_ForwardOutType>(ContextPtr)> createForwardFunc = createForwardOutput;
+        std::function<bool(const _PreOutType&, _ForwardOutType&, ContextPtr)> forwardFunc =
+                [this] (const _PreOutType& in, _ForwardOutType& out, ContextPtr ctx){
+            return forward(in, out, ctx);
+        };
+        std::function<std::vector<_ForwardOutType>(ContextPtr)> createForwardFunc = [this](ContextPtr ctx){
+            return createForwardOutput(ctx, nativeOutputStoreMode);
+        };
         pool->addNode(forwardFunc, createForwardFunc);
 
         std::function<bool(const _ForwardOutType&, _PostOutType&, ContextPtr)> postFunc =
-                [postCoreFunc] (const _ForwardOutType& in, _PostOutType& out, ContextPtr ctx){
+                [this, postCoreFunc] (const _ForwardOutType& in, _PostOutType& out, ContextPtr ctx){
             return postProcess(in, out, ctx, postCoreFunc);
         };
         pool->addNode(postFunc);
+
+        metricsId = BMMetrics::instance().addCollector([this](MetricsWriter& writer){
+            collectMetrics(writer);
+        });
+        metricsRegistered = true;
     }
 
     const bm_net_info_t *getNetInfo() const {
@@ -219,15 +368,115 @@ public:
             __init();
         }
         pool->start();
+        // the output queue is connected by start(), no task is pushed yet
+        if(outputNotifier) pool->getOutputQueue()->setPushCallback(outputNotifier);
+        startWatchdog();
+        if(warmUpRounds>0){
+            warmUp();
+        }
+    }
+
+    // timeoutMs=0 disables the watchdog, the default values come from
+    // BMSERVICE_WATCHDOG_TIMEOUT_MS and BMSERVICE_WATCHDOG_ACTION
+    void setWatchdog(size_t timeoutMs, WatchdogAction action = WATCHDOG_FAIL_TASK){
+        stopWatchdog();
+        watchdogTimeoutMs = timeoutMs;
+        watchdogAction = action;
+        if(pool) startWatchdog();
+    }
+
+    void setReleaseOutputFunc(ReleaseOutputFunc func){
+        releaseOutputFunc = func;
+    }
+
+    void setExpiredOutputFunc(ExpiredOutputFunc func){
+        expiredOutputFunc = func;
+    }
+
+    void setFailedOutputFunc(FailedOutputFunc func){
+        failedOutputFunc = func;
+    }
+
+    // must be called before start()
+    void setCancelledFunc(CancelledFunc func){
+        cancelledFunc = func;
+    }
+
+    // rounds=0 disables warm-up, the default value comes from BMSERVICE_WARMUP_ROUNDS
+    void setWarmUp(size_t rounds, WarmUpInputFunc inputFunc = nullptr, WarmUpOutputFunc outputFunc = nullptr){
+        warmUpRounds = rounds;
+        if(inputFunc) warmUpInputFunc = inputFunc;
+        if(outputFunc) releaseOutputFunc = outputFunc;
+    }
+
+    // creates the input tensors in the store mode of the network instead of 1N,
+    // only for pre-processes writing them by BMTensor::fill_device_mem, must be called before start()
+    void setNativeInputStoreMode(bool enable){
+        nativeInputStoreMode = enable;
+    }
+
+    // the same for the output tensors, only for post-processes reading them through BMTensor,
+    // the default value comes from BMSERVICE_NATIVE_STORE_MODE, must be called before start()
+    void setNativeOutputStoreMode(bool enable){
+        nativeOutputStoreMode = enable;
+    }
+
+    // called in the post-process threads every time a result is queued for pop()/waitAndPop(),
+    // lets event loops wait on an fd instead of polling, must be called before start()
+    void setOutputNotifier(std::function<void()> notifier){
+        outputNotifier = notifier;
+    }
+
+    void setWarmUpFunc(WarmUpInputFunc inputFunc, WarmUpOutputFunc outputFunc = nullptr){
+        warmUpInputFunc = inputFunc;
+        if(outputFunc) releaseOutputFunc = outputFunc;
+    }
+
+    // Pushes synthetic tasks until every device pipeline has processed warmUpRounds of them,
+    // so lazy allocations and first-launch costs are paid before serving.
+    // The results are consumed here, and never reach users or ProcessStatInfo.
+    // Without WarmUpInputFunc, the tasks forward zero inputs and skip the pre/post-process functions
+    void warmUp() {
+        auto netInfo = getNetInfo();
+        auto deviceNum = deviceIds.size();
+        size_t maxTasks = warmUpRounds * deviceNum * 4;
+        size_t pushedTasks = 0;
+        WarmUpStatInfo stat;
+        BMLOG(INFO, "warming up %d devices with %d rounds", deviceNum, warmUpRounds);
+        while(stat.minTaskNum(deviceIds)<warmUpRounds && pushedTasks<maxTasks){
+            size_t inFlight = 0;
+            for(size_t i=0; i<deviceNum; i++){
+                _PreInType task;
+                if(warmUpInputFunc) task.in = warmUpInputFunc(netInfo);
+                task.warmUp = true;
+                if(!pool->push(task)) break;
+                inFlight++;
+            }
+            if(inFlight == 0) break;
+            pushedTasks += inFlight;
+            for(; inFlight>0; inFlight--){
+                _PostOutType postOut;
+                if(!popTask(postOut, true)) break;
+                if(releaseOutputFunc) releaseOutputFunc(postOut.out);
+                stat.update(postOut.status);
+            }
+            if(inFlight>0) break;
+        }
+        if(stat.minTaskNum(deviceIds)<warmUpRounds){
+            BMLOG(WARNING, "some devices are not fully warmed up after %d tasks", pushedTasks);
+        }
+        stat.show();
     }
 
     void stop(int deviceId = -1){
+        // the pool is not created if start() fails to load the model
+        if(!pool) return;
         if(deviceId == -1) {
             pool->stop();
             return;
         }
         for(size_t index=0; index<deviceIds.size(); index++){
-            if(deviceId == deviceIds[index]) {
+            if((DeviceId)deviceId == deviceIds[index]) {
                 pool->stop(index);
                 break;
             }
@@ -235,6 +484,10 @@ public:
     }
 
     virtual ~BMDevicePool() {
+        if(metricsRegistered){
+            BMMetrics::instance().removeCollector(metricsId);
+        }
+        stopWatchdog();
         stop();
     }
 
@@ -242,8 +495,13 @@ public:
         return pool->canPush();
     }
 
-    bool push(InType in){
-        return pool->push(in);
+    // the stages are skipped once control is cancelled or past its deadline, or CancelledFunc says so,
+    // the task still comes out, as an invalid one with the output of ExpiredOutputFunc
+    bool push(InType in, TaskControl::Ptr control = nullptr){
+        _PreInType task;
+        task.in = std::move(in);
+        task.control = std::move(control);
+        return pool->push(task);
     }
 
     bool empty() {
@@ -254,9 +512,9 @@ public:
         return pool->allStopped();
     }
 
-    bool pop(OutType& out, std::shared_ptr<ProcessStatus>& status){
+    bool pop(OutType& out, ProcessStatus& status){
         _PostOutType postOut;
-        bool res = pool->pop(postOut);
+        bool res = popTask(postOut, false);
         if(res){
             status = postOut.status;
             out = postOut.out;
@@ -264,9 +522,9 @@ public:
         return res;
     }
 
-    bool waitAndPop(OutType &out, std::shared_ptr<ProcessStatus>& status) {
+    bool waitAndPop(OutType &out, ProcessStatus& status) {
         _PostOutType postOut;
-        bool res = pool->waitAndPop(postOut);
+        bool res = popTask(postOut, true);
         if(res){
             status = postOut.status;
             out = postOut.out;
@@ -274,23 +532,59 @@ public:
         return res;
     }
 
-    bool preProcess(const InType& in, _PreOutType& out, ContextPtr ctx, PreProcessFunc preCoreFunc) {
-        out.status = std::make_shared<ProcessStatus>();
-        out.status->deviceId = ctx->deviceId;
-        out.status->start();
-        out.in = in;
-        out.status->valid = preCoreFunc(in, out.preOut, ctx);
-        out.status->end();
+    bool preProcess(const _PreInType& in, _PreOutType& out, ContextPtr ctx, PreProcessFunc preCoreFunc) {
+        // out is recycled, the status of the last task must be cleared
+        out.status.reset();
+        out.status.deviceId = ctx->deviceId;
+        out.status.warmUp = in.warmUp;
+        out.in = in.in;
+        out.control = in.control;
         out.extra = ctx->getPreExtra();
+        auto& tracker = *trackers.at(ctx->deviceId);
+        if(tracker.failed){
+            // the task is taken before the device fails, give it to other devices
+            BMLOG_EVERY_MS(WARNING, 1000, "device #%d is failed, task is rerouted", ctx->deviceId);
+            out.status.rerouted = true;
+            out.status.dropped = true;
+            // the paused device takes no task from the queue, so it goes to the others, without waiting for room
+            pool->getInputQueue()->pushFront(in);
+            return true;
+        }
+        // before the inputs are copied to device
+        if(checkExpired(out.in, out.control, out.status)) return true;
+        beginStage(tracker, 0, out.in, out.status);
+        out.status.start();
+        if(isDefaultWarmUp(out.status)){
+            fillZeroInputs(out.preOut);
+            out.status.valid = true;
+        } else {
+            out.status.valid = preCoreFunc(in.in, out.preOut, ctx);
+        }
+        out.status.end();
+        if(endStage(tracker, 0)) out.status.dropped = true;
         return true;
     }
 
-    static std::vector<_PreOutType> createPreProcessOutput(ContextPtr ctx) {
+    // a warm-up task without WarmUpInputFunc, its InType is a default one nobody reads
+    bool isDefaultWarmUp(const ProcessStatus& status) const {
+        return status.warmUp && !warmUpInputFunc;
+    }
+
+    // the input tensors keep the shapes they are created with, those of the first stage
+    static void fillZeroInputs(const TensorVec& tensors) {
+        std::vector<unsigned char> zeros;
+        for(auto& tensor: tensors){
+            zeros.assign(tensor->get_host_mem_size(), 0);
+            tensor->fill_device_mem(zeros.data(), zeros.size());
+        }
+    }
+
+    static std::vector<_PreOutType> createPreProcessOutput(ContextPtr ctx, bool nativeStoreMode) {
         auto net = ctx->net;
         std::vector<_PreOutType> preOuts;
         for(size_t i=0; i<2; i++){
             _PreOutType preOut;
-            preOut.preOut = net->createInputTensors();
+            preOut.preOut = net->createInputTensors(nativeStoreMode);
             for(auto tensor: preOut.preOut){
                 ctx->allocMemForTensor(tensor);
             }
@@ -299,28 +593,32 @@ public:
         return preOuts;
     }
 
-    static bool forward(const _PreOutType& in, _ForwardOutType& out, ContextPtr ctx) {
-        out.status = std::move(in.status);
+    bool forward(const _PreOutType& in, _ForwardOutType& out, ContextPtr ctx) {
+        out.status = in.status;
         out.in = in.in;
-        if(out.status->valid){
-            out.status->start();
+        out.control = in.control;
+        if(out.status.valid && !out.status.dropped && !checkExpired(out.in, out.control, out.status)){
+            auto& tracker = *trackers.at(ctx->deviceId);
+            beginStage(tracker, 1, out.in, out.status);
+            out.status.start();
             auto preOut = in.preOut;
-            BMLOG(INFO, "ctx->inFilters.size=%d", ctx->inFilters.size());
+            BMLOG(DEBUG, "ctx->inFilters.size=%d", ctx->inFilters.size());
             for(auto filter: ctx->inFilters) preOut = filter(preOut, ctx);
-            out.status->valid = ctx->net->forward(preOut, out.forwardOut);
+            out.status.valid = ctx->net->forward(preOut, out.forwardOut);
             for(auto filter: ctx->outFilters) out.forwardOut = filter(out.forwardOut, ctx);
-            out.status->end();
+            out.status.end();
+            if(endStage(tracker, 1)) out.status.dropped = true;
         }
         out.extra = in.extra;
         return true;
     }
 
-    static std::vector<_ForwardOutType> createForwardOutput(ContextPtr ctx) {
+    static std::vector<_ForwardOutType> createForwardOutput(ContextPtr ctx, bool nativeStoreMode) {
         auto net = ctx->net;
         std::vector<_ForwardOutType> forwardOuts;
         for(size_t i=0; i<2; i++){
             _ForwardOutType forwardOut;
-            forwardOut.forwardOut = net->createOutputTensors();
+            forwardOut.forwardOut = net->createOutputTensors(nativeStoreMode);
             for(auto tensor: forwardOut.forwardOut){
                 ctx->allocMemForTensor(tensor);
             }
@@ -329,12 +627,27 @@ public:
         return forwardOuts;
     }
 
-    static bool postProcess(const _ForwardOutType& in, _PostOutType& out, ContextPtr ctx, PostProcessFunc postCoreFunc) {
-        out.status = std::move(in.status);
+    bool postProcess(const _ForwardOutType& in, _PostOutType& out, ContextPtr ctx, PostProcessFunc postCoreFunc) {
+        out.status = in.status;
+        if(out.status.rerouted){
+            return true;
+        }
+        if(checkExpired(in.in, in.control, out.status)){
+            out.out = OutType();
+            if(expiredOutputFunc) expiredOutputFunc(in.in, out.out);
+            return true;
+        }
+        auto& tracker = *trackers.at(ctx->deviceId);
         ctx->setPostExtra(in.extra);
-        out.status->start();
-        out.status->valid &= postCoreFunc(in.in, in.forwardOut, out.out, ctx);
-        out.status->end();
+        beginStage(tracker, 2, in.in, out.status);
+        out.status.start();
+        if(isDefaultWarmUp(out.status)){
+            out.out = OutType();
+        } else {
+            out.status.valid &= postCoreFunc(in.in, in.forwardOut, out.out, ctx);
+        }
+        out.status.end();
+        if(endStage(tracker, 2)) out.status.dropped = true;
         return true;
     }
 
@@ -357,6 +670,283 @@ private:
     std::vector<DeviceId> deviceIds;
     std::vector<BMDeviceContext::FilterType> inFilters;
     std::vector<BMDeviceContext::FilterType> outFilters;
+    size_t warmUpRounds;
+    bool nativeInputStoreMode;
+    bool nativeOutputStoreMode;
+    std::function<void()> outputNotifier;
+    WarmUpInputFunc warmUpInputFunc;
+    ReleaseOutputFunc releaseOutputFunc;
+    ExpiredOutputFunc expiredOutputFunc;
+    FailedOutputFunc failedOutputFunc;
+    CancelledFunc cancelledFunc;
+
+    // the task currently running in a stage of a device
+    struct _StageTracker {
+        std::mutex mutex;
+        bool busy = false;
+        bool reported = false;
+        std::chrono::steady_clock::time_point startTime;
+        // set by the watchdog when the task is replaced by a failed one
+        bool failed = false;
+        uint64_t taskSeq = 0;
+        // made when the stage starts, so the watchdog never touches the input the stage is using
+        OutType failedOut;
+        ProcessStatus status;
+    };
+    struct _DeviceTracker {
+        size_t index;
+        DeviceId deviceId;
+        // until the stalled stage returns
+        std::atomic_bool failed;
+        size_t stalledStage;
+        _StageTracker stages[3];
+        _DeviceTracker(size_t index, DeviceId deviceId): index(index), deviceId(deviceId), failed(false), stalledStage(0) {}
+    };
+    // created in __init, the map itself is read-only afterwards
+    std::map<DeviceId, std::unique_ptr<_DeviceTracker>> trackers;
+    std::atomic_size_t watchdogTimeoutMs;
+    WatchdogAction watchdogAction;
+    std::thread watchdogThread;
+    std::mutex watchdogMutex;
+    std::condition_variable watchdogCond;
+    bool watchdogDone;
+    size_t metricsId;
+    bool metricsRegistered;
+
+    void collectMetrics(MetricsWriter& writer){
+        std::string netName = getNetInfo()->name;
+        auto inQueue = pool->getInputQueue();
+        auto outQueue = pool->getOutputQueue();
+        writer.gauge("bmservice_queue_size", "Tasks waiting in the queue",
+                     {{"model", netName}, {"queue", "input"}}, inQueue->size());
+        writer.gauge("bmservice_queue_size", "Tasks waiting in the queue",
+                     {{"model", netName}, {"queue", "output"}}, outQueue->size());
+        writer.counter("bmservice_queue_pushed_total", "Tasks pushed into the queue",
+                       {{"model", netName}, {"queue", "input"}}, inQueue->pushedNum());
+        writer.counter("bmservice_queue_pushed_total", "Tasks pushed into the queue",
+                       {{"model", netName}, {"queue", "output"}}, outQueue->pushedNum());
+        for(size_t i=0; i<deviceIds.size(); i++){
+            MetricLabels labels = {{"model", netName}, {"device", std::to_string(deviceIds[i])}};
+            for(size_t stage=0; stage<3; stage++){
+                auto queue = pool->getWorkQueue(i, stage);
+                auto stageLabels = labels;
+                stageLabels.emplace_back("stage", __phaseMetricMap[stage]);
+                writer.gauge("bmservice_stage_queue_size", "Tasks waiting for the stage of a device",
+                             stageLabels, queue? queue->size(): 0);
+            }
+            writer.gauge("bmservice_device_failed", "Whether the device is failed by the watchdog",
+                         labels, trackers.at(deviceIds[i])->failed? 1: 0);
+            const ContextType &ctx = pool->getPipeLineContext(i);
+            writer.gauge("bmservice_device_memory_bytes", "Device memory allocated by the runner",
+                         labels, ctx.getAllocatedBytes());
+        }
+    }
+
+    // marks the task invalid once it expires, then the remaining stages are skipped
+    bool checkExpired(const InType& in, const TaskControl::Ptr& control, ProcessStatus& status){
+        if(status.expired) return true;
+        bool cancelled = cancelledFunc && !status.warmUp && cancelledFunc(in);
+        if(!cancelled && (!control || !control->expired())) return false;
+        status.expired = true;
+        status.valid = false;
+        return true;
+    }
+
+    // discards the results replaced by the watchdog
+    bool popTask(_PostOutType& postOut, bool wait){
+        while(wait? pool->waitAndPop(postOut): pool->pop(postOut)){
+            if(!postOut.status.dropped){
+                return true;
+            }
+            if(releaseOutputFunc){
+                releaseOutputFunc(postOut.out);
+            }
+        }
+        return false;
+    }
+
+    void beginStage(_DeviceTracker& tracker, size_t stage, const InType& in, const ProcessStatus& status){
+        if(watchdogTimeoutMs == 0) return;
+        auto& stageTracker = tracker.stages[stage];
+        OutType failedOut;
+        if(failedOutputFunc) failedOutputFunc(in, failedOut);
+        std::lock_guard<std::mutex> guard(stageTracker.mutex);
+        stageTracker.busy = true;
+        stageTracker.reported = false;
+        stageTracker.failed = false;
+        stageTracker.taskSeq++;
+        stageTracker.startTime = TimerClock::now();
+        stageTracker.failedOut = std::move(failedOut);
+        stageTracker.status = status;
+    }
+
+    // returns true if the task has been failed by the watchdog, its result must be dropped
+    bool endStage(_DeviceTracker& tracker, size_t stage){
+        auto& stageTracker = tracker.stages[stage];
+        std::lock_guard<std::mutex> guard(stageTracker.mutex);
+        // every stage runs in one thread, so the stalled one has returned, even if the watchdog is off now
+        if(tracker.failed && tracker.stalledStage == stage){
+            BMLOG(WARNING, "[watchdog] %s on device #%d returned, the device takes tasks again",
+                  __phaseMap[stage], tracker.deviceId);
+            tracker.failed = false;
+            pool->pause(tracker.index, false);
+        }
+        if(!stageTracker.busy) return false;
+        stageTracker.busy = false;
+        stageTracker.failedOut = OutType();
+        return stageTracker.failed;
+    }
+
+    void startWatchdog(){
+        if(watchdogTimeoutMs == 0 || watchdogThread.joinable()) return;
+        watchdogDone = false;
+        watchdogThread = std::thread(&BMDevicePool<InType, OutType>::watchdogLoop, this);
+        BMLOG(INFO, "watchdog started: timeout=%dms, action=%d", watchdogTimeoutMs.load(), watchdogAction);
+    }
+
+    void stopWatchdog(){
+        {
+            std::lock_guard<std::mutex> guard(watchdogMutex);
+            watchdogDone = true;
+        }
+        watchdogCond.notify_all();
+        if(watchdogThread.joinable()){
+            watchdogThread.join();
+        }
+    }
+
+    void watchdogLoop(){
+        std::unique_lock<std::mutex> lock(watchdogMutex);
+        auto interval = std::chrono::milliseconds(std::max<size_t>(watchdogTimeoutMs/4, 10));
+        while(!watchdogDone){
+            watchdogCond.wait_for(lock, interval);
+            if(watchdogDone) break;
+            checkStalls();
+        }
+    }
+
+    void checkStalls(){
+        auto now = TimerClock::now();
+        for(auto& item: trackers){
+            auto& tracker = *item.second;
+            if(tracker.failed){
+                drainFailedDevice(tracker);
+                continue;
+            }
+            for(size_t stage=0; stage<3; stage++){
+                auto& stageTracker = tracker.stages[stage];
+                std::unique_lock<std::mutex> guard(stageTracker.mutex);
+                if(!stageTracker.busy || stageTracker.reported) continue;
+                auto runUs = usBetween(stageTracker.startTime, now);
+                if(runUs < watchdogTimeoutMs*1000) continue;
+                stageTracker.reported = true;
+                auto taskSeq = stageTracker.taskSeq;
+                guard.unlock();
+                showStallReport(item.first, stage, runUs);
+                guard.lock();
+                if(watchdogAction == WATCHDOG_REPORT || !stageTracker.busy || stageTracker.taskSeq != taskSeq) continue;
+                stageTracker.failed = true;
+                failTask(stageTracker.failedOut, stageTracker.status);
+                if(watchdogAction == WATCHDOG_FAIL_DEVICE){
+                    guard.unlock();
+                    failDevice(item.first, tracker, stage);
+                    break;
+                }
+            }
+        }
+    }
+
+    // status is the one of the original task, which will be dropped
+    void failTask(const OutType& failedOut, const ProcessStatus& status){
+        if(status.rerouted || status.dropped) return;
+        _PostOutType postOut;
+        postOut.out = failedOut;
+        pushFailedTask(postOut, status);
+    }
+
+    // the task is taken out of the stalled device and never runs, so its input is released by ExpiredOutputFunc
+    void failDrainedTask(const InType& in, const ProcessStatus& status){
+        // the input of a rerouted task is with another device
+        if(status.rerouted) return;
+        _PostOutType postOut;
+        postOut.in = in;
+        if(expiredOutputFunc) expiredOutputFunc(in, postOut.out);
+        if(status.dropped){
+            // its failed output is out already
+            if(releaseOutputFunc) releaseOutputFunc(postOut.out);
+            return;
+        }
+        pushFailedTask(postOut, status);
+    }
+
+    void pushFailedTask(_PostOutType& postOut, const ProcessStatus& status){
+        postOut.status.deviceId = status.deviceId;
+        postOut.status.warmUp = status.warmUp;
+        postOut.status.valid = false;
+        postOut.status.timeout = true;
+        pool->getOutputQueue()->push(postOut);
+    }
+
+    void failDevice(DeviceId deviceId, _DeviceTracker& tracker, size_t stage){
+        BMLOG(ERROR, "[watchdog] device #%d is failed, its tasks will be dispatched to other devices", deviceId);
+        {
+            std::lock_guard<std::mutex> guard(tracker.stages[stage].mutex);
+            // returned in the meantime
+            if(!tracker.stages[stage].busy) return;
+            tracker.stalledStage = stage;
+            // paused first, so the device never takes the tasks it reroutes again
+            pool->pause(tracker.index);
+            tracker.failed = true;
+        }
+        drainFailedDevice(tracker);
+    }
+
+    // tasks waiting for the stalled stage will never run, the ones after it flow out as usual,
+    // their buffers go back to the free queue, so the device is whole again once the stage returns
+    void drainFailedDevice(_DeviceTracker& tracker){
+        auto stage = tracker.stalledStage;
+        // endStage re-arms the device under the same lock, so nothing is drained after it
+        std::lock_guard<std::mutex> guard(tracker.stages[stage].mutex);
+        if(!tracker.failed) return;
+        if(stage == 1){
+            drainQueue<_PreOutType>(tracker.index, stage);
+        } else if(stage == 2){
+            drainQueue<_ForwardOutType>(tracker.index, stage);
+        }
+    }
+
+    template<typename StageInType>
+    void drainQueue(size_t index, size_t stage){
+        auto queue = std::dynamic_pointer_cast<BMQueue<StageInType>>(pool->getWorkQueue(index, stage));
+        auto freeQueue = std::dynamic_pointer_cast<BMQueue<StageInType>>(pool->getResourceQueue(index, stage));
+        StageInType stageIn;
+        while(queue && queue->tryPop(stageIn)){
+            failDrainedTask(stageIn.in, stageIn.status);
+            if(freeQueue) freeQueue->push(stageIn);
+        }
+    }
+
+    void showStallReport(DeviceId deviceId, size_t stage, size_t runUs){
+        auto now = TimerClock::now();
+        BMLOG(ERROR, "[watchdog] %s on device #%d has run for %gms (timeout=%dms), input_queue=%d, output_queue=%d",
+              __phaseMap[stage], deviceId, runUs/1000.0, watchdogTimeoutMs.load(),
+              pool->getInputQueue()->size(), pool->getOutputQueue()->size());
+        for(auto& item: trackers){
+            auto& tracker = *item.second;
+            std::string stageStr;
+            for(size_t s=0; s<3; s++){
+                auto& stageTracker = tracker.stages[s];
+                std::lock_guard<std::mutex> guard(stageTracker.mutex);
+                auto queue = pool->getWorkQueue(tracker.index, s);
+                stageStr += std::string(" ") + __phaseMap[s] + "(queue=" + std::to_string(queue? queue->size(): 0);
+                if(stageTracker.busy){
+                    stageStr += ", busy=" + std::to_string(usBetween(stageTracker.startTime, now)/1000) + "ms";
+                }
+                stageStr += ")";
+            }
+            BMLOG(ERROR, "[watchdog]   -> device #%d%s:%s", item.first, tracker.failed? "(failed)": "", stageStr.c_str());
+        }
+    }
 };
 
 }
@@ -7,5 +7,37 @@
 #define BM_USE_DEVICE (BM_ENV_PREFIX "USE_DEVICE")
 
 #define BM_LOG_LEVEL (BM_ENV_PREFIX "LOG_LEVEL")
+// export BMSERVICE_LOG_ASYNC=0: write logs in the calling thread
+#define BM_LOG_ASYNC (BM_ENV_PREFIX "LOG_ASYNC")
+
+// export BMSERVICE_WARMUP_ROUNDS=2: push 2 rounds of synthetic tasks through every device before serving
+#define BM_WARMUP_ROUNDS (BM_ENV_PREFIX "WARMUP_ROUNDS")
+
+// export BMSERVICE_WATCHDOG_TIMEOUT_MS=5000: report stages running longer than 5s, 0 disables the watchdog
+// export BMSERVICE_WATCHDOG_ACTION=1: 0-report only, 1-fail the task, 2-fail the device until the stalled stage returns
+#define BM_WATCHDOG_TIMEOUT_MS (BM_ENV_PREFIX "WATCHDOG_TIMEOUT_MS")
+#define BM_WATCHDOG_ACTION (BM_ENV_PREFIX "WATCHDOG_ACTION")
+
+// export BMSERVICE_METRICS_PORT=9100: serve metrics at http://127.0.0.1:9100/metrics in Prometheus text format
+// export BMSERVICE_METRICS_FILE=/tmp/bmservice.prom: dump metrics to the file every BMSERVICE_METRICS_INTERVAL_MS(default 5000)
+#define BM_METRICS_PORT (BM_ENV_PREFIX "METRICS_PORT")
+#define BM_METRICS_FILE (BM_ENV_PREFIX "METRICS_FILE")
+#define BM_METRICS_INTERVAL_MS (BM_ENV_PREFIX "METRICS_INTERVAL_MS")
+
+// export BMSERVICE_NATIVE_STORE_MODE=1: create the output tensors of BMDevicePool and the input tensors of the C API
+// in the 4N/2N layouts that int8/int16 networks use natively on BM1684, instead of BM_STORE_1N
+#define BM_NATIVE_STORE_MODE (BM_ENV_PREFIX "NATIVE_STORE_MODE")
+
+// only used by the simulated backend(-DBM_SIMULATE=ON)
+// export BMSERVICE_SIM_DEVICE_NUM=4: simulate 4 devices, default 1
+// export BMSERVICE_SIM_LATENCY_US=normal:5000,500: forward latency of networks without latency_us, see BMSimDevice.h
+// export BMSERVICE_SIM_COPY_MBPS=2000: host<->device copy bandwidth per device in MB/s, 0(default) is unlimited
+// export BMSERVICE_SIM_SEED=1: seed of the latency sampling
+// export BMSERVICE_SIM_CHIP_ID=0x1686: chip id reported by bm_get_chipid, default 0x1684
+#define BM_SIM_DEVICE_NUM (BM_ENV_PREFIX "SIM_DEVICE_NUM")
+#define BM_SIM_LATENCY_US (BM_ENV_PREFIX "SIM_LATENCY_US")
+#define BM_SIM_COPY_MBPS (BM_ENV_PREFIX "SIM_COPY_MBPS")
+#define BM_SIM_SEED (BM_ENV_PREFIX "SIM_SEED")
+#define BM_SIM_CHIP_ID (BM_ENV_PREFIX "SIM_CHIP_ID")
 
 #endif // BMENV_H
@@ -1,16 +1,19 @@
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <vector>
 #include "BMLog.h"
 #include "BMEnv.h"
 
 namespace bm {
-static LogLevel BMRT_LOG_LEVEL_THRESHOLD;
-
-int get_log_level()
-{
-    return BMRT_LOG_LEVEL_THRESHOLD;
-}
+std::atomic<int> __bm_log_threshold(LogLevel::INFO);
 
 void set_log_level(LogLevel level){
-    BMRT_LOG_LEVEL_THRESHOLD = level;
+    __bm_log_threshold.store(level, std::memory_order_relaxed);
 }
 
 struct __log_initializer{
@@ -20,7 +23,7 @@ struct __log_initializer{
         set_env_log_level();
     }
 };
-static __log_initializer __log_init();
+static __log_initializer __log_init;
 
 void set_env_log_level(LogLevel level)
 {
@@ -31,4 +34,181 @@ void set_env_log_level(LogLevel level)
     set_log_level(level);
 }
 
+unsigned int __bm_thread_tag()
+{
+    return (unsigned int)pthread_self();
+}
+
+namespace {
+
+const size_t LOG_RECORD_SIZE = 496;
+const size_t LOG_RING_SIZE = 256;
+
+struct LogRecord {
+    unsigned long long seq;
+    unsigned int len;
+    char msg[LOG_RECORD_SIZE];
+};
+
+// single producer(the owner thread), single consumer(the writer thread)
+struct LogRing {
+    LogRecord records[LOG_RING_SIZE];
+    std::atomic<size_t> head{0};
+    std::atomic<size_t> tail{0};
+    std::atomic<size_t> dropped{0};
+    std::atomic<bool> orphaned{false};
+};
+
+class LogWriter {
+public:
+    LogWriter(): done(false), seq(0) {
+        auto async_cstr = getenv(BM_LOG_ASYNC);
+        async = !async_cstr || atoi(async_cstr) != 0;
+    }
+
+    bool isAsync() const { return async && !done; }
+    void setAsync(bool value) {
+        if(!value) flush();
+        async = value;
+    }
+
+    std::shared_ptr<LogRing> createRing() {
+        auto ring = std::make_shared<LogRing>();
+        std::lock_guard<std::mutex> guard(ringMutex);
+        rings.push_back(ring);
+        if(!thread.joinable() && !done){
+            thread = std::thread(&LogWriter::run, this);
+            atexit(LogWriter::stop);
+        }
+        return ring;
+    }
+
+    void write(LogRing& ring, const char* fmt, va_list args) {
+        auto head = ring.head.load(std::memory_order_relaxed);
+        auto tail = ring.tail.load(std::memory_order_acquire);
+        if(head - tail >= LOG_RING_SIZE){
+            ring.dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        auto& record = ring.records[head % LOG_RING_SIZE];
+        record.seq = seq.fetch_add(1, std::memory_order_relaxed);
+        int len = vsnprintf(record.msg, LOG_RECORD_SIZE, fmt, args);
+        if(len<0) len = 0;
+        if(len >= (int)LOG_RECORD_SIZE){
+            len = LOG_RECORD_SIZE-1;
+            record.msg[len-1] = '\n';
+        }
+        record.len = len;
+        ring.head.store(head+1, std::memory_order_release);
+    }
+
+    // writes out all buffered records, ordered by their sequence
+    void flush() {
+        std::lock_guard<std::mutex> flushGuard(flushMutex);
+        std::vector<std::shared_ptr<LogRing>> currentRings;
+        {
+            std::lock_guard<std::mutex> guard(ringMutex);
+            auto iter = std::remove_if(rings.begin(), rings.end(), [](const std::shared_ptr<LogRing>& r){
+                return r->orphaned && r->head == r->tail;
+            });
+            rings.erase(iter, rings.end());
+            currentRings = rings;
+        }
+        batch.clear();
+        std::vector<size_t> heads;
+        size_t dropped = 0;
+        for(auto& ring: currentRings){
+            auto head = ring->head.load(std::memory_order_acquire);
+            for(auto pos = ring->tail.load(std::memory_order_relaxed); pos != head; pos++){
+                batch.push_back(&ring->records[pos % LOG_RING_SIZE]);
+            }
+            heads.push_back(head);
+            dropped += ring->dropped.exchange(0, std::memory_order_relaxed);
+        }
+        std::sort(batch.begin(), batch.end(), [](const LogRecord* a, const LogRecord* b){
+            return a->seq < b->seq;
+        });
+        for(auto record: batch){
+            fwrite(record->msg, 1, record->len, stdout);
+        }
+        if(dropped>0){
+            fprintf(stdout, "[bmlog] %zu messages are dropped because the log buffer is full\n", dropped);
+        }
+        if(!batch.empty() || dropped>0){
+            fflush(stdout);
+        }
+        // records can be reused only after they are written
+        for(size_t i=0; i<currentRings.size(); i++){
+            currentRings[i]->tail.store(heads[i], std::memory_order_release);
+        }
+    }
+
+    static LogWriter& instance() {
+        // never destructed, so logs from static destructors are still safe
+        static LogWriter* writer = new LogWriter();
+        return *writer;
+    }
+
+private:
+    static void stop() {
+        auto& writer = instance();
+        writer.done = true;
+        if(writer.thread.joinable()){
+            writer.thread.join();
+        }
+        writer.flush();
+    }
+
+    void run() {
+        while(!done){
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            flush();
+        }
+    }
+
+    std::atomic<bool> async;
+    std::atomic<bool> done;
+    std::atomic<unsigned long long> seq;
+    std::mutex ringMutex;
+    std::vector<std::shared_ptr<LogRing>> rings;
+    std::mutex flushMutex;
+    std::vector<const LogRecord*> batch;
+    std::thread thread;
+};
+
+struct LocalRing {
+    std::shared_ptr<LogRing> ring;
+    ~LocalRing() {
+        if(ring) ring->orphaned = true;
+    }
+};
+
+}
+
+void __bm_log_write(const char *fmt, ...)
+{
+    auto& writer = LogWriter::instance();
+    va_list args;
+    va_start(args, fmt);
+    if(writer.isAsync()){
+        thread_local LocalRing local;
+        if(!local.ring) local.ring = writer.createRing();
+        writer.write(*local.ring, fmt, args);
+    } else {
+        vprintf(fmt, args);
+        fflush(stdout);
+    }
+    va_end(args);
+}
+
+void set_log_async(bool async)
+{
+    LogWriter::instance().setAsync(async);
+}
+
+void flush_log()
+{
+    LogWriter::instance().flush();
+}
+
 }
@@ -2,10 +2,18 @@
 #define BMLOG_H
 
 #include <stdio.h>
+#include <atomic>
+#include <chrono>
 #include <type_traits>
 #include <stdexcept>
 #include <thread>
 
+// log calls below this level are removed at compile time, FATAL is always kept
+// e.g. cmake -DBM_MIN_LOG_LEVEL=1 to remove all DEBUG logs
+#ifndef BM_MIN_LOG_LEVEL
+#define BM_MIN_LOG_LEVEL 0
+#endif
+
 namespace bm {
 
 typedef enum {
@@ -16,29 +24,83 @@ typedef enum {
     FATAL   = 4,
 } LogLevel;
 
-int get_log_level();
+extern std::atomic<int> __bm_log_threshold;
+
+inline int get_log_level()
+{
+    return __bm_log_threshold.load(std::memory_order_relaxed);
+}
 void set_log_level(LogLevel level);
+void set_env_log_level(LogLevel level=LogLevel::INFO);
+
+// In async mode(default), messages are formatted into a per-thread ring buffer and
+// written by a background thread, export BMSERVICE_LOG_ASYNC=0 to write them directly
+void set_log_async(bool async);
+// waits until all buffered messages are written
+void flush_log();
+
+unsigned int __bm_thread_tag();
+void __bm_log_write(const char* fmt, ...);
+
+template<int level>
+inline bool __bm_log_on() {
+    return level >= BM_MIN_LOG_LEVEL && (level >= FATAL || level >= get_log_level());
+}
 
 template<int level, typename ... ArgTypes>
 typename std::enable_if<level<FATAL , void>::type __bm_log(const char*fmt, ArgTypes ...args){
-    if (level >= get_log_level()){
-        printf(fmt, args...);
-        fflush(stdout);
-    }
+    __bm_log_write(fmt, args...);
 }
-void set_env_log_level(LogLevel level=LogLevel::INFO);
 
 template<int level, typename ... ArgTypes>
 typename std::enable_if<level==FATAL , void>::type __bm_log(const char* fmt, ArgTypes ...args){
     char msg[1024];
     snprintf(msg, sizeof(msg)-1, fmt, args...);
+    flush_log();
     printf("runtime_error, %s\n", msg);
     fflush(stdout);
     throw std::runtime_error(msg);
 }
 
-#define BMLOG(severity, fmt, ...) \
-    __bm_log<LogLevel::severity>("[tid=%x] %s: " fmt "\n", std::this_thread::get_id(), #severity, ##__VA_ARGS__)
+// returns true at most once per interval_ms for a call site, and counts the skipped calls
+inline bool __bm_log_rate_allow(std::atomic<long long>& last_ms, std::atomic<unsigned>& skipped,
+                                unsigned interval_ms, unsigned& skipped_out){
+    long long now = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+    long long last = last_ms.load(std::memory_order_relaxed);
+    if(now - last < interval_ms || !last_ms.compare_exchange_strong(last, now, std::memory_order_relaxed)){
+        skipped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    skipped_out = skipped.exchange(0, std::memory_order_relaxed);
+    return true;
+}
+
+#define BMLOG(severity, fmt, ...)                                                      \
+    do                                                                                 \
+    {                                                                                  \
+        if (bm::__bm_log_on<bm::LogLevel::severity>())                                 \
+        {                                                                              \
+            bm::__bm_log<bm::LogLevel::severity>("[tid=%x] %s: " fmt "\n",             \
+                                                 bm::__bm_thread_tag(), #severity,     \
+                                                 ##__VA_ARGS__);                       \
+        }                                                                              \
+    } while (0)
+
+// for hot paths: logs at most once per interval_ms at this call site
+#define BMLOG_EVERY_MS(severity, interval_ms, fmt, ...)                                  \
+    do                                                                                   \
+    {                                                                                    \
+        static std::atomic<long long> __bm_log_last_ms(-(long long)(interval_ms));       \
+        static std::atomic<unsigned> __bm_log_skipped(0);                                \
+        unsigned __bm_log_skipped_num = 0;                                               \
+        if (bm::__bm_log_on<bm::LogLevel::severity>() &&                                 \
+            bm::__bm_log_rate_allow(__bm_log_last_ms, __bm_log_skipped, (interval_ms),   \
+                                    __bm_log_skipped_num))                               \
+        {                                                                                \
+            BMLOG(severity, fmt " (%d skipped)", ##__VA_ARGS__, __bm_log_skipped_num);   \
+        }                                                                                \
+    } while (0)
 
 };
 
@@ -0,0 +1,284 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <algorithm>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "BMMetrics.h"
+#include "BMEnv.h"
+#include "BMLog.h"
+
+namespace bm {
+
+static std::string __escapeLabel(const std::string& value){
+    std::string escaped;
+    for(auto c: value){
+        if(c == '\\' || c == '"') escaped += '\\';
+        if(c == '\n') {
+            escaped += "\\n";
+            continue;
+        }
+        escaped += c;
+    }
+    return escaped;
+}
+
+std::string MetricsWriter::formatSample(const std::string &name, const MetricLabels &labels, double value)
+{
+    std::string line = name;
+    if(!labels.empty()){
+        line += "{";
+        for(size_t i=0; i<labels.size(); i++){
+            if(i>0) line += ",";
+            line += labels[i].first + "=\"" + __escapeLabel(labels[i].second) + "\"";
+        }
+        line += "}";
+    }
+    char valueStr[32];
+    snprintf(valueStr, sizeof(valueStr), " %.15g", value);
+    return line + valueStr;
+}
+
+MetricsWriter::Family &MetricsWriter::family(const std::string &name, const char *type, const std::string &help)
+{
+    auto iter = families.find(name);
+    if(iter == families.end()){
+        names.push_back(name);
+        iter = families.emplace(name, Family{type, help, {}}).first;
+    }
+    return iter->second;
+}
+
+void MetricsWriter::gauge(const std::string &name, const std::string &help, const MetricLabels &labels, double value)
+{
+    family(name, "gauge", help).samples.push_back(formatSample(name, labels, value));
+}
+
+void MetricsWriter::counter(const std::string &name, const std::string &help, const MetricLabels &labels, double value)
+{
+    family(name, "counter", help).samples.push_back(formatSample(name, labels, value));
+}
+
+void MetricsWriter::summary(const std::string &name, const std::string &help, const MetricLabels &labels,
+                            const std::vector<std::pair<double, double>> &quantiles, double sum, uint64_t count)
+{
+    auto& f = family(name, "summary", help);
+    for(auto& q: quantiles){
+        auto quantileLabels = labels;
+        char quantileStr[32];
+        snprintf(quantileStr, sizeof(quantileStr), "%g", q.first);
+        quantileLabels.emplace_back("quantile", quantileStr);
+        f.samples.push_back(formatSample(name, quantileLabels, q.second));
+    }
+    f.samples.push_back(formatSample(name + "_sum", labels, sum));
+    f.samples.push_back(formatSample(name + "_count", labels, count));
+}
+
+std::string MetricsWriter::str() const
+{
+    std::string text;
+    for(auto& name: names){
+        auto& f = families.at(name);
+        text += "# HELP " + name + " " + f.help + "\n";
+        text += "# TYPE " + name + " " + f.type + "\n";
+        for(auto& sample: f.samples){
+            text += sample + "\n";
+        }
+    }
+    return text;
+}
+
+BMMetrics::BMMetrics(): nextId(0), envChecked(false), done(false), exitRegistered(false) {}
+
+BMMetrics &BMMetrics::instance()
+{
+    // never destructed, collectors may be removed in static destructors
+    static BMMetrics* metrics = new BMMetrics();
+    return *metrics;
+}
+
+size_t BMMetrics::addCollector(BMMetrics::Collector collector)
+{
+    size_t id;
+    bool checkEnv;
+    {
+        std::lock_guard<std::mutex> guard(collectorMutex);
+        id = nextId++;
+        collectors[id] = std::move(collector);
+        checkEnv = !envChecked;
+        envChecked = true;
+    }
+    if(checkEnv) startFromEnv();
+    return id;
+}
+
+void BMMetrics::removeCollector(size_t id)
+{
+    std::lock_guard<std::mutex> guard(collectorMutex);
+    collectors.erase(id);
+}
+
+std::string BMMetrics::render()
+{
+    MetricsWriter writer;
+    std::lock_guard<std::mutex> guard(collectorMutex);
+    for(auto& item: collectors){
+        item.second(writer);
+    }
+    return writer.str();
+}
+
+void BMMetrics::startFromEnv()
+{
+    auto portStr = getenv(BM_METRICS_PORT);
+    if(portStr){
+        startHttp(atoi(portStr));
+    }
+    auto fileStr = getenv(BM_METRICS_FILE);
+    if(fileStr){
+        auto intervalStr = getenv(BM_METRICS_INTERVAL_MS);
+        size_t intervalMs = intervalStr? atoi(intervalStr): 5000;
+        startFileDump(fileStr, intervalMs);
+    }
+}
+
+int BMMetrics::startHttp(int port)
+{
+    std::lock_guard<std::mutex> guard(exporterMutex);
+    if(httpThread.joinable()){
+        BMLOG(WARNING, "metrics http server is already running");
+        return -1;
+    }
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if(fd < 0){
+        BMLOG(ERROR, "cannot create metrics socket: %s", strerror(errno));
+        return -1;
+    }
+    int reuse = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    socklen_t addrLen = sizeof(addr);
+    if(bind(fd, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, 8) != 0 ||
+            getsockname(fd, (sockaddr*)&addr, &addrLen) != 0){
+        BMLOG(ERROR, "cannot listen metrics port %d: %s", port, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    port = ntohs(addr.sin_port);
+    done = false;
+    if(!exitRegistered){
+        atexit(BMMetrics::stopAtExit);
+        exitRegistered = true;
+    }
+    httpThread = std::thread(&BMMetrics::httpLoop, this, fd);
+    BMLOG(INFO, "metrics are served at http://127.0.0.1:%d/metrics", port);
+    return port;
+}
+
+void BMMetrics::startFileDump(const std::string &path, size_t intervalMs)
+{
+    std::lock_guard<std::mutex> guard(exporterMutex);
+    if(dumpThread.joinable()){
+        BMLOG(WARNING, "metrics file dump is already running");
+        return;
+    }
+    done = false;
+    if(!exitRegistered){
+        atexit(BMMetrics::stopAtExit);
+        exitRegistered = true;
+    }
+    dumpThread = std::thread(&BMMetrics::dumpLoop, this, path, std::max<size_t>(intervalMs, 100));
+    BMLOG(INFO, "metrics are dumped to '%s' every %dms", path.c_str(), intervalMs);
+}
+
+void BMMetrics::stop()
+{
+    {
+        std::lock_guard<std::mutex> guard(exporterMutex);
+        done = true;
+    }
+    exporterCond.notify_all();
+    if(httpThread.joinable()) httpThread.join();
+    if(dumpThread.joinable()) dumpThread.join();
+}
+
+void BMMetrics::stopAtExit()
+{
+    instance().stop();
+}
+
+static bool __sendAll(int fd, const std::string& data){
+    size_t sent = 0;
+    while(sent < data.size()){
+        auto n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if(n <= 0) return false;
+        sent += n;
+    }
+    return true;
+}
+
+void BMMetrics::httpLoop(int fd)
+{
+    while(true){
+        {
+            std::lock_guard<std::mutex> guard(exporterMutex);
+            if(done) break;
+        }
+        pollfd pfd = {fd, POLLIN, 0};
+        if(poll(&pfd, 1, 200) <= 0) continue;
+        int client = accept(fd, nullptr, nullptr);
+        if(client < 0) continue;
+        // a scrape request fits in one read, the rest of the headers are ignored
+        char request[1024] = {0};
+        pollfd cfd = {client, POLLIN, 0};
+        if(poll(&cfd, 1, 1000) > 0){
+            auto n = recv(client, request, sizeof(request)-1, 0);
+            if(n < 0) n = 0;
+            request[n] = 0;
+        }
+        std::string response;
+        if(strncmp(request, "GET /metrics", 12) == 0 || strncmp(request, "GET / ", 6) == 0){
+            auto body = render();
+            response = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: "
+                    + std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+        } else {
+            response = "HTTP/1.0 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+        }
+        __sendAll(client, response);
+        close(client);
+    }
+    close(fd);
+}
+
+void BMMetrics::dumpLoop(std::string path, size_t intervalMs)
+{
+    auto tmpPath = path + ".tmp";
+    std::unique_lock<std::mutex> lock(exporterMutex);
+    while(!done){
+        exporterCond.wait_for(lock, std::chrono::milliseconds(intervalMs));
+        lock.unlock();
+        // written to a temporary file first, so readers never see a partial dump
+        auto text = render();
+        auto fp = fopen(tmpPath.c_str(), "w");
+        if(fp){
+            fwrite(text.data(), 1, text.size(), fp);
+            fclose(fp);
+            if(rename(tmpPath.c_str(), path.c_str()) != 0){
+                BMLOG_EVERY_MS(WARNING, 60000, "cannot write metrics file '%s'", path.c_str());
+            }
+        } else {
+            BMLOG_EVERY_MS(WARNING, 60000, "cannot open metrics file '%s'", tmpPath.c_str());
+        }
+        lock.lock();
+    }
+}
+
+}
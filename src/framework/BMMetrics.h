@@ -0,0 +1,85 @@
+#ifndef BMMETRICS_H
+#define BMMETRICS_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <condition_variable>
+#include "BMCommonUtils.h"
+
+namespace bm {
+
+using MetricLabels = std::vector<std::pair<std::string, std::string>>;
+
+// collects samples in Prometheus text format, samples of the same metric are grouped together
+class MetricsWriter {
+public:
+    void gauge(const std::string& name, const std::string& help, const MetricLabels& labels, double value);
+    void counter(const std::string& name, const std::string& help, const MetricLabels& labels, double value);
+    // quantiles are (quantile in [0, 1], value) pairs
+    void summary(const std::string& name, const std::string& help, const MetricLabels& labels,
+                 const std::vector<std::pair<double, double>>& quantiles, double sum, uint64_t count);
+    std::string str() const;
+
+    static std::string formatSample(const std::string& name, const MetricLabels& labels, double value);
+
+private:
+    struct Family {
+        std::string type;
+        std::string help;
+        std::vector<std::string> samples;
+    };
+    std::vector<std::string> names;
+    std::map<std::string, Family> families;
+    Family& family(const std::string& name, const char* type, const std::string& help);
+};
+
+// Process wide registry, each component adds a collector which writes its current state.
+// Exporters are started with the first collector if configured by env:
+//   export BMSERVICE_METRICS_PORT=9100: serve http://127.0.0.1:9100/metrics
+//   export BMSERVICE_METRICS_FILE=/tmp/bmservice.prom: dump to the file periodically
+//   export BMSERVICE_METRICS_INTERVAL_MS=5000: the dump interval
+class BMMetrics: public Uncopiable {
+public:
+    using Collector = std::function<void(MetricsWriter&)>;
+
+    static BMMetrics& instance();
+
+    size_t addCollector(Collector collector);
+    // blocks until the collector is not running, so its captures can be released safely
+    void removeCollector(size_t id);
+    std::string render();
+
+    // listens on the loopback interface only, port=0 picks a free port
+    // returns the port or -1 on failure
+    int startHttp(int port);
+    void startFileDump(const std::string& path, size_t intervalMs);
+    void stop();
+
+private:
+    BMMetrics();
+    void startFromEnv();
+    void httpLoop(int fd);
+    void dumpLoop(std::string path, size_t intervalMs);
+    static void stopAtExit();
+
+    std::mutex collectorMutex;
+    std::map<size_t, Collector> collectors;
+    size_t nextId;
+    bool envChecked;
+
+    std::mutex exporterMutex;
+    std::condition_variable exporterCond;
+    bool done;
+    bool exitRegistered;
+    std::thread httpThread;
+    std::thread dumpThread;
+};
+
+}
+
+#endif // BMMETRICS_H
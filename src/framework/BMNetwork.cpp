@@ -1,10 +1,73 @@
 #include <stdio.h>
+#include <string.h>
+#include <map>
+#include <mutex>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "BMNetwork.h"
+#include "BMDataConvert.h"
 namespace bm {
 
+BMModelData::BMModelData(const std::string &path): m_data(nullptr), m_size(0), m_path(path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if(fd<0){
+        BMLOG(FATAL, "cannot open bmodel(%s)", path.c_str());
+    }
+    struct stat st;
+    if(fstat(fd, &st)<0 || st.st_size == 0){
+        close(fd);
+        BMLOG(FATAL, "cannot stat bmodel(%s)", path.c_str());
+    }
+    m_size = st.st_size;
+    m_data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(m_data == MAP_FAILED){
+        m_data = nullptr;
+        BMLOG(FATAL, "cannot map bmodel(%s), size=%d", path.c_str(), m_size);
+    }
+    BMLOG(INFO, "bmodel(%s) is mapped, size=%d", path.c_str(), m_size);
+}
+
+BMModelData::~BMModelData() {
+    if(m_data){
+        munmap(m_data, m_size);
+    }
+}
+
+std::shared_ptr<BMModelData> BMModelData::get(const std::string &path) {
+    struct CacheItem {
+        std::weak_ptr<BMModelData> data;
+        struct timespec mtime;
+        off_t size;
+    };
+    static std::mutex cache_mutex;
+    static std::map<std::string, CacheItem> cache;
+
+    struct stat st;
+    if(stat(path.c_str(), &st)<0){
+        BMLOG(FATAL, "cannot stat bmodel(%s)", path.c_str());
+    }
+    std::lock_guard<std::mutex> guard(cache_mutex);
+    auto iter = cache.find(path);
+    if(iter != cache.end()){
+        auto& item = iter->second;
+        auto data = item.data.lock();
+        if(data && item.size == st.st_size &&
+                item.mtime.tv_sec == st.st_mtim.tv_sec && item.mtime.tv_nsec == st.st_mtim.tv_nsec){
+            return data;
+        }
+    }
+    auto data = std::make_shared<BMModelData>(path);
+    cache[path] = CacheItem{data, st.st_mtim, st.st_size};
+    return data;
+}
+
 BMNetwork::BMNetwork(void *bmrt, const std::string &name): m_bmrt(bmrt), bmodelPath(name) {
     m_handle = static_cast<bm_handle_t>(bmrt_get_bm_handle(bmrt));
-    if (!bmrt_load_bmodel(m_bmrt, bmodelPath.c_str())) {
+    m_model_data = BMModelData::get(bmodelPath);
+    if (!bmrt_load_bmodel_data(m_bmrt, m_model_data->data(), m_model_data->size())) {
         BMLOG(FATAL, "load bmodel(%s) failed!", bmodelPath.c_str());
     }
     const char **names;
@@ -23,6 +86,17 @@ BMNetwork::BMNetwork(void *bmrt, const std::string &name): m_bmrt(bmrt), bmodelP
     if(m_netinfo->input_num>0){
         batchSize = m_netinfo->stages[0].input_shapes[0].dims[0];
     }
+    // BM1684 computes int8 in 4N and int16 in 2N, 1N tensors are converted by bmrt on every launch
+    unsigned int chipid = 0;
+    m_native_store_mode = bm_get_chipid(m_handle, &chipid) == BM_SUCCESS && chipid == 0x1684;
+}
+
+bm_store_mode_t BMNetwork::nativeStoreMode(bm_data_type_t dtype) const
+{
+    if(!m_native_store_mode) return BM_STORE_1N;
+    if(dtype == BM_INT8 || dtype == BM_UINT8) return BM_STORE_4N;
+    if(dtype == BM_INT16 || dtype == BM_UINT16) return BM_STORE_2N;
+    return BM_STORE_1N;
 }
 
 static std::string shape_to_str(const bm_shape_t& shape) {
@@ -45,6 +119,7 @@ void BMNetwork::showInfo()
         "UINT16",
         "INT32",
         "UINT32",
+        "BFLOAT16",
     };
     BMLOG(INFO, "NetName: %s", m_netinfo->name);
     for(int i=0; i<m_netinfo->input_num; i++){
@@ -68,13 +143,13 @@ void BMNetwork::showInfo()
 
 }
 
-TensorVec BMNetwork::createOutputTensors(){
+TensorVec BMNetwork::createOutputTensors(bool nativeStoreMode){
     TensorVec tensors;
     auto innerTensors = new bm_tensor_t[m_netinfo->output_num];
     for(int i = 0; i < m_netinfo->output_num; ++i) {
         innerTensors[i].dtype = m_netinfo->output_dtypes[i];
         innerTensors[i].shape = m_netinfo->stages[0].output_shapes[i];
-        innerTensors[i].st_mode = BM_STORE_1N;
+        innerTensors[i].st_mode = nativeStoreMode? this->nativeStoreMode(innerTensors[i].dtype): BM_STORE_1N;
         innerTensors[i].device_mem = bm_mem_null();
         tensors.push_back(std::make_shared<BMTensor>(m_handle, m_netinfo->output_names[i],
                                                     m_netinfo->output_scales[i], &innerTensors[i], i==0));
@@ -82,13 +157,13 @@ TensorVec BMNetwork::createOutputTensors(){
     return tensors;
 }
 
-TensorVec BMNetwork::createInputTensors(){
+TensorVec BMNetwork::createInputTensors(bool nativeStoreMode){
     TensorVec tensors;
     auto innerTensors = new bm_tensor_t[m_netinfo->input_num];
     for(int i = 0; i < m_netinfo->input_num; ++i) {
         innerTensors[i].dtype = m_netinfo->input_dtypes[i];
         innerTensors[i].shape = m_netinfo->stages[0].input_shapes[i];
-        innerTensors[i].st_mode = BM_STORE_1N;
+        innerTensors[i].st_mode = nativeStoreMode? this->nativeStoreMode(innerTensors[i].dtype): BM_STORE_1N;
         innerTensors[i].device_mem = bm_mem_null();
         tensors.push_back(std::make_shared<BMTensor>(m_handle, m_netinfo->input_names[i],
                                                     m_netinfo->input_scales[i], &innerTensors[i], i==0));
@@ -113,6 +188,10 @@ int BMNetwork::forward(TensorVec inTensors, TensorVec outTensors) {
         BMLOG(DEBUG, "override batch size from %d to %d", runtime_batch_size, static_batch_size);
         for (int i = 0; i < m_netinfo->input_num; ++i)
             net_in_tensors[i].shape.dims[0] = static_batch_size;
+    }
+    if (!m_netinfo->is_dynamic)
+    {
+        // the outputs keep the batch of the last task
         for (int i = 0; i < m_netinfo->output_num; ++i)
             net_out_tensors[i].shape.dims[0] = static_batch_size;
     }
@@ -123,12 +202,19 @@ int BMNetwork::forward(TensorVec inTensors, TensorVec outTensors) {
         user_mem = true;
     }
 
+    // the store modes of the tensors are only respected with user_stmode
+    bool user_stmode = false;
+    for (int i = 0; i < m_netinfo->input_num; ++i)
+        user_stmode = user_stmode || net_in_tensors[i].st_mode != BM_STORE_1N;
+    for (int i = 0; i < m_netinfo->output_num; ++i)
+        user_stmode = user_stmode || net_out_tensors[i].st_mode != BM_STORE_1N;
+
     bool ok=bmrt_launch_tensor_ex(m_bmrt, m_netinfo->name, net_in_tensors, m_netinfo->input_num,
-                                  net_out_tensors, m_netinfo->output_num, user_mem, false);
+                                  net_out_tensors, m_netinfo->output_num, user_mem, user_stmode);
 
-    if (!m_netinfo->is_dynamic && runtime_batch_size < static_batch_size)
+    if (!m_netinfo->is_dynamic)
     {
-        // Set runtime batch size for static model
+        // Set runtime batch size for static model, so only the valid rows are copied back
         for (int i = 0; i < m_netinfo->output_num; ++i)
             net_out_tensors[i].shape.dims[0] = runtime_batch_size;
     }
@@ -154,6 +240,7 @@ BMTensor::~BMTensor() {
         delete [] m_raw_data;
         m_raw_data = NULL;
     }
+    delete [] m_pack_buffer;
     if (m_float_data != NULL) {
         delete [] m_float_data;
         m_float_data = NULL;
@@ -164,19 +251,78 @@ size_t BMTensor::get_elem_num() const {
 	return bmrt_shape_count(&m_tensor->shape);
 }
 
+static void packSamples(const unsigned char* src, unsigned char* dst, size_t lanes, size_t rows, size_t sampleBytes) {
+    if(lanes == 4){
+        pack4N(src, dst, rows, sampleBytes);
+    } else {
+        pack2N((const uint16_t*)src, (uint16_t*)dst, rows, sampleBytes/sizeof(uint16_t));
+    }
+}
+
+static void unpackSamples(const unsigned char* src, unsigned char* dst, size_t lanes, size_t rows, size_t sampleBytes) {
+    if(lanes == 4){
+        unpack4N(src, dst, rows, sampleBytes);
+    } else {
+        unpack2N((const uint16_t*)src, (uint16_t*)dst, rows, sampleBytes/sizeof(uint16_t));
+    }
+}
+
+static unsigned char* reserveBuffer(unsigned char*& buffer, size_t& size, size_t bytes) {
+    if(size < bytes) {
+        delete [] buffer;
+        buffer = nullptr;
+        size = 0;
+    }
+    if (buffer == nullptr) {
+        buffer = new unsigned char[bytes];
+        size = bytes;
+    }
+    return buffer;
+}
+
 bool BMTensor::fill_device_mem(const void *data, size_t len, size_t mem_offset)
 {
     auto mem = get_device_mem();
-    return bm_memcpy_s2d_partial_offset(m_handle, *mem, (void*)data, len, mem_offset) == BM_SUCCESS;
+    size_t lanes = pack_lanes();
+    if(lanes == 1){
+        return bm_memcpy_s2d_partial_offset(m_handle, *mem, (void*)data, len, mem_offset) == BM_SUCCESS;
+    }
+    // a group of lanes samples starts at the same offset in both layouts
+    size_t batch = shape(0);
+    size_t sampleBytes = batch? get_host_mem_size()/batch: 0;
+    if(sampleBytes == 0 || len%sampleBytes != 0 || mem_offset%sampleBytes != 0){
+        BMLOG(ERROR, "cannot fill %d bytes at %d into tensor '%s' of store mode %d",
+              len, mem_offset, m_name.c_str(), m_tensor->st_mode);
+        return false;
+    }
+    size_t groupBytes = sampleBytes*lanes;
+    size_t begin = mem_offset/groupBytes*groupBytes;
+    size_t end = (mem_offset+len+groupBytes-1)/groupBytes*groupBytes;
+    reserveBuffer(m_pack_buffer, m_pack_size, end-begin);
+    auto host = (const unsigned char*)data;
+    size_t rows = len/sampleBytes;
+    if(begin != mem_offset || (mem_offset+len != end && mem_offset+len < get_host_mem_size())){
+        // other samples share the first or last group, they are read back and kept
+        if(bm_memcpy_d2s_partial_offset(m_handle, m_pack_buffer, *mem, end-begin, begin) != BM_SUCCESS){
+            return false;
+        }
+        rows = (end-begin)/sampleBytes;
+        reserve_raw_data(end-begin);
+        unpackSamples(m_pack_buffer, m_raw_data, lanes, rows, sampleBytes);
+        memcpy(m_raw_data+mem_offset-begin, data, len);
+        host = m_raw_data;
+    }
+    packSamples(host, m_pack_buffer, lanes, rows, sampleBytes);
+    return bm_memcpy_s2d_partial_offset(m_handle, *mem, m_pack_buffer, end-begin, begin) == BM_SUCCESS;
 }
 
 size_t BMTensor::get_dtype_len() const {
     auto t = m_tensor->dtype;
     if(t == BM_FLOAT32 || t == BM_INT32 || t== BM_UINT32){
         return 4;
-    } else if(t == BM_UINT16 || t==BM_INT16 || t==BM_FLOAT16){
+    } else if(t == BM_UINT16 || t==BM_INT16 || t==BM_FLOAT16 || t==BM_BFLOAT16){
         return 2;
-    } else if(t == BM_UINT8 || t == BM_UINT8){
+    } else if(t == BM_UINT8 || t == BM_INT8){
         return 1;
     } else {
         BMLOG(FATAL, "Not support dtype=%d", t);
@@ -210,52 +356,114 @@ size_t BMTensor::get_mem_size() const
     return count;
 }
 
-unsigned char *BMTensor::get_raw_data() {
-    auto bytes = get_mem_size();
-    if(m_raw_size < bytes) {
-        delete [] m_raw_data;
-        m_raw_data = nullptr;
-        m_raw_size = 0;
+size_t BMTensor::get_host_mem_size() const
+{
+    return bmrt_tensor_bytesize(m_tensor);
+}
+
+unsigned char *BMTensor::reserve_raw_data(size_t bytes) {
+    return reserveBuffer(m_raw_data, m_raw_size, bytes);
+}
+
+size_t BMTensor::pack_lanes() const
+{
+    if(m_tensor->st_mode == BM_STORE_1N) return 1;
+    size_t lanes = m_tensor->st_mode == BM_STORE_4N? 4: 2;
+    // 4N holds 1-byte and 2N holds 2-byte elements
+    BM_ASSERT_EQ(lanes*get_dtype_len(), 4);
+    return lanes;
+}
+
+// returns the 1N bytes [offset, offset+bytes) in m_raw_data, only the groups covering them are copied back
+const unsigned char *BMTensor::read_host_bytes(size_t offset, size_t bytes)
+{
+    size_t lanes = pack_lanes();
+    if(lanes == 1 || bytes == 0){
+        reserve_raw_data(bytes);
+        auto ret = bm_memcpy_d2s_partial_offset(m_handle, m_raw_data, m_tensor->device_mem, bytes, offset);
+        BM_ASSERT_EQ(ret, BM_SUCCESS);
+        return m_raw_data;
     }
-    if (m_raw_data == nullptr) {
-        m_raw_data = new unsigned char[bytes];
-        m_raw_size = bytes;
+    size_t hostBytes = get_host_mem_size();
+    size_t batch = shape(0);
+    size_t sampleBytes = batch? hostBytes/batch: 0;
+    if(sampleBytes == 0){
+        reserve_raw_data(0);
+        return m_raw_data;
     }
-    bm_status_t ret = bm_memcpy_d2s_partial(m_handle, m_raw_data, m_tensor->device_mem, bytes);
+    size_t groupBytes = sampleBytes*lanes;
+    size_t begin = offset/groupBytes*groupBytes;
+    size_t end = (offset+bytes+groupBytes-1)/groupBytes*groupBytes;
+    reserveBuffer(m_pack_buffer, m_pack_size, end-begin);
+    auto ret = bm_memcpy_d2s_partial_offset(m_handle, m_pack_buffer, m_tensor->device_mem, end-begin, begin);
     BM_ASSERT_EQ(ret, BM_SUCCESS);
-    return m_raw_data;
+    size_t validEnd = end<hostBytes? end: hostBytes;
+    reserve_raw_data(validEnd-begin);
+    unpackSamples(m_pack_buffer, m_raw_data, lanes, (validEnd-begin)/sampleBytes, sampleBytes);
+    return m_raw_data+offset-begin;
+}
+
+unsigned char *BMTensor::get_raw_data() {
+    return (unsigned char*)read_host_bytes(0, get_host_mem_size());
+}
+
+float *BMTensor::reserve_float_data(size_t num) {
+    if (m_float_size < num){
+        delete [] m_float_data;
+        m_float_data = new float[num];
+        m_float_size = num;
+    }
+    return m_float_data;
 }
 
 float *BMTensor::get_float_data() {
-        if (m_tensor->dtype == BM_FLOAT32) {
-            return (float*)get_raw_data();
-        }else if (BM_INT8 == m_tensor->dtype || BM_UINT8 == m_tensor->dtype) {
-            size_t elem_num = get_elem_num();
-            if (m_float_data == nullptr){
-                m_float_data = new float[elem_num];
-            }
-            get_raw_data();
-            if(BM_INT8 == m_tensor->dtype){
-                auto int8_data = (int8_t*)m_raw_data;
-                for(size_t i = 0;i < elem_num; ++ i) {
-                    m_float_data[i] = int8_data[i] * m_scale;
-                }
-            } else {
-                auto uint8_data = (uint8_t*)m_raw_data;
-                for(size_t i = 0;i < elem_num; ++ i) {
-                    m_float_data[i] = uint8_data[i] * m_scale;
-                }
-            }
-        }else{
-            BMLOG(FATAL, "NOT support dtype=%d", m_tensor->dtype);
-        }
-        return m_float_data;
+    if (m_tensor->dtype == BM_FLOAT32) {
+        return (float*)get_raw_data();
+    }
+    size_t elem_num = get_elem_num();
+    get_float_data(reserve_float_data(elem_num), 0, elem_num);
+    return m_float_data;
+}
+
+size_t BMTensor::get_float_data(float *dst, size_t offset, size_t num)
+{
+    size_t elem_num = get_elem_num();
+    if(offset >= elem_num) return 0;
+    if(num > elem_num - offset) num = elem_num - offset;
+    auto dtype = m_tensor->dtype;
+    if (dtype == BM_FLOAT32 && m_tensor->st_mode == BM_STORE_1N) {
+        auto ret = bm_memcpy_d2s_partial_offset(m_handle, dst, m_tensor->device_mem,
+                                                num*sizeof(float), offset*sizeof(float));
+        BM_ASSERT_EQ(ret, BM_SUCCESS);
+        return num;
+    }
+    // only the requested bytes are copied back
+    auto dtype_len = get_dtype_len();
+    auto data = read_host_bytes(offset*dtype_len, num*dtype_len);
+    if (dtype == BM_FLOAT32) {
+        memcpy(dst, data, num*sizeof(float));
+    } else if (dtype == BM_INT8) {
+        dequantize((const int8_t*)data, dst, num, m_scale);
+    } else if (dtype == BM_UINT8) {
+        dequantize((const uint8_t*)data, dst, num, m_scale);
+    } else if (dtype == BM_FLOAT16) {
+        fp16ToFloat((const uint16_t*)data, dst, num);
+    } else if (dtype == BM_BFLOAT16) {
+        bf16ToFloat((const uint16_t*)data, dst, num);
+    } else {
+        BMLOG(FATAL, "NOT support dtype=%d", dtype);
+    }
+    return num;
 }
 
 size_t BMTensor::fill_host_mem(void *ptr, size_t len)
 {
-    auto bytes = get_mem_size();
+    auto bytes = get_host_mem_size();
     size_t real_len = bytes>len? len: bytes;
+    if(m_tensor->st_mode != BM_STORE_1N){
+        memcpy(ptr, read_host_bytes(0, real_len), real_len);
+        return real_len;
+    }
     bm_status_t ret = bm_memcpy_d2s_partial(m_handle, ptr, m_tensor->device_mem, real_len);
     BM_ASSERT_EQ(ret, BM_SUCCESS);
     return real_len;
@@ -273,4 +481,88 @@ void BMTensor::dumpData(const char* filename) {
     }
 }
 
+// returns the elements of a sample, a scalar tensor is a single sample
+size_t BMTensor::clamp_batch(size_t &begin, size_t &end) const
+{
+    size_t batch = m_tensor->shape.num_dims>0? shape(0): 1;
+    if(end > batch) end = batch;
+    if(begin > end) begin = end;
+    return batch? get_elem_num()/batch: 0;
+}
+
+TensorView BMTensor::host_view(size_t begin, size_t end)
+{
+    size_t sampleElems = clamp_batch(begin, end);
+    auto dtype_len = get_dtype_len();
+    auto data = read_host_bytes(begin*sampleElems*dtype_len, (end-begin)*sampleElems*dtype_len);
+    TensorView view((void*)data, m_tensor->dtype, m_tensor->shape);
+    if(view.dims>0) view.shape[0] = end-begin;
+    return view;
+}
+
+TensorView BMTensor::float_view(size_t begin, size_t end)
+{
+    if (m_tensor->dtype == BM_FLOAT32) {
+        return host_view(begin, end);
+    }
+    size_t sampleElems = clamp_batch(begin, end);
+    size_t num = (end-begin)*sampleElems;
+    get_float_data(reserve_float_data(num), begin*sampleElems, num);
+    TensorView view(m_float_data, BM_FLOAT32, m_tensor->shape);
+    if(view.dims>0) view.shape[0] = end-begin;
+    return view;
+}
+
+TensorView::TensorView(void *data, bm_data_type_t dtype, const bm_shape_t &shape):
+    data(data), dtype(dtype), dims(shape.num_dims) {
+    size_t stride = 1;
+    for(size_t i=dims; i>0; i--){
+        this->shape[i-1] = shape.dims[i-1];
+        strides[i-1] = stride;
+        stride *= shape.dims[i-1];
+    }
+}
+
+size_t TensorView::elem_num() const
+{
+    size_t num = 1;
+    for(size_t i=0; i<dims; i++){
+        num *= shape[i];
+    }
+    return num;
+}
+
+bool TensorView::is_contiguous() const
+{
+    size_t stride = 1;
+    for(size_t i=dims; i>0; i--){
+        if(shape[i-1] != 1 && strides[i-1] != stride) return false;
+        stride *= shape[i-1];
+    }
+    return true;
+}
+
+TensorView TensorView::slice(size_t begin, size_t end) const
+{
+    BM_ASSERT(dims>0 && begin<=end && end<=shape[0], "invalid slice [%d, %d) of %d samples", begin, end, dims>0? shape[0]: 0);
+    TensorView view = *this;
+    view.data = (char*)data + begin*strides[0]*dtype_len();
+    view.shape[0] = end-begin;
+    return view;
+}
+
+TensorView TensorView::operator[](size_t b) const
+{
+    BM_ASSERT(dims>0 && b<shape[0], "sample %d is out of %d", b, dims>0? shape[0]: 0);
+    TensorView view;
+    view.data = (char*)data + b*strides[0]*dtype_len();
+    view.dtype = dtype;
+    view.dims = dims-1;
+    for(size_t i=1; i<dims; i++){
+        view.shape[i-1] = shape[i];
+        view.strides[i-1] = strides[i];
+    }
+    return view;
+}
+
 }
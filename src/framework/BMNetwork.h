@@ -10,15 +10,39 @@
 
 namespace bm {
 
+// non-owning view of tensor data on host, shape and strides are in elements
+struct TensorView {
+    void* data;
+    bm_data_type_t dtype;
+    size_t dims;
+    size_t shape[BM_MAX_DIMS_NUM];
+    size_t strides[BM_MAX_DIMS_NUM];
+
+    TensorView(): data(nullptr), dtype(BM_FLOAT32), dims(0) {}
+    // contiguous data of the shape
+    TensorView(void* data, bm_data_type_t dtype, const bm_shape_t& shape);
+
+    size_t dtype_len() const { return bmrt_data_type_size(dtype); }
+    size_t elem_num() const;
+    bool is_contiguous() const;
+    // samples [begin, end) of dim 0
+    TensorView slice(size_t begin, size_t end) const;
+    // sample b, without dim 0
+    TensorView operator[](size_t b) const;
+    template<typename T> T* ptr() const { return static_cast<T*>(data); }
+};
+
 class BMTensor{
 public:
     BMTensor(bm_handle_t handle, const char *name, float scale, bm_tensor_t* tensor, bool relase):
-        m_handle(handle), m_name(name), m_raw_data(nullptr), m_raw_size(0), m_float_data(nullptr), m_scale(scale), m_tensor(tensor), need_release(relase) {
+        m_handle(handle), m_name(name), m_raw_data(nullptr), m_raw_size(0), m_pack_buffer(nullptr), m_pack_size(0), m_float_data(nullptr), m_float_size(0), m_scale(scale), m_tensor(tensor), need_release(relase) {
     }
 
     void set_device_mem(bm_device_mem_t *mem) { this->m_tensor->device_mem = *mem; }
     const bm_device_mem_t* get_device_mem() { return &this->m_tensor->device_mem; }
 
+    // data, len and mem_offset are in the 1N layout, 4N/2N tensors are packed on the way,
+    // then mem_offset and len must be whole samples
     bool fill_device_mem(const void* data, size_t len, size_t mem_offset = 0);
 
     // basic attribute of tensor
@@ -32,6 +56,11 @@ public:
             m_tensor->shape.dims[i] = shape[i];
         }
     }
+    // the number of valid samples, BMNetwork::forward runs a static network with its full batch,
+    // then sets the batch of the outputs back, so only the valid rows are copied to host
+    void set_batch(size_t batch){
+        if(m_tensor->shape.num_dims>0) m_tensor->shape.dims[0] = batch;
+    }
     size_t shape(int dim) const {
         while(dim<0) dim+=m_tensor->shape.num_dims;
         return dim<m_tensor->shape.num_dims? m_tensor->shape.dims[dim]:1; }
@@ -39,13 +68,25 @@ public:
     size_t dims() const { return m_tensor->shape.num_dims; }
     float get_scale() const { return m_scale; }
 
+    // bytes on device in the store mode, including the padding samples of 4N/2N
     size_t get_mem_size() const;
+    // bytes of the 1N data returned by get_raw_data and fill_host_mem
+    size_t get_host_mem_size() const;
     size_t get_elem_num() const;
 
     bm_tensor_t* raw_tensor() { return m_tensor; }
+    // host reads always return the 1N layout, 4N/2N tensors are unpacked
     unsigned char* get_raw_data();
     float *get_float_data();
+    // converts elements [offset, offset+num) to float into dst without touching the internal float buffer,
+    // returns the number of elements written
+    size_t get_float_data(float* dst, size_t offset = 0, size_t num = (size_t)-1);
     size_t fill_host_mem(void* ptr, size_t len);
+    // views of samples [begin, end) in the internal host buffers, only those samples are copied back,
+    // valid until the next host read of the tensor
+    TensorView host_view(size_t begin = 0, size_t end = (size_t)-1);
+    // in float like get_float_data()
+    TensorView float_view(size_t begin = 0, size_t end = (size_t)-1);
     const std::string &name() const { return m_name; }
 
     virtual ~BMTensor();
@@ -56,22 +97,49 @@ private:
     std::string m_name;
     unsigned char* m_raw_data;
     size_t m_raw_size;
+    // device layout of 4N/2N tensors
+    unsigned char* m_pack_buffer;
+    size_t m_pack_size;
     float* m_float_data;
+    size_t m_float_size;
     float m_scale;
     bool need_release;
     bm_tensor_t *m_tensor;
+
+    unsigned char* reserve_raw_data(size_t bytes);
+    float* reserve_float_data(size_t num);
+    size_t clamp_batch(size_t& begin, size_t& end) const;
+    size_t pack_lanes() const;
+    const unsigned char* read_host_bytes(size_t offset, size_t bytes);
 };
 
 using TensorPtr = std::shared_ptr<BMTensor>;
 using TensorVec = std::vector<TensorPtr>;
 
+// mmaped bmodel file, shared by all devices and runners in the process
+// the cache is keyed by path and modification time, a changed file will be mapped again
+class BMModelData : public Uncopiable {
+    void* m_data;
+    size_t m_size;
+    std::string m_path;
+public:
+    BMModelData(const std::string& path);
+    ~BMModelData();
+    const void* data() const { return m_data; }
+    size_t size() const { return m_size; }
+
+    static std::shared_ptr<BMModelData> get(const std::string& path);
+};
+
 class BMNetwork : public Uncopiable {
     const bm_net_info_t *m_netinfo;
     bm_handle_t  m_handle;
     std::string bmodelPath;
+    std::shared_ptr<BMModelData> m_model_data;
     void *m_bmrt;
     size_t batchSize;
     std::vector<std::string> m_network_names;
+    bool m_native_store_mode;
 
 public:
     BMNetwork(void *bmrt, const std::string& name);
@@ -81,8 +149,12 @@ public:
     size_t getBatchSize(){ return batchSize; }
     const bm_net_info_t *getNetInfo() const { return m_netinfo; }
 
-    TensorVec createOutputTensors();
-    TensorVec createInputTensors();
+    // the layout bmrt uses for dtype without conversion, BM_STORE_1N if the chip has none
+    bm_store_mode_t nativeStoreMode(bm_data_type_t dtype) const;
+    // the tensors are 1N unless asked for, code reading or writing the device memory directly,
+    // e.g. by bmcv, expects 1N, while BMTensor packs and unpacks the native layouts itself
+    TensorVec createOutputTensors(bool nativeStoreMode = false);
+    TensorVec createInputTensors(bool nativeStoreMode = false);
     int forward(TensorVec inTensors, TensorVec outTensors);
 };
 
@@ -4,6 +4,8 @@
 #include <set>
 #include <vector>
 #include <memory>
+#include <mutex>
+#include <condition_variable>
 #include <future>
 #include <thread>
 #include <typeinfo>
@@ -25,6 +27,38 @@ public:
 
 struct BMPipelineEmptyContext { };
 
+// stops the first node of a pipeline from taking tasks, which waits on it until resumed or stopped
+class BMPipelinePause {
+public:
+    void set(bool value) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            paused = value;
+        }
+        cond.notify_all();
+    }
+
+    bool isSet() const {
+        return paused;
+    }
+
+    void wait(const std::atomic_bool& done) {
+        std::unique_lock<std::mutex> lock(mutex);
+        cond.wait(lock, [&]{ return !paused || done; });
+    }
+
+    // done is set without the lock, so the waiters are woken up after it
+    void wake() {
+        { std::lock_guard<std::mutex> lock(mutex); }
+        cond.notify_all();
+    }
+
+private:
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::atomic_bool paused{false};
+};
+
 template<typename InType, typename OutType, typename ContextType = BMPipelineEmptyContext>
 class BMPipelineNodeImp: public Uncopiable, public BMPipelineNodeBase {
 private:
@@ -40,6 +74,7 @@ private:
     OutQueuePtr outTaskQueue;
     std::thread innerThread;
     std::atomic_bool& done;
+    BMPipelinePause* paused;
     std::string name;
 
     void workThread(){
@@ -60,6 +95,10 @@ private:
             }
             bool finish = false;
             while(!done && !finish){
+                if(paused && paused->isSet()){
+                    paused->wait(done);
+                    continue;
+                }
                 if(inTaskQueue->waitAndPop(in)) {
                     BMLOG(DEBUG, "[%s] got a task", name.c_str());
                 } else {
@@ -67,6 +106,11 @@ private:
                     join = true;
                     break;
                 }
+                // paused while waiting, the task goes back to the queue shared with the other pipelines
+                if(paused && paused->isSet()){
+                    inTaskQueue->pushFront(in);
+                    continue;
+                }
                 if(!done){
                     finish = taskFunc(in, out, context);
                     if(inFreeQueue) {
@@ -96,13 +140,13 @@ public:
                       OutQueuePtr outFreeQueue, OutQueuePtr outTaskQueue,
                       std::atomic_bool& done,
                       std::shared_ptr<ContextType> context,
-                      const std::string& name
+                      const std::string& name,
+                      BMPipelinePause* paused = nullptr
                       ):
-        taskFunc(taskFunc),
+        context(context), taskFunc(taskFunc),
         inFreeQueue(inFreeQueue), inTaskQueue(inTaskQueue),
         outFreeQueue(outFreeQueue), outTaskQueue(outTaskQueue),
-        done(done),
-        context(context), name(name)
+        done(done), paused(paused), name(name)
     {}
 
     virtual void setOutQueue(std::shared_ptr<BMQueueVoid> outQueueVoid) override {
@@ -138,8 +182,12 @@ private:
     std::shared_ptr<BMQueue<InType>> inQueue;
     std::shared_ptr<BMQueue<OutType>> outQueue;
     std::vector<std::shared_ptr<BMPipelineNodeBase>> pipelineNodes;
+    std::vector<std::shared_ptr<BMQueueVoid>> nodeWorkQueues;
+    std::vector<std::shared_ptr<BMQueueVoid>> nodeResourceQueues;
     std::shared_ptr<ContextType> context;
     std::atomic_bool done;
+    // only stops the first node from taking new tasks, the others keep working
+    BMPipelinePause paused;
     std::shared_ptr<BMQueueVoid> lastOutResourceQueue;
     std::shared_ptr<BMQueueVoid> lastOutWorkQueue;
     std::string lastTypeName;
@@ -230,12 +278,15 @@ public:
             outResourceQueue->push(out);
         }
         std::string nodeName = pipelineName+"_n" + std::to_string(pipelineNodes.size());
+        BMPipelinePause* nodePaused = pipelineNodes.empty()? &paused: nullptr;
         pipelineNodes.emplace_back(
                     new BMPipelineNodeImp<NodeInType, NodeOutType, ContextType>(func,
                                                                                 inResourceQueue, inWorkQueue,
                                                                                 outResourceQueue, outWorkQueue,
-                                                                                done, context, nodeName)
+                                                                                done, context, nodeName, nodePaused)
                     );
+        nodeWorkQueues.push_back(inWorkQueue);
+        nodeResourceQueues.push_back(inResourceQueue);
     }
 
     void start() {
@@ -276,6 +327,24 @@ public:
         return done;
     }
 
+    void pause(bool value = true){
+        paused.set(value);
+    }
+
+    size_t nodeNum() const {
+        return pipelineNodes.size();
+    }
+
+    // input work queue of the node
+    std::shared_ptr<BMQueueVoid> getWorkQueue(size_t nodeIndex) const {
+        return nodeIndex<nodeWorkQueues.size()? nodeWorkQueues[nodeIndex]: std::shared_ptr<BMQueueVoid>();
+    }
+
+    // the queue the node gives its inputs back to once processed, null if they are not resource limited
+    std::shared_ptr<BMQueueVoid> getResourceQueue(size_t nodeIndex) const {
+        return nodeIndex<nodeResourceQueues.size()? nodeResourceQueues[nodeIndex]: std::shared_ptr<BMQueueVoid>();
+    }
+
     void join() {
         for (int i = 0; i < pipelineNodes.size(); ++i)
         {
@@ -286,6 +355,7 @@ public:
 
     void stop(){
         done = true;
+        paused.wake();
         this->join();
     }
 
@@ -304,6 +374,41 @@ private:
    std::shared_ptr<BMQueue<OutType>> outQueue;
    std::function<void(std::shared_ptr<ContextType>)> contextDeinitializer;
 
+    // contexts are initialized concurrently, since each one may take seconds to load models on its device
+    // all errors are collected before failing, so every bad device is reported
+    // each one is logged with its own time and the name of its pipeline, such as the device of it
+    static std::vector<std::shared_ptr<ContextType>> initContexts(
+            size_t num_pipeline, std::function<std::shared_ptr<ContextType>(size_t)> contextInitializer,
+            std::function<std::string(size_t, ContextType &)> nameFunc) {
+        std::vector<std::shared_ptr<ContextType>> contexts(num_pipeline);
+        if(!contextInitializer) return contexts;
+        auto startTime = TimerClock::now();
+        std::vector<std::future<std::shared_ptr<ContextType>>> futures;
+        for(size_t i=0; i<num_pipeline; i++){
+            futures.push_back(std::async(std::launch::async, [i, &contextInitializer, &nameFunc](){
+                auto contextStart = TimerClock::now();
+                auto context = contextInitializer(i);
+                auto name = nameFunc && context? nameFunc(i, *context): "#" + std::to_string(i);
+                BMLOG(INFO, "context %s initialized in %gms", name.c_str(), usBetween(contextStart, TimerClock::now())/1000.0);
+                return context;
+            }));
+        }
+        std::string errors;
+        for(size_t i=0; i<num_pipeline; i++){
+            try {
+                contexts[i] = futures[i].get();
+            } catch (std::exception& e) {
+                BMLOG(ERROR, "context #%d initialization failed: %s", i, e.what());
+                errors += " #" + std::to_string(i) + ": " + e.what();
+            }
+        }
+        if(!errors.empty()){
+            BMLOG(FATAL, "context initialization failed:%s", errors.c_str());
+        }
+        BMLOG(INFO, "%d contexts initialized in %gms", num_pipeline, usBetween(startTime, TimerClock::now())/1000.0);
+        return contexts;
+    }
+
 public:
     BMPipelinePool(size_t num_pipeline = 1,
                    std::function<std::shared_ptr<ContextType>(size_t)> contextInitializer = nullptr,
@@ -312,11 +417,9 @@ public:
                    ) {
         inQueue = std::make_shared<BMQueue<InType>>();
         outQueue = std::make_shared<BMQueue<OutType>>();
+        auto contexts = initContexts(num_pipeline, contextInitializer, nameFunc);
         for(size_t i=0; i<num_pipeline; i++){
-            std::shared_ptr<ContextType> context;
-            if(contextInitializer){
-                context = contextInitializer(i);
-            }
+            auto& context = contexts[i];
             std::string pipelineName = std::string("pipeline") + std::to_string(i);
             if(nameFunc){
                 pipelineName = nameFunc(i, *context);
@@ -342,6 +445,30 @@ public:
         return inQueue;
     }
 
+    std::shared_ptr<BMQueue<OutType>> getOutputQueue(){
+        return outQueue;
+    }
+
+    size_t pipelineNum() const {
+        return pipelines.size();
+    }
+
+    std::shared_ptr<BMQueueVoid> getWorkQueue(size_t index, size_t nodeIndex) const {
+        if(index>=pipelines.size() || !pipelines[index]) return std::shared_ptr<BMQueueVoid>();
+        return pipelines[index]->getWorkQueue(nodeIndex);
+    }
+
+    std::shared_ptr<BMQueueVoid> getResourceQueue(size_t index, size_t nodeIndex) const {
+        if(index>=pipelines.size() || !pipelines[index]) return std::shared_ptr<BMQueueVoid>();
+        return pipelines[index]->getResourceQueue(nodeIndex);
+    }
+
+    void pause(size_t index, bool value = true){
+        if(index<pipelines.size() && pipelines[index]){
+            pipelines[index]->pause(value);
+        }
+    }
+
     template<typename NodeInType, typename NodeOutType, typename Container = std::vector<NodeOutType>>
     void addNode(std::function<NodeOutType(const NodeInType&)> func,
                  std::function<Container(std::shared_ptr<ContextType>)> outResourceInitializer = nullptr) {
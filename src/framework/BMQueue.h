@@ -4,6 +4,7 @@
 #include <thread>
 #include <mutex>
 #include <deque>
+#include <functional>
 #include <atomic>
 #include <condition_variable>
 #include "BMCommonUtils.h"
@@ -13,6 +14,8 @@ namespace bm {
 class BMQueueVoid {
 public:
     virtual ~BMQueueVoid() {};
+    virtual size_t size() const = 0;
+    virtual size_t pushedNum() const = 0;
 };
 
 template <typename T>
@@ -30,7 +33,9 @@ private:
     bool joined = false;
     size_t max_nodes;
     std::atomic<size_t> num_nodes;
+    std::atomic<size_t> num_pushed;
     std::condition_variable data_cond;
+    std::function<void()> push_callback;
     Node* getTail(){
         LOCK(tail);
         return tail;
@@ -63,7 +68,7 @@ private:
     }
 
 public:
-    BMQueue(size_t max_nodes=0): head(new Node), tail(head.get()), max_nodes(max_nodes), num_nodes(0) {}
+    BMQueue(size_t max_nodes=0): head(new Node), tail(head.get()), max_nodes(max_nodes), num_nodes(0), num_pushed(0) {}
 
     std::shared_ptr<T> tryPop() {
         auto oldHead = tryPopHead();
@@ -102,10 +107,24 @@ public:
         return  max_nodes==0 || num_nodes<max_nodes;
     }
 
+    // called after every push, in the pushing thread, must be set before anything is pushed
+    void setPushCallback(std::function<void()> callback){
+        push_callback = callback;
+    }
+
     void setMaxNode(size_t max){
         max_nodes = max;
     }
 
+    size_t size() const override {
+        return num_nodes.load(std::memory_order_acquire);
+    }
+
+    // total number of pushed items since created
+    size_t pushedNum() const override {
+        return num_pushed.load(std::memory_order_relaxed);
+    }
+
     void push(T new_value) {
         std::shared_ptr<T> new_data(
                     std::make_shared<T>(std::move(new_value)));
@@ -119,6 +138,22 @@ public:
             tail = new_tail;
             num_nodes.fetch_add(1, std::memory_order_acq_rel);
         }
+        num_pushed.fetch_add(1, std::memory_order_relaxed);
+        data_cond.notify_one();
+        if(push_callback) push_callback();
+    }
+
+    // gives a popped item back to the head, for the next pop, without waiting for room
+    // it is not counted as pushed and does not call the push callback
+    void pushFront(T value) {
+        std::unique_ptr<Node> new_node(new Node);
+        new_node->data = std::make_shared<T>(std::move(value));
+        {
+            LOCK(head);
+            new_node->next = std::move(head);
+            head = std::move(new_node);
+            num_nodes.fetch_add(1, std::memory_order_acq_rel);
+        }
         data_cond.notify_one();
     }
 
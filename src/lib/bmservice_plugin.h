@@ -0,0 +1,50 @@
+#ifndef BMSERVICE_PLUGIN_H
+#define BMSERVICE_PLUGIN_H
+#include <stddef.h>
+#include "bmruntime_interface.h"
+#include "interface.h"
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+// a plugin is a shared library loaded by runner_start_with_plugin, which looks up the functions below by name
+// a missing hook falls back to the raw tensor copy of runner_start, but one of the pre and post hooks is needed
+// the hooks run on the pre/post-process threads of every device at the same time, so they must be thread safe
+// warm-up tasks never go through the hooks
+
+// called once with the config of runner_start_with_plugin, the result is passed to every other function
+// returning a null pointer fails the start
+typedef void *(*bmservice_plugin_create_t)(const char *config);
+// called after the runner is stopped, needed if create returns a state to be freed
+typedef void (*bmservice_plugin_destroy_t)(void *plugin);
+
+// inputs are the tensors put to the runner, net_inputs have dims, shape and dtype of the largest stage
+// and data large enough for them. fill the data, shape[0] may be reduced to the batch of the task,
+// dtype of fp16/bf16 inputs may be set to BM_FLOAT32. returns 0 on success, otherwise the task is invalid
+typedef int (*bmservice_plugin_pre_t)(void *plugin, const tensor_data_t *inputs, unsigned int input_num,
+                                      tensor_data_t *net_inputs, unsigned int net_input_num);
+
+// creates num output tensors with bytes[i] of data each, in one block released by runner_release_output
+typedef tensor_data_t *(*bmservice_alloc_outputs_t)(const size_t *bytes, unsigned int num);
+
+// net_outputs are the outputs selected by runner_select_outputs on host, fp16/bf16 converted to fp32,
+// inputs are the ones given to the pre hook. *outputs must be created by alloc_outputs, then dims, shape,
+// dtype and data of them filled. returns 0 on success, otherwise the task is invalid
+// it is also called for the tasks whose pre hook or forward failed, their outputs are invalid anyway
+// get_output_sizes and runner_get_output_into describe the network outputs, not the ones of the hook
+typedef int (*bmservice_plugin_post_t)(void *plugin, const tensor_data_t *inputs, unsigned int input_num,
+                                       const tensor_data_t *net_outputs, unsigned int net_output_num,
+                                       bmservice_alloc_outputs_t alloc_outputs,
+                                       tensor_data_t **outputs, unsigned int *output_num);
+
+#define BMSERVICE_PLUGIN_CREATE "bmservice_plugin_create"
+#define BMSERVICE_PLUGIN_DESTROY "bmservice_plugin_destroy"
+#define BMSERVICE_PLUGIN_PRE "bmservice_plugin_pre"
+#define BMSERVICE_PLUGIN_POST "bmservice_plugin_post"
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BMSERVICE_PLUGIN_H
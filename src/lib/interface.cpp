@@ -1,19 +1,35 @@
 #include <map>
+#include <deque>
 #include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <algorithm>
 #include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <dlfcn.h>
 #include "bmruntime_interface.h"
 #include "BMDevicePool.h"
+#include "BMDataConvert.h"
 #include "BMLog.h"
+#include "BMMetrics.h"
+#include "BMCommonUtils.h"
+#include "BMDetectUtils.h"
+#include "BMImageUtils.h"
 #include "interface.h"
+#include "bmservice_plugin.h"
 
 using namespace bm;
 
 size_t dtype_len(unsigned int t) {
     if(t == BM_FLOAT32 || t == BM_INT32 || t== BM_UINT32){
         return 4;
-    } else if(t == BM_UINT16 || t==BM_INT16 || t==BM_FLOAT16){
+    } else if(t == BM_UINT16 || t==BM_INT16 || t==BM_FLOAT16 || t==BM_BFLOAT16){
         return 2;
-    } else if(t == BM_UINT8 || t == BM_UINT8){
+    } else if(t == BM_UINT8 || t == BM_INT8 || t == BM_ENCODED_IMAGE){
         return 1;
     } else {
         BMLOG(FATAL, "Not support dtype=%d", t);
@@ -21,6 +37,10 @@ size_t dtype_len(unsigned int t) {
     return 0;
 }
 
+static size_t align_up(size_t value, size_t align){
+    return (value + align - 1)/align*align;
+}
+
 static size_t elem_num(const unsigned int* shape, unsigned int dims){
     size_t elem = 1;
     for(size_t i=0; i<dims; i++){
@@ -29,95 +49,1030 @@ static size_t elem_num(const unsigned int* shape, unsigned int dims){
     return elem;
 }
 
+struct InputBlock;
 struct InputType {
     bool release_inside = false;
     unsigned int id = 0;
     unsigned num = 0;
     tensor_data_t* tensors = nullptr;
+    // set if tensors is a pooled block, which is given back once copied to device,
+    // or after the post hook of a plugin, which reads the inputs too
+    std::shared_ptr<InputBlock> block;
+};
+
+// the buffers of a runner_get_output_into call, taken by the post-process of the next task
+struct OutputDest {
+    tensor_data_t* outputs;
+    const unsigned int* capacities;
+    unsigned int num;
+    // the output num, -2 or -3 as returned by runner_get_output_into
+    int result = 0;
+    // the task filling it is dropped by the watchdog, set where it is popped
+    bool dropped = false;
 };
 
 struct OutputType {
     unsigned int id = 0;
     unsigned num = 0;
     tensor_data_t* tensors = nullptr;
+    // set instead of tensors if the outputs are in the buffers of a runner_get_output_into call
+    OutputDest* dest = nullptr;
+};
+
+// image is set if the inputs may be encoded images, see runner_set_image_input
+// keep_inputs holds a pooled input block until the post-process, which still reads the inputs
+using ImageSpec = std::shared_ptr<const image_spec_t>;
+bool preProcess(const InputType& input, const TensorVec& inTensors, ContextPtr ctx, ImageSpec image, bool keep_inputs);
+
+// the tensor_data_t array and the data of the inputs or outputs of a task are one block,
+// a header before the array keeps its capacity, so released blocks can be reused
+class HostBlockPool {
+public:
+    static const size_t HEADER_SIZE = 16;
+    // cached blocks of every capacity, the rest are freed
+    static const size_t MAX_FREE_BLOCKS = 64;
+
+    static HostBlockPool& instance() {
+        static HostBlockPool pool;
+        return pool;
+    }
+
+    // pooled blocks are rounded up to powers of 2, so tasks of different batches can share them
+    unsigned char* acquire(size_t bytes, bool pooled) {
+        size_t capacity = bytes + HEADER_SIZE;
+        unsigned char* block = nullptr;
+        if(pooled){
+            size_t rounded = 256;
+            while(rounded < capacity) rounded *= 2;
+            capacity = rounded;
+            std::lock_guard<std::mutex> lock(mutex);
+            auto& blocks = freeBlocks[capacity];
+            if(!blocks.empty()){
+                block = blocks.back();
+                blocks.pop_back();
+            }
+        }
+        if(!block) block = new unsigned char[capacity];
+        auto header = (Header*)block;
+        header->capacity = capacity;
+        header->pooled = pooled;
+        return block + HEADER_SIZE;
+    }
+
+    void release(const void* ptr) {
+        auto block = (unsigned char*)ptr - HEADER_SIZE;
+        auto header = (Header*)block;
+        if(header->pooled){
+            std::lock_guard<std::mutex> lock(mutex);
+            auto& blocks = freeBlocks[header->capacity];
+            if(blocks.size() < MAX_FREE_BLOCKS){
+                blocks.push_back(block);
+                return;
+            }
+        }
+        delete [] block;
+    }
+
+    ~HostBlockPool() {
+        for(auto& item: freeBlocks){
+            for(auto block: item.second) delete [] block;
+        }
+    }
+
+private:
+    struct Header {
+        size_t capacity;
+        bool pooled;
+    };
+    std::mutex mutex;
+    std::map<size_t, std::vector<unsigned char*>> freeBlocks;
+};
+
+// the tensor_data_t array comes first, then the data of every tensor, 16-byte aligned
+static tensor_data_t* acquire_tensors(const std::vector<size_t>& bytes, bool pooled){
+    std::vector<size_t> offsets(bytes.size()+1);
+    offsets[0] = align_up(bytes.size()*sizeof(tensor_data_t), 16);
+    for(size_t k=0; k<bytes.size(); k++){
+        offsets[k+1] = offsets[k] + align_up(bytes[k], 16);
+    }
+    auto buffer = HostBlockPool::instance().acquire(offsets.back(), pooled);
+    auto tensors = (tensor_data_t*)buffer;
+    for(size_t k=0; k<bytes.size(); k++){
+        tensors[k].data = buffer + offsets[k];
+    }
+    return tensors;
+}
+
+// a pooled block of the inputs of the largest stage of dynamic networks, so any task fits
+// half_as_float leaves room for fp16/bf16 inputs passed as fp32
+static tensor_data_t* acquire_net_inputs(const bm_net_info_t* net_info, bool half_as_float){
+    std::vector<size_t> bytes(net_info->input_num);
+    std::vector<const bm_shape_t*> shapes(net_info->input_num);
+    for(int i=0; i<net_info->input_num; i++){
+        auto dtype = net_info->input_dtypes[i];
+        size_t elem_size = half_as_float && (dtype == BM_FLOAT16 || dtype == BM_BFLOAT16)? sizeof(float): dtype_len(dtype);
+        for(int s=0; s<net_info->stage_num; s++){
+            auto& shape = net_info->stages[s].input_shapes[i];
+            size_t stage_bytes = bmrt_shape_count(&shape) * elem_size;
+            if(shapes[i] && stage_bytes <= bytes[i]) continue;
+            bytes[i] = stage_bytes;
+            shapes[i] = &shape;
+        }
+    }
+    auto tensors = acquire_tensors(bytes, true);
+    for(int i=0; i<net_info->input_num; i++){
+        tensors[i].dims = shapes[i]->num_dims;
+        for(int d=0; d<shapes[i]->num_dims; d++){
+            tensors[i].shape[d] = shapes[i]->dims[d];
+        }
+        tensors[i].dtype = net_info->input_dtypes[i];
+    }
+    return tensors;
+}
+
+struct InputBlock {
+    tensor_data_t* tensors;
+    std::atomic_bool released{false};
+    InputBlock(tensor_data_t* tensors): tensors(tensors) {}
+    // only the first call gives it back, the copies of the task in later stages share it
+    void release() {
+        if(!released.exchange(true)) HostBlockPool::instance().release(tensors);
+    }
+    ~InputBlock() {
+        release();
+    }
 };
 
-bool preProcess(const InputType& input, const TensorVec& inTensors, ContextPtr ctx);
-bool postProcess(const InputType& input, const TensorVec& outTensors, OutputType& postOut, ContextPtr ctx);
+// selected is the indices of the returned outputs, nullptr returns all
+using OutputSelection = std::shared_ptr<const std::vector<unsigned>>;
+// reducers[i] applies to the network output i, the outputs after the end are not reduced
+using OutputReducers = std::shared_ptr<const std::vector<output_reducer_t>>;
+bool postProcess(const InputType& input, const TensorVec& outTensors, OutputType& postOut, ContextPtr ctx,
+                 OutputSelection selected, OutputReducers reducers, bool pooled, OutputDest* dest);
+InputType createWarmUpInput(const bm_net_info_t* netInfo);
+void releaseOutput(OutputType& output);
+void expiredOutput(const InputType& input, OutputType& output);
+void failedOutput(const InputType& input, OutputType& output);
+static void releaseInput(const InputType& input);
 
 std::vector<DeviceId> globalDevices;
+
+// wakes up the users waiting for outputs, through an eventfd or a callback
+class CompletionNotifier {
+public:
+    ~CompletionNotifier() {
+        if(fd >= 0) close(fd);
+    }
+
+    // created on first use, so runners nobody waits on do not write it
+    int getFd() {
+        int current = fd;
+        if(current >= 0) return current;
+        int created = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if(created < 0){
+            BMLOG(ERROR, "eventfd failed: %s", strerror(errno));
+            return -1;
+        }
+        if(!fd.compare_exchange_strong(current, created)){
+            close(created);
+            return current;
+        }
+        return created;
+    }
+
+    void setCallback(runner_completion_callback_t func, void* user_data) {
+        std::shared_ptr<const Callback> callback;
+        if(func) callback = std::make_shared<const Callback>(Callback{func, user_data});
+        std::atomic_store(&this->callback, callback);
+    }
+
+    void notify(unsigned int runner_id) {
+        int current = fd;
+        if(current >= 0){
+            uint64_t one = 1;
+            ssize_t written = write(current, &one, sizeof(one));
+            (void)written;
+        }
+        auto current_callback = std::atomic_load(&callback);
+        if(current_callback) current_callback->func(runner_id, current_callback->user_data);
+    }
+
+private:
+    struct Callback {
+        runner_completion_callback_t func;
+        void* user_data;
+    };
+    std::atomic_int fd{-1};
+    std::shared_ptr<const Callback> callback;
+};
+
+// the outputs taken from the runner by runner_wait_task/runner_poll_task, until their tasks are asked for
+struct TaskTable {
+    // the oldest unclaimed outputs are dropped beyond it, so tasks nobody waits for do not pile up
+    static const size_t MAX_COMPLETED = 4096;
+    struct Completed {
+        tensor_data_t* tensors;
+        unsigned int num;
+        unsigned int valid;
+    };
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::map<unsigned int, Completed> completed;
+    bool stopped = false;
+    // counts the notifies, so a waiter popping without the lock does not miss one
+    uint64_t notified = 0;
+    // the waiters popping the runner, their tasks are neither pending nor completed until filed
+    std::atomic_uint popping{0};
+    // the outputs popped by runner_get_output* wake up the waiters, whose tasks may be among them
+    std::atomic_uint waiters{0};
+
+    // called with the mutex locked
+    void add(unsigned int id, const Completed& done) {
+        completed[id] = done;
+        if(completed.size() <= MAX_COMPLETED) return;
+        // ids grow with the puts, so the first one is the oldest task
+        auto oldest = completed.begin();
+        BMLOG(WARNING, "output of task #%u is never waited for, dropped", oldest->first);
+        runner_release_output(oldest->second.num, oldest->second.tensors);
+        completed.erase(oldest);
+    }
+
+    void notify(bool stop = false) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if(stop) stopped = true;
+            notified++;
+        }
+        cond.notify_all();
+    }
+
+    ~TaskTable() {
+        for(auto& item: completed){
+            runner_release_output(item.second.num, item.second.tensors);
+        }
+    }
+};
+
+// the hooks of a library loaded by runner_start_with_plugin, see bmservice_plugin.h
+class RunnerPlugin {
+public:
+    // returns nullptr if the library cannot be loaded or refuses the config
+    static std::shared_ptr<RunnerPlugin> load(const char* so_path, const char* config);
+    ~RunnerPlugin();
+
+    bool hasPre() const { return pre != nullptr; }
+    bool hasPost() const { return post != nullptr; }
+    bool preProcess(const InputType& input, const TensorVec& inTensors, ContextPtr ctx);
+    bool postProcess(const InputType& input, const TensorVec& outTensors, OutputType& postOut,
+                     OutputSelection selected, OutputReducers reducers, bool pooled);
+
+private:
+    RunnerPlugin() = default;
+    void* handle = nullptr;
+    void* state = nullptr;
+    bmservice_plugin_destroy_t destroy = nullptr;
+    bmservice_plugin_pre_t pre = nullptr;
+    bmservice_plugin_post_t post = nullptr;
+};
+using RunnerPluginPtr = std::shared_ptr<RunnerPlugin>;
+
+// cancel marks of the tasks in flight, without any lock or allocation per put
+// a slot holds id<<1|cancelled of the task put into it, or 0 once that task is popped,
+// a task whose slot is still held by an older one goes to a locked map instead, which needs SLOT_NUM tasks in flight
+class CancelTable {
+public:
+    static const size_t SLOT_NUM = 4096;
+
+    CancelTable() {
+        for(auto& slot: slots) slot = 0;
+    }
+    void put(unsigned int id) {
+        uint64_t empty = 0;
+        if(slot(id).compare_exchange_strong(empty, (uint64_t)id<<1)) return;
+        std::lock_guard<std::mutex> lock(mutex);
+        overflow[id] = false;
+        overflowNum++;
+    }
+    void pop(unsigned int id) {
+        auto& s = slot(id);
+        uint64_t value = s.load();
+        while((value>>1) == id){
+            if(s.compare_exchange_weak(value, 0)) return;
+        }
+        if(overflowNum == 0) return;
+        std::lock_guard<std::mutex> lock(mutex);
+        if(overflow.erase(id)) overflowNum--;
+    }
+    // returns false if the task is popped or unknown
+    bool cancel(unsigned int id) {
+        // an empty slot would match it
+        if(id == INVALID_TASK_ID) return false;
+        auto& s = slot(id);
+        uint64_t value = s.load();
+        while((value>>1) == id){
+            if(s.compare_exchange_weak(value, value|1)) return true;
+        }
+        if(overflowNum == 0) return false;
+        std::lock_guard<std::mutex> lock(mutex);
+        auto iter = overflow.find(id);
+        if(iter == overflow.end()) return false;
+        iter->second = true;
+        return true;
+    }
+    // true from the put of the task until it is popped
+    bool pending(unsigned int id) {
+        if(id == INVALID_TASK_ID) return false;
+        if((slot(id).load()>>1) == id) return true;
+        if(overflowNum == 0) return false;
+        std::lock_guard<std::mutex> lock(mutex);
+        return overflow.count(id) != 0;
+    }
+    bool cancelled(unsigned int id) {
+        uint64_t value = slot(id).load(std::memory_order_relaxed);
+        if((value>>1) == id) return value&1;
+        if(overflowNum == 0) return false;
+        std::lock_guard<std::mutex> lock(mutex);
+        auto iter = overflow.find(id);
+        return iter != overflow.end() && iter->second;
+    }
+
+private:
+    std::atomic<uint64_t> slots[SLOT_NUM];
+    std::atomic_size_t overflowNum{0};
+    std::mutex mutex;
+    std::map<unsigned int, bool> overflow;
+    std::atomic<uint64_t>& slot(unsigned int id) { return slots[id%SLOT_NUM]; }
+};
+
 using GeneralRunner = BMDevicePool<InputType, OutputType>;
 struct RunnerInfo {
-    RunnerInfo(const char* bmodel, unsigned int batch = 1):
-        task_id(INVALID_TASK_ID), runner(bmodel, preProcess, postProcess, globalDevices), status(bmodel), batch(batch) {
+    RunnerInfo(unsigned int runner_id, const char* bmodel, unsigned int batch = 1, int warmup_rounds = -1,
+               RunnerPluginPtr plugin = nullptr):
+        runner_id(runner_id), task_id(INVALID_TASK_ID), pooledOutput(false), plugin(plugin),
+        runner(bmodel, [this](const InputType& in, const TensorVec& inTensors, ContextPtr ctx){
+            // warm-up tasks are not made for the plugin
+            if(this->plugin && this->plugin->hasPre() && !in.release_inside){
+                return this->plugin->preProcess(in, inTensors, ctx);
+            }
+            // the post hook is given the inputs too
+            bool keep_inputs = this->plugin && this->plugin->hasPost();
+            return preProcess(in, inTensors, ctx, std::atomic_load(&imageSpec), keep_inputs);
+        }, [this](const InputType& in, const TensorVec& outTensors, OutputType& out, ContextPtr ctx){
+            auto selected = std::atomic_load(&outputSelection);
+            auto reducers = std::atomic_load(&outputReducers);
+            if(this->plugin && this->plugin->hasPost() && !in.release_inside){
+                return this->plugin->postProcess(in, outTensors, out, selected, reducers, pooledOutput);
+            }
+            // a runner_get_output_into call waiting for outputs takes those of this task, warm-up tasks have none
+            OutputDest* dest = !in.release_inside && outputDest.load()? outputDest.exchange(nullptr): nullptr;
+            return postProcess(in, outTensors, out, ctx, selected, reducers, pooledOutput, dest);
+        }, globalDevices),
+        status(bmodel), batch(batch) {
+        runner.setWarmUpFunc(createWarmUpInput);
+        runner.setReleaseOutputFunc(releaseOutput);
+        runner.setExpiredOutputFunc(expiredOutput);
+        runner.setFailedOutputFunc(failedOutput);
+        runner.setCancelledFunc([this](const InputType& in){
+            return cancels.cancelled(in.id);
+        });
+        // inputs are copied by fill_device_mem, which packs them, so they follow the outputs
+        auto native_cstr = getenv(BM_NATIVE_STORE_MODE);
+        runner.setNativeInputStoreMode(native_cstr && atoi(native_cstr) != 0);
+        runner.setOutputNotifier([this]{
+            completion.notify(this->runner_id);
+            tasks.notify();
+        });
+        if(warmup_rounds>=0){
+            runner.setWarmUp(warmup_rounds);
+        }
         runner.start();
         status.start();
     }
+    ~RunnerInfo() {
+        for(auto& spare: spareOutputs) releaseOutput(spare.first);
+    }
     unsigned int nextId() {
-        task_id++;
-        if(task_id == INVALID_TASK_ID) task_id++;
-        return task_id;
+        // several threads may put to the same runner
+        unsigned int id = ++task_id;
+        if(id == INVALID_TASK_ID) id = ++task_id;
+        return id;
     }
 
-    unsigned int task_id;
+    const unsigned int runner_id;
+    std::atomic_uint task_id;
+    // replaced as a whole by runner_select_outputs while the post-processes read it
+    OutputSelection outputSelection;
+    OutputReducers outputReducers;
+    ImageSpec imageSpec;
+    std::atomic_bool pooledOutput;
+    // the buffers of the runner_get_output_into call waiting, the calls run one at a time
+    std::atomic<OutputDest*> outputDest{nullptr};
+    std::mutex intoMutex;
+    // the outputs popped by a runner_get_output_into call while its buffers were being filled by another task
+    std::deque<std::pair<OutputType, unsigned int>> spareOutputs;
+    // destroyed after the runner, whose threads notify it
+    CompletionNotifier completion;
+    TaskTable tasks;
+    // read by the stages of the runner
+    CancelTable cancels;
+    // unloaded after the runner, whose threads call its hooks
+    RunnerPluginPtr plugin;
 
     GeneralRunner runner;
     ProcessStatInfo status;
     unsigned int batch;
 };
 
-std::map<unsigned int, std::shared_ptr<RunnerInfo>> globalRunnerInfos;
+using RunnerInfoPtr = std::shared_ptr<RunnerInfo>;
 
-bool preProcess(const InputType& input, const TensorVec& inTensors, ContextPtr ctx){
-    if(input.num == 0){
-        return false;
+// runner_id = generation*CAPACITY + slot, a stopped id never finds the runner reusing its slot
+// lookups never take the registry mutex, so runners can be used from many threads while others start and stop,
+// the atomic shared_ptr accesses still take a short lock inside libstdc++
+class RunnerRegistry {
+public:
+    static const unsigned int CAPACITY = 256;
+
+    // the slot is reserved before the runner is created, bmodel loading and warmup run without the lock
+    unsigned int start(const char *bmodel, unsigned int batch, int warmup_rounds, RunnerPluginPtr plugin = nullptr) {
+        unsigned int runner_id = INVALID_RUNNER_ID;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for(unsigned int i=0; i<CAPACITY; i++){
+                if(reserved[i]) continue;
+                reserved[i] = true;
+                runner_id = generations[i]*CAPACITY + i;
+                if(++generations[i] == INVALID_RUNNER_ID/CAPACITY) generations[i] = 0;
+                break;
+            }
+        }
+        if(runner_id == INVALID_RUNNER_ID){
+            BMLOG(ERROR, "too many runners, at most %d", CAPACITY);
+            return INVALID_RUNNER_ID;
+        }
+        RunnerInfoPtr info;
+        try {
+            info = std::make_shared<RunnerInfo>(runner_id, bmodel, batch, warmup_rounds, plugin);
+        } catch (std::exception& e) {
+            BMLOG(ERROR, "cannot start runner of %s: %s", bmodel, e.what());
+            std::lock_guard<std::mutex> lock(mutex);
+            reserved[runner_id%CAPACITY] = false;
+            return INVALID_RUNNER_ID;
+        }
+        std::atomic_store(&slots[runner_id%CAPACITY], info);
+        return runner_id;
     }
-    BM_ASSERT_EQ(input.num, inTensors.size());
-    for(size_t i=0; i<input.num; i++){
-        size_t in_mem_size = elem_num(input.tensors[i].shape, input.tensors[i].dims) * dtype_len(input.tensors[i].dtype);
-        BM_ASSERT_EQ(inTensors[i]->get_dtype(), input.tensors[i].dtype);
-        if (!inTensors[i]->fill_device_mem(input.tensors[i].data, in_mem_size))
+
+    RunnerInfoPtr find(unsigned int runner_id) {
+        auto info = std::atomic_load(&slots[runner_id%CAPACITY]);
+        if(!info || info->runner_id != runner_id) return nullptr;
+        return info;
+    }
+
+    // the runner is destroyed after the calls still using it return
+    void stop(unsigned int runner_id) {
+        auto info = find(runner_id);
+        if(!info) return;
+        info->runner.join();
+        // the waiters find the runner stopped
+        info->completion.notify(runner_id);
+        info->tasks.notify(true);
+        if(!std::atomic_compare_exchange_strong(&slots[runner_id%CAPACITY], &info, RunnerInfoPtr())) return;
+        std::lock_guard<std::mutex> lock(mutex);
+        reserved[runner_id%CAPACITY] = false;
+    }
+
+private:
+    RunnerInfoPtr slots[CAPACITY];
+    std::mutex mutex;
+    bool reserved[CAPACITY] = {};
+    unsigned int generations[CAPACITY] = {};
+};
+
+RunnerRegistry globalRunners;
+
+static void fill_inputs(const tensor_data_t* tensors, unsigned int tensor_num, const TensorVec& inTensors){
+    BM_ASSERT_EQ(tensor_num, inTensors.size());
+    // fp32 inputs of fp16/bf16 models are converted here, on the pre-process threads
+    thread_local std::vector<uint16_t> halfData;
+    for(size_t i=0; i<tensor_num; i++){
+        size_t num = elem_num(tensors[i].shape, tensors[i].dims);
+        size_t in_mem_size = num * dtype_len(tensors[i].dtype);
+        const void* data = tensors[i].data;
+        auto dtype = inTensors[i]->get_dtype();
+        if(tensors[i].dtype == BM_FLOAT32 && (dtype == BM_FLOAT16 || dtype == BM_BFLOAT16)){
+            halfData.resize(num);
+            if(dtype == BM_FLOAT16){
+                floatToFp16((const float*)data, halfData.data(), num);
+            } else {
+                floatToBf16((const float*)data, halfData.data(), num);
+            }
+            data = halfData.data();
+            in_mem_size = num * sizeof(uint16_t);
+        } else {
+            BM_ASSERT_EQ(dtype, tensors[i].dtype);
+        }
+        // the shape goes first, 4N/2N inputs are packed by samples of it
+        inTensors[i]->set_shape(tensors[i].shape, tensors[i].dims);
+        if (!inTensors[i]->fill_device_mem(data, in_mem_size))
         {
             BMLOG(FATAL, "fill device memory \"%s\" failed %d vs %d",
                   inTensors[i]->name().c_str(), in_mem_size, inTensors[i]->get_mem_size());
         }
-        inTensors[i]->set_shape(input.tensors[i].shape, input.tensors[i].dims);
     }
-    return true;
 }
 
-bool postProcess(const InputType& input, const TensorVec& outTensors, OutputType& postOut, ContextPtr ctx){
-    postOut.id = input.id;
-    if(input.release_inside){
-        for(size_t i=0; i<input.num; i++){
-            delete [] input.tensors[i].data;
+// the device images between the decoded images and the input tensor, cached by every pre-process thread
+// as the resnet runner does, the threads end with the runner
+struct ImageInputBuffers {
+    BMDeviceContext* ctx = nullptr;
+    int batch = 0;
+    int height = 0;
+    int width = 0;
+    bool nchw = true;
+    bm_image_format_ext format = FORMAT_RGB_PLANAR;
+    bm_image_data_format_ext dtype = DATA_TYPE_EXT_FLOAT32;
+    // resized, in 1N bytes
+    std::vector<bm_image> resized;
+    // converted to the input dtype, only for NHWC inputs, which are then made packed
+    std::vector<bm_image> planar;
+    // attached to the device mem of the input tensor, or to staging if the input is in 4N
+    std::vector<bm_image> converted;
+    // the converted images in 1N, copied to host and packed into the input tensor by fill_device_mem
+    bool packed = false;
+    bm_device_mem_t staging;
+    std::vector<unsigned char> hostStaging;
+
+    void prepare(ContextPtr ctx, int batch, int height, int width, bool nchw,
+                 bm_image_format_ext format, bm_image_data_format_ext dtype, size_t packedBytes){
+        bool packed = packedBytes > 0;
+        if(this->ctx == ctx.get() && this->batch == batch && this->height == height && this->width == width &&
+                this->nchw == nchw && this->format == format && this->dtype == dtype && this->packed == packed){
+            return;
+        }
+        if(this->ctx == ctx.get()){
+            ctx->freeImages(resized);
+            ctx->freeImages(planar);
+            if(this->packed) ctx->freeDeviceMem(staging);
+        }
+        this->ctx = ctx.get();
+        this->batch = batch;
+        this->height = height;
+        this->width = width;
+        this->nchw = nchw;
+        this->format = format;
+        this->dtype = dtype;
+        this->packed = packed;
+        if(packed){
+            staging = ctx->allocDeviceMem(packedBytes);
+            hostStaging.resize(packedBytes);
+        }
+        resized = ctx->allocAlignedImages(batch, height, width, format, DATA_TYPE_EXT_1N_BYTE);
+        if(nchw){
+            planar.clear();
+            converted = ctx->allocImagesWithoutMem(batch, height, width, format, dtype);
+        } else {
+            planar = ctx->allocImages(batch, height, width, format, dtype);
+            auto packed = format == FORMAT_BGR_PLANAR? FORMAT_BGR_PACKED: FORMAT_RGB_PACKED;
+            converted = ctx->allocImagesWithoutMem(batch, height, width, packed, dtype);
+        }
+    }
+};
+
+// decodes the images of the task and preprocesses them by spec into the only input of the network
+static bool fill_image_inputs(const InputType& input, const TensorVec& inTensors, ContextPtr ctx,
+                              const image_spec_t& spec){
+    if(inTensors.size() != 1){
+        BMLOG(ERROR, "encoded images need a network of one input, not %d", inTensors.size());
+        return false;
+    }
+    for(size_t i=0; i<input.num; i++){
+        if(input.tensors[i].dtype != BM_ENCODED_IMAGE){
+            BMLOG(ERROR, "encoded images cannot be mixed with other inputs");
+            return false;
+        }
+    }
+    // the largest stage holds the most images
+    auto net_info = ctx->net->getNetInfo();
+    const bm_shape_t* shape = &net_info->stages[0].input_shapes[0];
+    for(int s=1; s<net_info->stage_num; s++){
+        auto& stage_shape = net_info->stages[s].input_shapes[0];
+        if(bmrt_shape_count(&stage_shape) > bmrt_shape_count(shape)) shape = &stage_shape;
+    }
+    auto& inTensor = inTensors[0];
+    auto dtype = inTensor->get_dtype();
+    bool nchw = spec.layout == IMAGE_LAYOUT_NCHW || (spec.layout == IMAGE_LAYOUT_AUTO && shape->dims[1] == 3);
+    if(shape->num_dims != 4 || shape->dims[nchw? 1: 3] != 3 || (unsigned)shape->dims[0] < input.num ||
+            (dtype != BM_FLOAT32 && dtype != BM_INT8 && dtype != BM_UINT8)){
+        BMLOG(ERROR, "%d images do not fit the input '%s', which must be a float32/int8/uint8 image batch",
+              input.num, inTensor->name().c_str());
+        return false;
+    }
+    int height = shape->dims[nchw? 2: 1];
+    int width = shape->dims[nchw? 3: 2];
+    auto format = spec.bgr? FORMAT_BGR_PLANAR: FORMAT_RGB_PLANAR;
+    auto imageDtype = dtype == BM_FLOAT32? DATA_TYPE_EXT_FLOAT32:
+                      dtype == BM_INT8? DATA_TYPE_EXT_1N_BYTE_SIGNED: DATA_TYPE_EXT_1N_BYTE;
+    // bmcv writes 1N only, 4N inputs are staged
+    size_t packedBytes = inTensor->get_store_mode() == BM_STORE_1N? 0: bmrt_shape_count(shape)*inTensor->get_dtype_len();
+    thread_local static ImageInputBuffers buffers;
+    buffers.prepare(ctx, shape->dims[0], height, width, nchw, format, imageDtype, packedBytes);
+
+    std::vector<bm_image> decoded;
+    bool ok = true;
+    for(size_t i=0; i<input.num && ok; i++){
+        bm_image image;
+        ok = decodeAlignedImage(ctx->handle, input.tensors[i].data, input.tensors[i].shape[0], image);
+        if(ok) decoded.push_back(image);
+    }
+    std::vector<bm_image> resized(buffers.resized.begin(), buffers.resized.begin()+input.num);
+    if(!ok){
+    } else if(spec.resize_mode == IMAGE_RESIZE_ASPECT_PAD){
+        bmcv_color_t color = {spec.pad_color[0], spec.pad_color[1], spec.pad_color[2]};
+        aspectScaleAndPad(ctx->handle, decoded, resized, color);
+    } else if(spec.resize_mode == IMAGE_RESIZE_CENTRAL_CROP){
+        centralCropAndResize(ctx->handle, decoded, resized, spec.crop_factor);
+    } else {
+        for(size_t i=0; i<input.num && ok; i++){
+            ok = bmcv_image_vpp_convert(ctx->handle, 1, decoded[i], &resized[i]) == BM_SUCCESS;
+        }
+    }
+    for(auto& image: decoded){
+        bm_image_destroy(image);
+    }
+    if(!ok) return false;
+
+    // (pixel - mean) * scale, quantized by the input scale for int8 networks
+    float inputScale = inTensor->get_scale();
+    bmcv_convert_to_attr attr;
+    attr.alpha_0 = spec.scale[0] * inputScale;
+    attr.beta_0 = -spec.mean[0] * spec.scale[0] * inputScale;
+    attr.alpha_1 = spec.scale[1] * inputScale;
+    attr.beta_1 = -spec.mean[1] * spec.scale[1] * inputScale;
+    attr.alpha_2 = spec.scale[2] * inputScale;
+    attr.beta_2 = -spec.mean[2] * spec.scale[2] * inputScale;
+    unsigned int dims[4];
+    std::copy(shape->dims, shape->dims+4, dims);
+    inTensor->set_shape(dims, 4);
+    inTensor->set_batch(input.num);
+    auto mem = buffers.packed? buffers.staging: *inTensor->get_device_mem();
+    bm_image_attach_contiguous_mem(input.num, buffers.converted.data(), mem);
+    if(nchw){
+        ok = bmcv_image_convert_to(ctx->handle, input.num, attr, resized.data(), buffers.converted.data()) == BM_SUCCESS;
+    } else {
+        ok = bmcv_image_convert_to(ctx->handle, input.num, attr, resized.data(), buffers.planar.data()) == BM_SUCCESS &&
+             bmcv_image_storage_convert(ctx->handle, input.num, buffers.planar.data(), buffers.converted.data()) == BM_SUCCESS;
+    }
+    bm_image_dettach_contiguous_mem(input.num, buffers.converted.data());
+    if(ok && buffers.packed){
+        auto bytes = inTensor->get_host_mem_size();
+        ok = bm_memcpy_d2s_partial(ctx->handle, buffers.hostStaging.data(), buffers.staging, bytes) == BM_SUCCESS &&
+             inTensor->fill_device_mem(buffers.hostStaging.data(), bytes);
+    }
+    return ok;
+}
+
+bool preProcess(const InputType& input, const TensorVec& inTensors, ContextPtr ctx, ImageSpec image, bool keep_inputs){
+    if(input.num == 0){
+        return false;
+    }
+    bool ok = true;
+    if(input.tensors[0].dtype == BM_ENCODED_IMAGE){
+        if(!image) BMLOG(ERROR, "encoded images are put before runner_set_image_input");
+        ok = image && fill_image_inputs(input, inTensors, ctx, *image);
+    } else {
+        fill_inputs(input.tensors, input.num, inTensors);
+    }
+    // reusable by the next tasks while this one is still in forward
+    if(input.block && !keep_inputs) input.block->release();
+    return ok;
+}
+
+// the result of an output reducer, computed before the block of the outputs is acquired
+struct ReducedOutput {
+    bool used = false;
+    unsigned int dtype = BM_FLOAT32;
+    std::vector<unsigned int> shape;
+    std::vector<float> values;
+    std::vector<int32_t> indices;
+};
+
+static size_t reduced_rows(const TensorPtr& tensor, size_t& last_dim){
+    last_dim = tensor->shape(tensor->dims()-1);
+    return last_dim? tensor->get_elem_num()/last_dim: 0;
+}
+
+static void reduce_output(const output_reducer_t& reducer, const TensorPtr& tensor, ReducedOutput& out){
+    thread_local std::vector<float> data;
+    auto num = tensor->get_elem_num();
+    data.resize(num);
+    tensor->get_float_data(data.data(), 0, num);
+    size_t last_dim = 0;
+    size_t rows = reduced_rows(tensor, last_dim);
+    // the leading dims are kept, the last one is reduced
+    out.shape.clear();
+    for(size_t d=0; d+1<tensor->dims(); d++){
+        out.shape.push_back(tensor->shape(d));
+    }
+    out.values.clear();
+    out.indices.clear();
+    out.dtype = BM_FLOAT32;
+    if(reducer.kind == OUTPUT_REDUCER_TOPK){
+        size_t k = reducer.params[0]>0? std::min((size_t)reducer.params[0], last_dim): last_dim;
+        for(size_t r=0; r<rows; r++){
+            for(auto& item: topk(data.data() + r*last_dim, last_dim, k)){
+                out.values.push_back(item.first);
+                out.values.push_back(item.second);
+            }
+        }
+        out.shape.push_back(k);
+        out.shape.push_back(2);
+    } else if(reducer.kind == OUTPUT_REDUCER_ARGMAX){
+        out.dtype = BM_INT32;
+        for(size_t r=0; r<rows; r++){
+            out.indices.push_back(argmax(data.data() + r*last_dim, last_dim));
+        }
+    } else if(reducer.kind == OUTPUT_REDUCER_THRESHOLD){
+        for(size_t r=0; r<rows; r++){
+            for(size_t i=0; i<last_dim; i++){
+                float value = data[r*last_dim + i];
+                if(value < reducer.params[0]) continue;
+                out.values.insert(out.values.end(), {(float)r, (float)i, value});
+            }
         }
-        delete []input.tensors;
+        out.shape = {(unsigned int)out.values.size()/3, 3};
+    } else if(reducer.kind == OUTPUT_REDUCER_DETECT){
+        // boxes of yolo outputs, (cx, cy, w, h, objectness, class scores...)
+        size_t batch = tensor->shape(0);
+        size_t box_num = batch? rows/batch: 0;
+        std::vector<std::vector<DetectBox>> batch_boxes(batch);
+        for(size_t b=0; b<batch && last_dim>5; b++){
+            for(size_t n=0; n<box_num; n++){
+                auto box_data = data.data() + (b*box_num + n)*last_dim;
+                auto category = argmax(box_data + 5, last_dim - 5);
+                DetectBox box;
+                box.confidence = box_data[4] * box_data[5 + category];
+                if(box.confidence <= reducer.params[0]) continue;
+                box.imageId = b;
+                box.category = category;
+                box.xmin = box_data[0] - box_data[2]*.5;
+                box.xmax = box_data[0] + box_data[2]*.5;
+                box.ymin = box_data[1] - box_data[3]*.5;
+                box.ymax = box_data[1] + box_data[3]*.5;
+                batch_boxes[b].push_back(box);
+            }
+        }
+        auto results = batchNMS(batch_boxes, reducer.params[1], reducer.params[2]>0? (size_t)reducer.params[2]: 0);
+        for(auto& boxes: results){
+            for(auto& box: boxes){
+                out.values.insert(out.values.end(), {(float)box.imageId, (float)box.category, box.confidence,
+                                                     box.xmin, box.ymin, box.xmax, box.ymax});
+            }
+        }
+        out.shape = {(unsigned int)out.values.size()/7, 7};
     }
+    out.used = true;
+}
 
-    size_t outNum = outTensors.size();
-    postOut.num = outNum;
-    postOut.tensors = new tensor_data_t[outNum];
-    for(size_t i=0; i<outNum; i++){
-        postOut.tensors[i].dims = outTensors[i]->dims();
-        for(size_t d=0; d<postOut.tensors[i].dims; d++){
-            postOut.tensors[i].shape[d] = outTensors[i]->shape(d);
+// the selected outputs of a task on the way to host, reducers run first so the bytes are known before copying
+// the outputs not selected are never copied back from device
+struct HostOutputs {
+    std::vector<TensorPtr> tensors;
+    std::vector<size_t> bytes;
+    std::vector<ReducedOutput> reduced;
+
+    void prepare(const TensorVec& outTensors, OutputSelection selected, OutputReducers reducers) {
+        size_t num = selected? selected->size(): outTensors.size();
+        tensors.resize(num);
+        bytes.resize(num);
+        reduced.resize(num);
+        for(size_t k=0; k<num; k++){
+            auto index = selected? (*selected)[k]: k;
+            tensors[k] = outTensors[index];
+            reduced[k].used = false;
+            if(reducers && index < reducers->size() && (*reducers)[index].kind != OUTPUT_REDUCER_NONE){
+                reduce_output((*reducers)[index], tensors[k], reduced[k]);
+                bytes[k] = reduced[k].values.size()*sizeof(float) + reduced[k].indices.size()*sizeof(int32_t);
+                continue;
+            }
+            auto dtype = tensors[k]->get_dtype();
+            // fp16/bf16 are returned as fp32, so those models are a drop-in replacement
+            bytes[k] = dtype == BM_FLOAT16 || dtype == BM_BFLOAT16?
+                        tensors[k]->get_elem_num()*sizeof(float): tensors[k]->get_host_mem_size();
         }
-        postOut.tensors[i].dtype = outTensors[i]->get_dtype();
-        auto mem_size = outTensors[i]->get_mem_size();
-        postOut.tensors[i].data = new unsigned char[mem_size];
-        auto fill_size = outTensors[i]->fill_host_mem(postOut.tensors[i].data, mem_size);
-        BM_ASSERT_EQ(fill_size, mem_size);
     }
+
+    // outputs[k].data holds bytes[k], only dims, shape and dtype are set without data
+    void fill(tensor_data_t* outputs, bool with_data) const {
+        for(size_t k=0; k<tensors.size(); k++){
+            auto& outTensor = tensors[k];
+            auto& out = outputs[k];
+            if(reduced[k].used){
+                auto& result = reduced[k];
+                out.dims = result.shape.size();
+                std::copy(result.shape.begin(), result.shape.end(), out.shape);
+                out.dtype = result.dtype;
+                if(!with_data) continue;
+                if(result.dtype == BM_INT32){
+                    memcpy(out.data, result.indices.data(), result.indices.size()*sizeof(int32_t));
+                } else {
+                    memcpy(out.data, result.values.data(), result.values.size()*sizeof(float));
+                }
+                continue;
+            }
+            out.dims = outTensor->dims();
+            for(size_t d=0; d<out.dims; d++){
+                out.shape[d] = outTensor->shape(d);
+            }
+            auto dtype = outTensor->get_dtype();
+            if(dtype == BM_FLOAT16 || dtype == BM_BFLOAT16){
+                out.dtype = BM_FLOAT32;
+                if(!with_data) continue;
+                auto num = outTensor->get_elem_num();
+                auto fill_num = outTensor->get_float_data((float*)out.data, 0, num);
+                BM_ASSERT_EQ(fill_num, num);
+                continue;
+            }
+            out.dtype = dtype;
+            if(!with_data) continue;
+            // the batch of the task only, not the static batch of the network
+            auto mem_size = outTensor->get_host_mem_size();
+            auto fill_size = outTensor->fill_host_mem(out.data, mem_size);
+            BM_ASSERT_EQ(fill_size, mem_size);
+        }
+    }
+};
+
+// every task of the C API is a forward of its own, so the block is the host buffer of the whole batch,
+// views into a buffer shared by several tasks would save nothing, pooled blocks are recycled instead
+static tensor_data_t* copy_outputs(const TensorVec& outTensors, OutputSelection selected, OutputReducers reducers,
+                                   bool pooled, unsigned& outNum){
+    thread_local HostOutputs host;
+    host.prepare(outTensors, selected, reducers);
+    outNum = host.tensors.size();
+    auto outputs = acquire_tensors(host.bytes, pooled);
+    host.fill(outputs, true);
+    return outputs;
+}
+
+// copies the outputs straight into the buffers of a runner_get_output_into call
+static int copy_outputs_into(const TensorVec& outTensors, OutputSelection selected, OutputReducers reducers,
+                             OutputDest& dest){
+    thread_local HostOutputs host;
+    host.prepare(outTensors, selected, reducers);
+    if(host.tensors.size() > dest.num) return -2;
+    bool fit = true;
+    for(size_t k=0; k<host.tensors.size(); k++){
+        fit &= host.bytes[k] <= dest.capacities[k];
+    }
+    // the shapes tell the bytes needed even if the data does not fit
+    host.fill(dest.outputs, fit);
+    return fit? host.tensors.size(): -3;
+}
+
+bool postProcess(const InputType& input, const TensorVec& outTensors, OutputType& postOut, ContextPtr ctx,
+                 OutputSelection selected, OutputReducers reducers, bool pooled, OutputDest* dest){
+    postOut.id = input.id;
+    // the out of the stage is reused by the next tasks
+    postOut.dest = dest;
+    releaseInput(input);
+    if(dest){
+        postOut.tensors = nullptr;
+        postOut.num = 0;
+        dest->result = copy_outputs_into(outTensors, selected, reducers, *dest);
+        return true;
+    }
+    postOut.tensors = copy_outputs(outTensors, selected, reducers, pooled, postOut.num);
     return true;
 }
 
-unsigned int runner_start_with_batch(const char *bmodel, unsigned int batch) {
+RunnerPluginPtr RunnerPlugin::load(const char* so_path, const char* config){
+    auto handle = dlopen(so_path, RTLD_NOW | RTLD_LOCAL);
+    if(!handle){
+        BMLOG(ERROR, "cannot load plugin: %s", dlerror());
+        return nullptr;
+    }
+    RunnerPluginPtr plugin(new RunnerPlugin);
+    plugin->handle = handle;
+    plugin->pre = (bmservice_plugin_pre_t)dlsym(handle, BMSERVICE_PLUGIN_PRE);
+    plugin->post = (bmservice_plugin_post_t)dlsym(handle, BMSERVICE_PLUGIN_POST);
+    if(!plugin->pre && !plugin->post){
+        BMLOG(ERROR, "plugin %s has neither %s nor %s", so_path, BMSERVICE_PLUGIN_PRE, BMSERVICE_PLUGIN_POST);
+        return nullptr;
+    }
+    auto create = (bmservice_plugin_create_t)dlsym(handle, BMSERVICE_PLUGIN_CREATE);
+    if(create){
+        plugin->state = create(config? config: "");
+        if(!plugin->state){
+            BMLOG(ERROR, "plugin %s refuses config \"%s\"", so_path, config? config: "");
+            return nullptr;
+        }
+    }
+    plugin->destroy = (bmservice_plugin_destroy_t)dlsym(handle, BMSERVICE_PLUGIN_DESTROY);
+    if(plugin->state && !plugin->destroy){
+        BMLOG(WARNING, "plugin %s has no %s, its state is never destroyed", so_path, BMSERVICE_PLUGIN_DESTROY);
+    }
+    BMLOG(INFO, "plugin %s is loaded, pre hook: %d, post hook: %d", so_path, plugin->hasPre(), plugin->hasPost());
+    return plugin;
+}
+
+RunnerPlugin::~RunnerPlugin(){
+    if(destroy) destroy(state);
+    dlclose(handle);
+}
+
+bool RunnerPlugin::preProcess(const InputType& input, const TensorVec& inTensors, ContextPtr ctx){
+    auto net_info = ctx->net->getNetInfo();
+    auto net_inputs = acquire_net_inputs(net_info, true);
+    // the inputs are kept for the post hook, a pooled input block is given back there
+    bool ok = pre(state, input.tensors, input.num, net_inputs, net_info->input_num) == 0;
+    if(ok) fill_inputs(net_inputs, net_info->input_num, inTensors);
+    HostBlockPool::instance().release(net_inputs);
+    return ok;
+}
+
+static tensor_data_t* alloc_outputs(const size_t* bytes, unsigned int num){
+    return acquire_tensors(std::vector<size_t>(bytes, bytes+num), false);
+}
+
+static tensor_data_t* alloc_pooled_outputs(const size_t* bytes, unsigned int num){
+    return acquire_tensors(std::vector<size_t>(bytes, bytes+num), true);
+}
+
+bool RunnerPlugin::postProcess(const InputType& input, const TensorVec& outTensors, OutputType& postOut,
+                               OutputSelection selected, OutputReducers reducers, bool pooled){
+    postOut.id = input.id;
+    postOut.dest = nullptr;
+    unsigned int net_output_num = 0;
+    // only read by the hook, so always recycled
+    auto net_outputs = copy_outputs(outTensors, selected, reducers, true, net_output_num);
+    postOut.tensors = nullptr;
+    postOut.num = 0;
+    int ret = post(state, input.tensors, input.num, net_outputs, net_output_num,
+                   pooled? alloc_pooled_outputs: alloc_outputs, &postOut.tensors, &postOut.num);
+    runner_release_output(net_output_num, net_outputs);
+    releaseInput(input);
+    return ret == 0;
+}
+
+InputType createWarmUpInput(const bm_net_info_t* netInfo){
+    InputType input;
+    input.release_inside = true;
+    input.num = netInfo->input_num;
+    input.tensors = new tensor_data_t[input.num];
+    for(size_t i=0; i<input.num; i++){
+        auto& shape = netInfo->stages[0].input_shapes[i];
+        auto& tensor = input.tensors[i];
+        tensor.dims = shape.num_dims;
+        for(size_t d=0; d<tensor.dims; d++){
+            tensor.shape[d] = shape.dims[d];
+        }
+        tensor.dtype = netInfo->input_dtypes[i];
+        auto mem_size = elem_num(tensor.shape, tensor.dims) * dtype_len(tensor.dtype);
+        tensor.data = new unsigned char[mem_size]();
+    }
+    return input;
+}
+
+void releaseOutput(OutputType& output){
+    if(output.dest) output.dest->dropped = true;
+    runner_release_output(output.num, output.tensors);
+}
+
+static void releaseInput(const InputType& input){
+    if(input.block) input.block->release();
+    if(!input.release_inside) return;
+    for(size_t i=0; i<input.num; i++){
+        delete [] input.tensors[i].data;
+    }
+    delete [] input.tensors;
+}
+
+void expiredOutput(const InputType& input, OutputType& output){
+    // the id is kept, so the waiters of the task get it as an invalid one
+    output.id = input.id;
+    releaseInput(input);
+}
+
+void failedOutput(const InputType& input, OutputType& output){
+    // the stalled stage still holds the input, and releases it if it ever returns
+    output.id = input.id;
+}
+
+unsigned int runner_start_with_warmup(const char *bmodel, unsigned int batch, int warmup_rounds) {
     set_env_log_level();
-    unsigned int runner_id = 0;
-    while(globalRunnerInfos.count(runner_id)) runner_id++;
-    globalRunnerInfos[runner_id] = std::make_shared<RunnerInfo>(bmodel, batch);
-    return runner_id;
+    return globalRunners.start(bmodel, batch, warmup_rounds);
+}
+
+unsigned int runner_start_with_plugin(const char *bmodel, unsigned int batch, int warmup_rounds,
+                                      const char *so_path, const char *config) {
+    set_env_log_level();
+    auto plugin = RunnerPlugin::load(so_path, config);
+    if(!plugin) return INVALID_RUNNER_ID;
+    return globalRunners.start(bmodel, batch, warmup_rounds, plugin);
+}
+
+unsigned int runner_start_with_batch(const char *bmodel, unsigned int batch) {
+    return runner_start_with_warmup(bmodel, batch, -1);
 }
 
 unsigned int runner_start(const char *bmodel) {
@@ -125,69 +1080,193 @@ unsigned int runner_start(const char *bmodel) {
 }
 
 void runner_stop(unsigned int runner_id) {
-    if(!globalRunnerInfos.count(runner_id)) return;
-    globalRunnerInfos[runner_id]->runner.join();
-    globalRunnerInfos.erase(runner_id);
+    globalRunners.stop(runner_id);
+}
+
+void runner_set_watchdog(unsigned int runner_id, unsigned int timeout_ms, int action)
+{
+    auto info = globalRunners.find(runner_id);
+    if(!info) return;
+    info->runner.setWatchdog(timeout_ms, (WatchdogAction)action);
+}
+
+int runner_select_outputs(unsigned int runner_id, const unsigned *indices, unsigned int num)
+{
+    auto info = globalRunners.find(runner_id);
+    if(!info) return -1;
+    if(num == 0){
+        std::atomic_store(&info->outputSelection, OutputSelection());
+        return 0;
+    }
+    auto output_num = info->runner.getNetInfo()->output_num;
+    for(unsigned i=0; i<num; i++){
+        if(indices[i] >= (unsigned)output_num){
+            BMLOG(ERROR, "invalid output index %d, the network has %d outputs", indices[i], output_num);
+            return -1;
+        }
+    }
+    OutputSelection selection = std::make_shared<std::vector<unsigned>>(indices, indices+num);
+    std::atomic_store(&info->outputSelection, selection);
+    return 0;
 }
 
 void runner_show_status(unsigned int runner_id)
 {
-    if(!globalRunnerInfos.count(runner_id)) return;
-    globalRunnerInfos[runner_id]->status.show();
+    auto info = globalRunners.find(runner_id);
+    if(!info) return;
+    info->status.show();
 }
 
-unsigned int runner_put_input(unsigned runner_id, unsigned int input_num, const tensor_data_t *input_tensors, int need_copy)
+static unsigned int push_input(RunnerInfo* info, unsigned int input_num, const tensor_data_t *input_tensors, int need_copy,
+                               unsigned int timeout_ms = 0, bool acquired = false)
 {
-    if(!globalRunnerInfos.count(runner_id)) return -1;
     InputType input;
-    input.id = globalRunnerInfos[runner_id]->nextId();
-    input.release_inside = need_copy;
+    input.id = info->nextId();
+    // cancels go through the table, a control is only needed for a deadline
+    TaskControl::Ptr control;
+    if(timeout_ms > 0){
+        control = std::make_shared<TaskControl>();
+        control->deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    }
+    info->cancels.put(input.id);
     input.num = input_num;
     if(input_num != 0){
         if(need_copy){
-            input.tensors = new tensor_data_t[input_num];
-            memcpy(input.tensors, input_tensors, sizeof(tensor_data_t)*input_num);
-            for(size_t i = 0; i<input.num; i++){
-                auto mem_size = dtype_len(input_tensors[i].dtype) * elem_num(input_tensors[i].shape, input_tensors[i].dims);
-                input.tensors[i].data = new unsigned char[mem_size];
-                memcpy(input.tensors[i].data, input_tensors[i].data, mem_size);
+            // a pooled block, given back after the copy to device instead of after the post-process
+            std::vector<size_t> bytes(input_num);
+            for(size_t i = 0; i<input_num; i++){
+                bytes[i] = dtype_len(input_tensors[i].dtype) * elem_num(input_tensors[i].shape, input_tensors[i].dims);
+            }
+            input.tensors = acquire_tensors(bytes, true);
+            input.block = std::make_shared<InputBlock>(input.tensors);
+            for(size_t i = 0; i<input_num; i++){
+                auto data = input.tensors[i].data;
+                input.tensors[i] = input_tensors[i];
+                input.tensors[i].data = data;
+                memcpy(data, input_tensors[i].data, bytes[i]);
             }
         } else {
             input.tensors = (tensor_data_t*)input_tensors;
+            if(acquired) input.block = std::make_shared<InputBlock>(input.tensors);
         }
     } else {
         input.tensors = nullptr;
     }
-    globalRunnerInfos[runner_id]->runner.push(input);
+    info->runner.push(input, control);
     return input.id;
 }
 
+unsigned int runner_put_input(unsigned runner_id, unsigned int input_num, const tensor_data_t *input_tensors, int need_copy)
+{
+    auto info = globalRunners.find(runner_id);
+    if(!info) return -1;
+    return push_input(info.get(), input_num, input_tensors, need_copy);
+}
+
+unsigned int runner_put_input_with_timeout(unsigned runner_id, unsigned int input_num, const tensor_data_t *input_tensors,
+                                           int need_copy, unsigned int timeout_ms)
+{
+    auto info = globalRunners.find(runner_id);
+    if(!info) return -1;
+    return push_input(info.get(), input_num, input_tensors, need_copy, timeout_ms);
+}
+
+tensor_data_t *runner_acquire_input(unsigned runner_id, unsigned int *input_num)
+{
+    *input_num = 0;
+    auto info = globalRunners.find(runner_id);
+    if(!info) return nullptr;
+    auto net_info = info->runner.getNetInfo();
+    *input_num = net_info->input_num;
+    return acquire_net_inputs(net_info, false);
+}
+
+unsigned int runner_submit_acquired(unsigned runner_id, unsigned int input_num, tensor_data_t *input_tensors)
+{
+    auto info = globalRunners.find(runner_id);
+    if(!info){
+        if(input_tensors) HostBlockPool::instance().release(input_tensors);
+        return -1;
+    }
+    return push_input(info.get(), input_num, input_tensors, false, 0, true);
+}
+
+int runner_cancel(unsigned runner_id, unsigned int task_id)
+{
+    auto info = globalRunners.find(runner_id);
+    if(!info) return -1;
+    return info->cancels.cancel(task_id)? 0: -1;
+}
+
+unsigned int runner_put_inputs(unsigned runner_id, unsigned int num_tasks, const unsigned int *input_nums,
+                               const tensor_data_t *input_tensors, int need_copy, unsigned int *task_ids)
+{
+    // one lookup for all the tasks
+    auto info = globalRunners.find(runner_id);
+    if(!info) return 0;
+    for(unsigned int t=0; t<num_tasks; t++){
+        task_ids[t] = push_input(info.get(), input_nums[t], input_tensors, need_copy);
+        input_tensors += input_nums[t];
+    }
+    return num_tasks;
+}
+
 
 int runner_all_stopped(size_t runner_id){
-    if(!globalRunnerInfos.count(runner_id)) return true;
-    return globalRunnerInfos[runner_id]->runner.allStopped();
+    auto info = globalRunners.find(runner_id);
+    if(!info) return true;
+    return info->runner.allStopped();
 }
 
-static tensor_data_t *__runner_get_output(unsigned runner_id, unsigned int *task_id, unsigned int *output_num, unsigned int *is_valid, bool is_async){
-    if(!globalRunnerInfos.count(runner_id)) return nullptr;
-    auto& info = globalRunnerInfos[runner_id];
-    OutputType output;
-    std::shared_ptr<ProcessStatus> status;
+static bool pop_task(RunnerInfo* info, OutputType& output, unsigned int *is_valid, bool is_async, bool by_table = false){
+    ProcessStatus status;
     bool ok;
     if (is_async)
         ok = info->runner.pop(output, status);
     else
         ok = info->runner.waitAndPop(output, status);
 
-    if(!ok) return nullptr;
+    if(!ok) return false;
+    info->cancels.pop(output.id);
+    if(!by_table && info->tasks.waiters > 0) info->tasks.notify();
 
+    *is_valid = status.valid;
+    info->status.update(status, info->batch);
+    return true;
+}
+
+static tensor_data_t *pop_output(RunnerInfo* info, unsigned int *task_id, unsigned int *output_num, unsigned int *is_valid, bool is_async,
+                                 bool by_table = false){
+    OutputType output;
+    if(!pop_task(info, output, is_valid, is_async, by_table)) return nullptr;
     *task_id = output.id;
     *output_num = output.num;
-    *is_valid = status->valid;
-    info->status.update(status, info->batch);
     return output.tensors;
 }
 
+static tensor_data_t *__runner_get_output(unsigned runner_id, unsigned int *task_id, unsigned int *output_num, unsigned int *is_valid, bool is_async){
+    auto info = globalRunners.find(runner_id);
+    if(!info) return nullptr;
+    return pop_output(info.get(), task_id, output_num, is_valid, is_async);
+}
+
+unsigned int runner_get_outputs(unsigned runner_id, unsigned int max_tasks, int wait, unsigned int *task_ids,
+                                unsigned int *output_nums, unsigned int *is_valids, tensor_data_t **outputs)
+{
+    auto info = globalRunners.find(runner_id);
+    if(!info) return 0;
+    unsigned int num = 0;
+    while(num < max_tasks){
+        // only waits for the first one, then takes what is finished
+        // the outputs of invalid tasks may be null, so a popped task is told by its id
+        task_ids[num] = INVALID_TASK_ID;
+        outputs[num] = pop_output(info.get(), &task_ids[num], &output_nums[num], &is_valids[num], num>0 || !wait);
+        if(task_ids[num] == INVALID_TASK_ID) break;
+        num++;
+    }
+    return num;
+}
+
 tensor_data_t *runner_try_to_get_output(unsigned runner_id, unsigned int *task_id, unsigned int *output_num, unsigned int *is_valid)
 {
     return __runner_get_output(runner_id, task_id, output_num, is_valid, true);
@@ -200,25 +1279,327 @@ tensor_data_t *runner_get_output(unsigned runner_id, unsigned int *task_id, unsi
 }
 
 void runner_release_output(unsigned int output_num, const tensor_data_t *output_data){
-    for(size_t i=0; i<output_num; i++){
-        delete [] output_data[i].data;
+    // the data of the outputs lives in the same block as output_data
+    if(output_data) HostBlockPool::instance().release(output_data);
+}
+
+static int wait_task(RunnerInfo* info, unsigned int task_id, int timeout_ms,
+                     tensor_data_t **outputs, unsigned int *output_num, unsigned int *is_valid)
+{
+    auto& table = info->tasks;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms>0? timeout_ms: 0);
+    std::vector<std::pair<unsigned int, TaskTable::Completed>> popped;
+    std::unique_lock<std::mutex> lock(table.mutex);
+    while(true){
+        auto seen = table.notified;
+        table.popping++;
+        lock.unlock();
+        // files every finished task, whoever waits for it, popped outside the lock so waiters do not serialize
+        while(true){
+            TaskTable::Completed done;
+            unsigned int done_id = INVALID_TASK_ID;
+            done.tensors = pop_output(info, &done_id, &done.num, &done.valid, true, true);
+            if(done_id == INVALID_TASK_ID) break;
+            popped.emplace_back(done_id, done);
+        }
+        lock.lock();
+        table.popping--;
+        for(auto& item: popped){
+            table.add(item.first, item.second);
+        }
+        // the tasks of the other waiters may be among them
+        if(!popped.empty()){
+            table.notified++;
+            table.cond.notify_all();
+        }
+        popped.clear();
+        auto iter = table.completed.find(task_id);
+        if(iter != table.completed.end()){
+            *outputs = iter->second.tensors;
+            *output_num = iter->second.num;
+            *is_valid = iter->second.valid;
+            table.completed.erase(iter);
+            return 0;
+        }
+        if(table.stopped) return -1;
+        // counted before the check, so a pop by runner_get_output* right after it wakes this one up
+        table.waiters++;
+        // never put, popped by runner_get_output* or dropped, waiting would never end
+        bool lost = table.popping == 0 && !info->cancels.pending(task_id);
+        if(lost || timeout_ms == 0){
+            table.waiters--;
+            return lost? -1: 1;
+        }
+        auto woken = [&]{ return table.notified != seen; };
+        if(timeout_ms < 0){
+            table.cond.wait(lock, woken);
+        } else if(!table.cond.wait_until(lock, deadline, woken)){
+            timeout_ms = 0;
+        }
+        table.waiters--;
+    }
+}
+
+int runner_wait_task(unsigned runner_id, unsigned int task_id, int timeout_ms,
+                     tensor_data_t **outputs, unsigned int *output_num, unsigned int *is_valid)
+{
+    auto info = globalRunners.find(runner_id);
+    if(!info) return -1;
+    return wait_task(info.get(), task_id, timeout_ms, outputs, output_num, is_valid);
+}
+
+int runner_infer_all(unsigned runner_id, unsigned int num_tasks, const unsigned int *input_nums,
+                     const tensor_data_t *input_tensors, tensor_data_t **outputs,
+                     unsigned int *output_nums, unsigned int *is_valids)
+{
+    auto info = globalRunners.find(runner_id);
+    if(!info) return -1;
+    std::vector<unsigned int> task_ids(num_tasks);
+    int valid_num = 0;
+    unsigned int waited = 0;
+    auto wait_oldest = [&]{
+        auto t = waited++;
+        // the tasks finished out of order are kept in the table until their turn, a task not put is not waited for
+        if(task_ids[t] == INVALID_TASK_ID || wait_task(info.get(), task_ids[t], -1, &outputs[t], &output_nums[t], &is_valids[t]) != 0){
+            outputs[t] = nullptr;
+            output_nums[t] = 0;
+            is_valids[t] = 0;
+        }
+        valid_num += is_valids[t] != 0;
+    };
+    auto tensors = input_tensors;
+    for(unsigned int t=0; t<num_tasks; t++){
+        // a put spins while the input queue is full, so the oldest task is collected until there is room
+        while(waited < t && !info->runner.canPush()) wait_oldest();
+        task_ids[t] = push_input(info.get(), input_nums[t], tensors, false);
+        tensors += input_nums[t];
+    }
+    while(waited < num_tasks) wait_oldest();
+    return valid_num;
+}
+
+int runner_poll_task(unsigned runner_id, unsigned int task_id,
+                     tensor_data_t **outputs, unsigned int *output_num, unsigned int *is_valid)
+{
+    auto info = globalRunners.find(runner_id);
+    if(!info) return -1;
+    return wait_task(info.get(), task_id, 0, outputs, output_num, is_valid);
+}
+
+int runner_completion_fd(unsigned int runner_id)
+{
+    auto info = globalRunners.find(runner_id);
+    if(!info) return -1;
+    return info->completion.getFd();
+}
+
+int runner_set_completion_callback(unsigned int runner_id, runner_completion_callback_t callback, void *user_data)
+{
+    auto info = globalRunners.find(runner_id);
+    if(!info) return -1;
+    info->completion.setCallback(callback, user_data);
+    return 0;
+}
+
+void runner_use_output_pool(unsigned int runner_id, int enable)
+{
+    auto info = globalRunners.find(runner_id);
+    if(!info) return;
+    info->pooledOutput = enable != 0;
+}
+
+int runner_set_image_input(unsigned int runner_id, const image_spec_t *spec)
+{
+    auto info = globalRunners.find(runner_id);
+    if(!info) return -1;
+    if(!spec){
+        std::atomic_store(&info->imageSpec, ImageSpec());
+        return 0;
+    }
+    if(spec->resize_mode > IMAGE_RESIZE_CENTRAL_CROP || spec->layout > IMAGE_LAYOUT_NHWC ||
+            (spec->resize_mode == IMAGE_RESIZE_CENTRAL_CROP && !(spec->crop_factor > 0 && spec->crop_factor <= 1))){
+        BMLOG(ERROR, "invalid image spec, resize_mode=%d, layout=%d, crop_factor=%f",
+              spec->resize_mode, spec->layout, spec->crop_factor);
+        return -1;
+    }
+    std::atomic_store(&info->imageSpec, ImageSpec(std::make_shared<image_spec_t>(*spec)));
+    return 0;
+}
+
+int runner_set_output_reducers(unsigned int runner_id, const output_reducer_t *reducers, unsigned int num)
+{
+    auto info = globalRunners.find(runner_id);
+    if(!info) return -1;
+    if(num == 0){
+        std::atomic_store(&info->outputReducers, OutputReducers());
+        return 0;
+    }
+    auto output_num = info->runner.getNetInfo()->output_num;
+    if(num > (unsigned)output_num){
+        BMLOG(ERROR, "%d output reducers, the network has %d outputs", num, output_num);
+        return -1;
+    }
+    for(unsigned i=0; i<num; i++){
+        if(reducers[i].kind > OUTPUT_REDUCER_DETECT){
+            BMLOG(ERROR, "invalid output reducer %d of output %d", reducers[i].kind, i);
+            return -1;
+        }
+    }
+    OutputReducers all = std::make_shared<std::vector<output_reducer_t>>(reducers, reducers+num);
+    std::atomic_store(&info->outputReducers, all);
+    return 0;
+}
+
+// the largest result of the reducer on an output of shape, enough for any task
+static size_t max_reduced_bytes(const output_reducer_t& reducer, const bm_shape_t& shape){
+    size_t count = bmrt_shape_count(&shape);
+    size_t last_dim = shape.num_dims>0? shape.dims[shape.num_dims-1]: 0;
+    size_t rows = last_dim? count/last_dim: 0;
+    if(reducer.kind == OUTPUT_REDUCER_TOPK){
+        size_t k = reducer.params[0]>0? std::min((size_t)reducer.params[0], last_dim): last_dim;
+        return rows*k*2*sizeof(float);
+    } else if(reducer.kind == OUTPUT_REDUCER_ARGMAX){
+        return rows*sizeof(int32_t);
+    } else if(reducer.kind == OUTPUT_REDUCER_THRESHOLD){
+        return count*3*sizeof(float);
+    }
+    return rows*7*sizeof(float);
+}
+
+static std::vector<unsigned> selected_outputs(RunnerInfo& info) {
+    auto selection = std::atomic_load(&info.outputSelection);
+    if(selection) return *selection;
+    std::vector<unsigned> indices(info.runner.getNetInfo()->output_num);
+    for(size_t i=0; i<indices.size(); i++) indices[i] = i;
+    return indices;
+}
+
+unsigned *get_output_sizes(unsigned runner_id, unsigned *num)
+{
+    *num = 0;
+    auto info_ptr = globalRunners.find(runner_id);
+    if(!info_ptr) return nullptr;
+    auto& info = *info_ptr;
+    auto net_info = info.runner.getNetInfo();
+    auto indices = selected_outputs(info);
+    auto reducers = std::atomic_load(&info.outputReducers);
+    *num = indices.size();
+    auto sizes = new unsigned[2*indices.size()];
+    for(size_t k=0; k<indices.size(); k++){
+        unsigned dtype = net_info->output_dtypes[indices[k]];
+        if(dtype == BM_FLOAT16 || dtype == BM_BFLOAT16) dtype = BM_FLOAT32;
+        // the largest stage of dynamic networks
+        const bm_shape_t* shape = nullptr;
+        uint64_t count = 0;
+        for(int s=0; s<net_info->stage_num; s++){
+            auto stage_count = bmrt_shape_count(&net_info->stages[s].output_shapes[indices[k]]);
+            if(shape && stage_count <= count) continue;
+            count = stage_count;
+            shape = &net_info->stages[s].output_shapes[indices[k]];
+        }
+        sizes[2*k] = count * dtype_len(dtype);
+        sizes[2*k+1] = dtype;
+        if(reducers && indices[k] < reducers->size() && (*reducers)[indices[k]].kind != OUTPUT_REDUCER_NONE){
+            auto& reducer = (*reducers)[indices[k]];
+            sizes[2*k] = max_reduced_bytes(reducer, *shape);
+            sizes[2*k+1] = reducer.kind == OUTPUT_REDUCER_ARGMAX? BM_INT32: BM_FLOAT32;
+        }
+    }
+    return sizes;
+}
+
+// the outputs of a task popped without the buffers of the call, such as the outputs of a plugin or spare ones
+static int copy_popped_outputs(const OutputType& output, tensor_data_t *outputs, const unsigned int *capacities,
+                               unsigned int num){
+    // invalid tasks, such as expired or cancelled ones, may come out without outputs
+    if(!output.tensors) return 0;
+    int result = output.num <= num? (int)output.num: -2;
+    for(size_t i=0; i<output.num && i<num; i++){
+        auto data = outputs[i].data;
+        outputs[i] = output.tensors[i];
+        outputs[i].data = data;
+        auto bytes = elem_num(output.tensors[i].shape, output.tensors[i].dims)*dtype_len(output.tensors[i].dtype);
+        if(bytes > capacities[i]){
+            if(result >= 0) result = -3;
+            continue;
+        }
+        memcpy(data, output.tensors[i].data, bytes);
+    }
+    runner_release_output(output.num, output.tensors);
+    return result;
+}
+
+int runner_get_output_into(unsigned runner_id, unsigned int *task_id, unsigned int *is_valid,
+                           tensor_data_t *outputs, const unsigned int *capacities, unsigned int num)
+{
+    auto info_ptr = globalRunners.find(runner_id);
+    if(!info_ptr) return -1;
+    auto& info = *info_ptr;
+    if(selected_outputs(info).size() > num) return -2;
+    *task_id = INVALID_TASK_ID;
+    auto& table = info.tasks;
+    std::lock_guard<std::mutex> into_lock(info.intoMutex);
+    while(true){
+        if(!info.spareOutputs.empty()){
+            auto spare = info.spareOutputs.front();
+            info.spareOutputs.pop_front();
+            *task_id = spare.first.id;
+            *is_valid = spare.second;
+            return copy_popped_outputs(spare.first, outputs, capacities, num);
+        }
+        // the post-process of the next task copies its outputs straight into the buffers
+        OutputDest dest;
+        dest.outputs = outputs;
+        dest.capacities = capacities;
+        dest.num = num;
+        info.outputDest = &dest;
+        auto withdraw = [&]{
+            OutputDest* own = &dest;
+            return info.outputDest.compare_exchange_strong(own, nullptr);
+        };
+        // popped without waiting, so a task dropped after taking the buffers is noticed, the table wakes it up
+        std::unique_lock<std::mutex> lock(table.mutex);
+        while(true){
+            auto seen = table.notified;
+            lock.unlock();
+            OutputType output;
+            unsigned int valid = 0;
+            while(pop_task(&info, output, &valid, true)){
+                *task_id = output.id;
+                *is_valid = valid;
+                if(output.dest == &dest) return dest.result;
+                if(withdraw()) return copy_popped_outputs(output, outputs, capacities, num);
+                // the buffers are being filled by a task finishing after this one
+                info.spareOutputs.emplace_back(output, valid);
+                *task_id = INVALID_TASK_ID;
+            }
+            // its failed output is among the spare ones
+            if(dest.dropped) break;
+            lock.lock();
+            if(table.stopped){
+                if(withdraw()) return -1;
+                // taken before the stop, its output is queued
+                continue;
+            }
+            table.cond.wait(lock, [&]{ return table.notified != seen; });
+        }
     }
-    delete []output_data;
 }
 
 int runner_empty(unsigned int runner_id)
 {
-    if(!globalRunnerInfos.count(runner_id)) return true;
-    return globalRunnerInfos[runner_id]->runner.empty();
+    auto info = globalRunners.find(runner_id);
+    if(!info) return true;
+    return info->runner.empty();
 }
 
 void runner_join(unsigned int runner_id)
 {
-    if(!globalRunnerInfos.count(runner_id)) {
+    auto info = globalRunners.find(runner_id);
+    if(!info) {
         BMLOG(ERROR, "invalid runner_id %d", runner_id);
         return;
     }
-    auto& info = globalRunnerInfos[runner_id];
     info->runner.join();
 }
 
@@ -239,11 +1620,11 @@ unsigned int available_devices(unsigned int *devices, unsigned int maxNum)
 
 blob_info_t *get_input_info(unsigned runner_id, unsigned *num)
 {
-    if(!globalRunnerInfos.count(runner_id)) {
+    auto info = globalRunners.find(runner_id);
+    if(!info) {
         BMLOG(ERROR, "invalid runner_id %d", runner_id);
         return nullptr;
     }
-    auto& info = globalRunnerInfos[runner_id];
     const bm_net_info_t *net_info = info->runner.getNetInfo();
     *num = net_info->input_num;
     auto blobs = new blob_info_t[*num];
@@ -266,8 +1647,17 @@ void release_input_info(unsigned runner_id, blob_info_t *info)
 uint32_t *get_runner_durations(unsigned runner_id, unsigned *num)
 {
     *num = 0;
-    if(!globalRunnerInfos.count(runner_id)) return nullptr;
-    return globalRunnerInfos[runner_id]->status.get_durations(num);
+    auto info = globalRunners.find(runner_id);
+    if(!info) return nullptr;
+    return info->status.get_durations(num);
+}
+
+uint32_t *get_runner_percentiles(unsigned runner_id, int device_id, unsigned *num)
+{
+    *num = 0;
+    auto info = globalRunners.find(runner_id);
+    if(!info) return nullptr;
+    return info->status.get_percentiles(device_id, num);
 }
 
 void release_unsigned_pointer(unsigned *data)
@@ -275,3 +1665,26 @@ void release_unsigned_pointer(unsigned *data)
     delete[] data;
 }
 
+char *get_metrics_text()
+{
+    auto text = BMMetrics::instance().render();
+    auto data = new char[text.size()+1];
+    memcpy(data, text.c_str(), text.size()+1);
+    return data;
+}
+
+void release_metrics_text(char *text)
+{
+    delete[] text;
+}
+
+int metrics_start_http(int port)
+{
+    return BMMetrics::instance().startHttp(port);
+}
+
+void metrics_start_file_dump(const char *path, unsigned int interval_ms)
+{
+    BMMetrics::instance().startFileDump(path, interval_ms);
+}
+
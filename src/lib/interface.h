@@ -1,3 +1,5 @@
+#ifndef BMSERVICE_INTERFACE_H
+#define BMSERVICE_INTERFACE_H
 #ifdef __cplusplus
 extern "C"{
 #endif
@@ -11,12 +13,16 @@ typedef enum bm_data_type_e {
   BM_INT16 = 4,
   BM_UINT16 = 5,
   BM_INT32 = 6,
-  BM_UINT32 = 7
+  BM_UINT32 = 7,
+  BM_BFLOAT16 = 8
 } bm_data_type_t;
 */
 
 
 #define INVALID_TASK_ID 0
+// returned by runner_start* when no runner can be created, such as a bmodel failing to load,
+// at most 256 runners run at the same time
+#define INVALID_RUNNER_ID 0xFFFFFFFFu
 struct tensor_data_t {
     unsigned int dims;
     unsigned int shape[8];
@@ -24,20 +30,147 @@ struct tensor_data_t {
     unsigned char* data;
 };
 
+// all runner functions can be called from any thread, the ids of stopped runners are never reused
 unsigned int available_devices(unsigned int* devices, unsigned int maxNum);
 void runner_use_devices(const unsigned* device_ids, unsigned num);
 unsigned int runner_start_with_batch(const char *bmodel, unsigned int batch);
+// warmup_rounds<0: use BMSERVICE_WARMUP_ROUNDS, 0: disable warm-up
+unsigned int runner_start_with_warmup(const char *bmodel, unsigned int batch, int warmup_rounds);
 unsigned int runner_start(const char* bmodel);
+// pre/post-processes the tasks by the hooks of the plugin library at so_path, see bmservice_plugin.h
+// config is passed to the plugin as it is, batch and warmup_rounds are the same as runner_start_with_warmup
+// returns INVALID_RUNNER_ID if the plugin cannot be loaded
+unsigned int runner_start_with_plugin(const char *bmodel, unsigned int batch, int warmup_rounds,
+                                      const char *so_path, const char *config);
 void runner_stop(unsigned int runner_id);
 int runner_empty(unsigned int runner_id);
 int runner_all_stopped(size_t runner_id);
 void runner_show_status(unsigned int runner_id);
+// timeout_ms=0 disables the watchdog, action: 0-report only, 1-fail the task, 2-fail the device until the stalled stage returns
+void runner_set_watchdog(unsigned int runner_id, unsigned int timeout_ms, int action);
 
+// only the outputs at indices are copied back and returned, in that order, num=0 returns all of them
+// applies to the tasks post-processed after the call, returns -1 for an invalid runner or index
+int runner_select_outputs(unsigned int runner_id, const unsigned* indices, unsigned int num);
+
+// dtype of an input tensor holding the bytes of an encoded image(jpeg, png, ...), dims=1, shape[0]=bytes
+// the tensors of such a task are the images of its batch, decoded and preprocessed on the pre-process threads
+// by the spec of runner_set_image_input into the only input of the network
+#define BM_ENCODED_IMAGE 100
+#define IMAGE_RESIZE_STRETCH 0
+// keeps the aspect ratio and pads the rest with pad_color, as the yolo runners do
+#define IMAGE_RESIZE_ASPECT_PAD 1
+// resizes the central crop_factor of the image, as the inception runner does
+#define IMAGE_RESIZE_CENTRAL_CROP 2
+// NCHW if dim 1 of the input is 3, otherwise NHWC
+#define IMAGE_LAYOUT_AUTO 0
+#define IMAGE_LAYOUT_NCHW 1
+#define IMAGE_LAYOUT_NHWC 2
+// the input is (pixel - mean[c]) * scale[c] in the dtype of the network input, float32, int8 or uint8,
+// int8 inputs are quantized by their input scale. c is in the channel order of the input, RGB unless bgr!=0
+// pad_color is r, g, b
+struct image_spec_t {
+    unsigned int resize_mode;
+    float crop_factor;
+    unsigned char pad_color[3];
+    unsigned int layout;
+    int bgr;
+    float mean[3];
+    float scale[3];
+};
+// applies to the tasks pre-processed after the call, a null spec disables encoded images
+// returns -1 for an invalid runner or spec
+int runner_set_image_input(unsigned int runner_id, const image_spec_t *spec);
+
+// reducers of the outputs, run in the post-process threads, so only the compact results are copied out
+// the last dim of an output is a row, the leading dims are kept unless said otherwise
+#define OUTPUT_REDUCER_NONE 0
+// float32 [..., k, 2] of (index, value) of the k largest values of every row, k=params[0], 0 keeps all
+#define OUTPUT_REDUCER_TOPK 1
+// int32 [...], the index of the largest value of every row
+#define OUTPUT_REDUCER_ARGMAX 2
+// float32 [n, 3] of (row, index, value) of the values not less than params[0], rows of all the leading dims
+#define OUTPUT_REDUCER_THRESHOLD 3
+// yolo boxes [batch, ..., 5+class_num] of (cx, cy, w, h, objectness, class scores) are decoded,
+// the ones with objectness*score>params[0] go through NMS with iou threshold params[1], params[2] boxes at most per sample
+// float32 [n, 7] of (sample, class, score, xmin, ymin, xmax, ymax)
+#define OUTPUT_REDUCER_DETECT 4
+struct output_reducer_t {
+    unsigned int kind;
+    float params[3];
+};
+// reducers[i] applies to the network output i whatever runner_select_outputs picks, and before the post hook
+// of a plugin, the outputs from num on are returned as they are, num=0 removes all reducers
+// applies to the tasks post-processed after the call, returns -1 for an invalid runner or reducer
+int runner_set_output_reducers(unsigned int runner_id, const output_reducer_t *reducers, unsigned int num);
+
+// inputs of fp16/bf16 models may also be passed as fp32, their outputs are always returned as fp32
 unsigned int runner_put_input(unsigned runner_id, unsigned int input_num, const tensor_data_t* input_tensors, int need_copy);
+// a pooled host block of the inputs, dims, shape and dtype are those of the full batch,
+// write the data in place, the shapes can be reduced, then pass it to runner_submit_acquired,
+// which gives the block back right after the inputs are copied to device
+// a block never submitted is given back by runner_release_output
+tensor_data_t *runner_acquire_input(unsigned runner_id, unsigned int *input_num);
+// returns the task id, the block must not be touched after it, even if the runner is invalid
+unsigned int runner_submit_acquired(unsigned runner_id, unsigned int input_num, tensor_data_t *input_tensors);
+// the task is skipped if it is still waiting after timeout_ms, 0 means no timeout
+unsigned int runner_put_input_with_timeout(unsigned runner_id, unsigned int input_num, const tensor_data_t* input_tensors,
+                                           int need_copy, unsigned int timeout_ms);
+// the stages of the task not started yet are skipped, it still comes out as an invalid one without outputs
+// returns 0 if the task is not popped yet, otherwise -1
+int runner_cancel(unsigned runner_id, unsigned int task_id);
 tensor_data_t *runner_get_output(unsigned runner_id, unsigned int *task_id, unsigned int *output_num, unsigned int *is_valid);
 tensor_data_t *runner_try_to_get_output(unsigned runner_id, unsigned int *task_id, unsigned int *output_num, unsigned int *is_valid);
+// puts num_tasks tasks at once, the tensors of task t are input_nums[t] items of input_tensors following task t-1
+// fills task_ids[num_tasks], returns the number of tasks put, 0 if the runner is invalid
+unsigned int runner_put_inputs(unsigned runner_id, unsigned int num_tasks, const unsigned int *input_nums,
+                               const tensor_data_t *input_tensors, int need_copy, unsigned int *task_ids);
+// pops up to max_tasks finished tasks, wait!=0 blocks until the first one, the rest are taken if already finished
+// every outputs[i] is released by runner_release_output, returns the number of tasks popped
+unsigned int runner_get_outputs(unsigned runner_id, unsigned int max_tasks, int wait, unsigned int *task_ids,
+                                unsigned int *output_nums, unsigned int *is_valids, tensor_data_t **outputs);
+// the outputs of a task and their data are a single allocation, released as a whole
 void runner_release_output(unsigned int output_num, const tensor_data_t *output_data);
 
+// waits for the outputs of task_id only, so many threads can share one runner, timeout_ms<0 waits forever
+// every finished task is kept until it is asked for, at most 4096 of them, the oldest unclaimed ones are dropped
+// it excludes popping the same runner by runner_get_output*, runner_try_to_get_output and runner_get_outputs,
+// which would take the tasks waited for here
+// returns 0 and fills the outputs released by runner_release_output, 1 on timeout, -1 if the runner is stopped or invalid,
+// or the task is not in flight anymore, being never put, dropped or taken by another pop
+int runner_wait_task(unsigned runner_id, unsigned int task_id, int timeout_ms,
+                     tensor_data_t **outputs, unsigned int *output_num, unsigned int *is_valid);
+// runs num_tasks tasks laid out like runner_put_inputs, without copying the inputs, and waits for all of them
+// the outputs of task t are in outputs[t], output_nums[t] and is_valids[t], each released by runner_release_output
+// a task the runner could not take is invalid with null outputs, returns the number of valid tasks, -1 if the runner is invalid
+int runner_infer_all(unsigned runner_id, unsigned int num_tasks, const unsigned int *input_nums,
+                     const tensor_data_t *input_tensors, tensor_data_t **outputs,
+                     unsigned int *output_nums, unsigned int *is_valids);
+// runner_wait_task without waiting
+int runner_poll_task(unsigned runner_id, unsigned int task_id,
+                     tensor_data_t **outputs, unsigned int *output_num, unsigned int *is_valid);
+// an eventfd becoming readable when outputs are queued or the runner is stopped, closed by runner_stop
+// read it to reset, then take outputs by runner_try_to_get_output until none is left, returns -1 on error
+int runner_completion_fd(unsigned int runner_id);
+// callback(runner_id, user_data) is called in the post-process threads when an output is queued,
+// it must return quickly, a null callback removes it
+typedef void (*runner_completion_callback_t)(unsigned int runner_id, void *user_data);
+int runner_set_completion_callback(unsigned int runner_id, runner_completion_callback_t callback, void *user_data);
+// recycles the blocks of released outputs instead of freeing them
+void runner_use_output_pool(unsigned int runner_id, int enable);
+// bytes and dtypes of the outputs of a full batch, after runner_select_outputs, enough for any task
+// returns 2*num values: bytes_0, dtype_0, bytes_1, dtype_1, ..., released by release_unsigned_pointer
+unsigned *get_output_sizes(unsigned runner_id, unsigned *num);
+// waits for the next output like runner_get_output, and copies it into outputs[i].data of capacities[i] bytes,
+// from the device straight into them unless a plugin makes the outputs, dims, shape and dtype of outputs are filled in,
+// the bytes from get_output_sizes fit any task, the calls on one runner run one at a time,
+// it excludes runner_wait_task/runner_poll_task/runner_infer_all on the same runner
+// returns the output num, 0 with *task_id set for an invalid task without outputs,
+// -1 if the runner is stopped or invalid, -2 if num is less than the output num,
+// -3 with *task_id and the shapes set if an output is larger than its capacity, the task is popped without data
+int runner_get_output_into(unsigned runner_id, unsigned int *task_id, unsigned int *is_valid,
+                           tensor_data_t *outputs, const unsigned int *capacities, unsigned int num);
+
 struct blob_info_t {
     const char *name;
     int num_dims;
@@ -48,8 +181,20 @@ blob_info_t *get_input_info(unsigned runner_id, unsigned *num);
 void release_input_info(unsigned runner_id, blob_info_t *);
 void runner_join(unsigned int runner_id);
 unsigned *get_runner_durations(unsigned runner_id, unsigned *num);
+// (p50, p90, p99, p99.9) in us of pre-process, forward, post-process and the whole task,
+// device_id=-1 means all devices
+unsigned *get_runner_percentiles(unsigned runner_id, int device_id, unsigned *num);
 void release_unsigned_pointer(unsigned *data);
 
+// metrics of all runners in Prometheus text format, released by release_metrics_text
+char *get_metrics_text();
+void release_metrics_text(char *text);
+// serves http://127.0.0.1:port/metrics, port=0 picks a free port, returns the port or -1
+int metrics_start_http(int port);
+void metrics_start_file_dump(const char *path, unsigned int interval_ms);
+
 #ifdef __cplusplus
 }
 #endif
+
+#endif // BMSERVICE_INTERFACE_H
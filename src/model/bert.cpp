@@ -352,7 +352,7 @@ int main(int argc, char** argv){
     std::map<std::string, std::string> prediction;
     std::thread resultThread([&runner, &info, &prediction](){
         PostOutType out;
-        std::shared_ptr<ProcessStatus> status;
+        ProcessStatus status;
         while (true) {
             if (!runner.waitAndPop(out, status)) {
                 break;
@@ -246,7 +246,7 @@ int main(int argc, char** argv){
     std::vector<std::pair<unsigned int, float>> scores;
     std::thread resultThread([&runner, &info, &scores](){
         DLRMOutput out;
-        std::shared_ptr<ProcessStatus> status;
+        ProcessStatus status;
         while(true){
             if (!runner.waitAndPop(out, status)) {
                 break;
@@ -97,6 +97,7 @@ bool preProcess(const InType& in, const TensorVec& inTensors, ContextPtr ctx){
 
     auto mem = inTensor->get_device_mem();
     bm_image_attach_contiguous_mem(in.size(), cfg.preOutImages.data(), *mem);
+    inTensor->set_batch(in.size());
 
     if(cfg.isNCHW){
         bmcv_image_convert_to(ctx->handle, in.size(), cfg.ConvertAttr, cfg.resizedImages.data(), cfg.preOutImages.data());
@@ -115,12 +116,12 @@ bool postProcess(const InType& rawIn, const TensorVec& outTensors, PostOutType&
     const size_t K=5;
     auto outTensor = outTensors[0];
     size_t batch = rawIn.size();
-    float* data = outTensor->get_float_data();
+    auto scores = outTensor->float_view(0, batch);
     size_t len = outTensor->shape(1);
 
     postOut.classAndScores.resize(batch);
     for(size_t b=0; b<batch; b++){
-        float* allScores = data+b*len;
+        float* allScores = scores[b].ptr<float>();
         postOut.classAndScores[b] = topk(allScores, len, K);
     }
     return true;
@@ -188,7 +189,7 @@ int main(int argc, char* argv[]){
     });
     std::thread resultThread([&runner, &refMap, &labelMap, &info](){
         PostOutType out;
-        std::shared_ptr<ProcessStatus> status;
+        ProcessStatus status;
         Top5AccuracyStat stat;
         while (true) {
             if (!runner.waitAndPop(out, status)) {
@@ -104,6 +104,7 @@ bool preProcess(const InType& in, const TensorVec& inTensors, ContextPtr ctx){
 // r.record("attach memery");  
     auto mem = inTensor->get_device_mem();
     bm_image_attach_contiguous_mem(in.size(), cfg.preOutImages.data(), *mem);
+    inTensor->set_batch(in.size());
 // r.record("linear convert"); 
     if(cfg.isNCHW){
         bmcv_image_convert_to(ctx->handle, in.size(), cfg.ConvertAttr, cfg.cropedImages.data(), cfg.preOutImages.data());
@@ -150,13 +151,13 @@ bool postProcess(const InType& rawIn, const TensorVec& outTensors, PostOutType&
     const size_t K=5;
     postOut.rawIns = rawIn;
     auto outTensor = outTensors[0];
-    float* data = outTensor->get_float_data();
+    auto scores = outTensor->float_view();
     size_t batch = outTensor->shape(0);
     size_t len = outTensor->shape(1);
 
     postOut.classAndScores.resize(batch);
     for(size_t b=0; b<batch; b++){
-        float* allScores = data+b*len;
+        float* allScores = scores[b].ptr<float>();
         postOut.classAndScores[b] = topk(allScores, len, K);
     }
     return true;
@@ -227,7 +228,7 @@ int main(int argc, char* argv[]){
     });
     std::thread resultThread([&runner, &refMap, &labelMap, &info, batchSize](){
         PostOutType out;
-        std::shared_ptr<ProcessStatus> status;
+        ProcessStatus status;
         Top5AccuracyStat stat;
         while(true){
             if (!runner.waitAndPop(out, status)) {
@@ -225,6 +225,7 @@ bool preProcess(const InType& in, const TensorVec& inTensors, ContextPtr ctx){
 
     auto mem = inTensor->get_device_mem();
     bm_image_attach_contiguous_mem(in.size(), cfg.preOutImages.data(), *mem);
+    inTensor->set_batch(in.size());
 
     if(cfg.isNCHW){
         bmcv_image_convert_to(ctx->handle, in.size(), cfg.ConvertAttr, cfg.resizedImages.data(), cfg.preOutImages.data());
@@ -489,7 +490,7 @@ int main(int argc, char* argv[]){
     });
     std::thread resultThread([&runner, &info, &allPredictions](){
         PostOutType out;
-        std::shared_ptr<ProcessStatus> status;
+        ProcessStatus status;
         while(true){
             if (!runner.waitAndPop(out, status)) {
                 info.show();
@@ -61,6 +61,7 @@ bool preProcess(const InType& in, const TensorVec& inTensors, ContextPtr ctx){
         inTensor->fill_device_mem(cfg.buffer, cfg.memSize, i*cfg.memSize);
         fclose(fp);
     }
+    inTensor->set_batch(in.size());
 
     return true;
 }
@@ -71,7 +72,7 @@ bool postProcess(const InType& rawIn, const TensorVec& outTensors, PostOutType&
     auto outTensor = outTensors[0];
     size_t batch = rawIn.size();
     unsigned char* data = outTensor->get_raw_data();
-    size_t len = outTensor->get_mem_size();
+    size_t len = outTensor->get_host_mem_size();
     size_t block = len/batch;
     BM_ASSERT_EQ(len%batch, 0);
     for(size_t i=0; i<rawIn.size(); i++){
@@ -117,7 +118,7 @@ int main(int argc, char* argv[]){
 
     std::thread resultThread([&runner, &info](){
         PostOutType out;
-        std::shared_ptr<ProcessStatus> status;
+        ProcessStatus status;
         while (true){
             if (!runner.waitAndPop(out, status))
             {
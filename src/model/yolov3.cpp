@@ -123,6 +123,7 @@ bool preProcess(const InType& in, const TensorVec& inTensors, ContextPtr ctx){
 
     auto mem = inTensor->get_device_mem();
     bm_image_attach_contiguous_mem(in.size(), cfg.preOutImages.data(), *mem);
+    inTensor->set_batch(in.size());
 
     if(cfg.isNCHW){
         bmcv_image_convert_to(ctx->handle, in.size(), cfg.ConvertAttr, cfg.resizedImages.data(), cfg.preOutImages.data());
@@ -215,13 +216,13 @@ bool postProcess(const InType& rawIn, const TensorVec& outTensors, PostOutType&
     // fill batchBoxInfo
     std::vector<int> batchIndice(batch, 0);
     for(size_t i=0; i<outTensors.size(); i++){
-        auto rawData = outTensors[i]->get_float_data();
+        auto output = outTensors[i]->float_view();
         auto boxNum = boxNums[i];
         for(size_t b=0; b<batch; b++){
             auto& ci = coordInfos[b];
+            auto rawData = output[b].ptr<float>();
             for(size_t n=0; n<boxNum; n++){
-                auto rawOffset = singleDataSize *(b*boxNum + n);
-                auto rawBoxData = rawData + rawOffset;
+                auto rawBoxData = rawData + singleDataSize*n;
                 auto& boxInfo = batchBoxInfos[b][batchIndice[b]];
                 auto scores = &rawBoxData[5];
                 if(yoloV3BoxParse(boxInfo, rawBoxData, singleDataSize, cfg.probThreshold, ci)){
@@ -310,7 +311,7 @@ int main(int argc, char* argv[]){
     });
     std::thread resultThread([&runner, &info, &allPredictions](){
         PostOutType out;
-        std::shared_ptr<ProcessStatus> status;
+        ProcessStatus status;
         while (true) {
             if (!runner.waitAndPop(out, status)) {
                 info.show();
@@ -130,6 +130,7 @@ bool preProcess(const InType& in, const TensorVec& inTensors, ContextPtr ctx){
 
     auto mem = inTensor->get_device_mem();
     bm_image_attach_contiguous_mem(in.size(), cfg.preOutImages.data(), *mem);
+    inTensor->set_batch(in.size());
 
     if(cfg.isNCHW){
         bmcv_image_convert_to(ctx->handle, in.size(), cfg.ConvertAttr, cfg.resizedImages.data(), cfg.preOutImages.data());
@@ -240,7 +241,7 @@ bool postProcess(const InType& rawIn, const TensorVec& outTensors, PostOutType&
     // fill batchBoxInfo
     std::vector<int> batchIndice(batch, 0);
     for(size_t i=0; i<outTensors.size(); i++){
-        auto rawData = outTensors[i]->get_float_data();
+        auto output = outTensors[i]->float_view();
         size_t grid_w = outTensors[i]->shape(2);
         size_t grid_h = outTensors[i]->shape(3);
         size_t area = grid_w*grid_h;
@@ -251,10 +252,10 @@ bool postProcess(const InType& rawIn, const TensorVec& outTensors, PostOutType&
         size_t w_stride = bbox_len;
         size_t h_stride = grid_w * w_stride;
         size_t a_stride = grid_h * h_stride;
-        size_t b_stride = anchors * a_stride;
         
         for(size_t b=0; b<batch; b++){
             auto& ci = coordInfos[b];
+            auto rawData = output[b].ptr<float>();
             for(int anchor=0; anchor<anchors; anchor++){         
                 for(int grid_y=0; grid_y<grid_h; grid_y++){
                     for(int grid_x=0; grid_x<grid_w; grid_x++){
@@ -365,7 +366,7 @@ int main(int argc, char* argv[]){
     });
     std::thread resultThread([&runner, &info, &allPredictions](){
         PostOutType out;
-        std::shared_ptr<ProcessStatus> status;
+        ProcessStatus status;
         while(true){
             if (!runner.waitAndPop(out, status)) {
                 info.show();
@@ -0,0 +1,71 @@
+#ifndef BMSIMDEVICE_H
+#define BMSIMDEVICE_H
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <random>
+#include <memory>
+#include "bmlib_runtime.h"
+
+// shared state of the simulated bmlib/bmrt/bmcv, not part of their public api
+namespace bm {
+namespace sim {
+
+// samples the duration of a simulated forward in us, spec:
+//   "5000" or "const:5000"  always 5000us
+//   "normal:5000,500"       mean=5000us, stddev=500us
+//   "lognormal:5000,500"    lognormal with mean=5000us, stddev=500us, for long tails
+//   "uniform:4000,6000"     uniformly in [4000us, 6000us]
+class LatencyDistribution {
+public:
+    enum Type { CONST, NORMAL, LOGNORMAL, UNIFORM };
+    LatencyDistribution(double value = 0);
+    static bool parse(const std::string& spec, LatencyDistribution& dist);
+    double sample(std::mt19937& rng) const;
+    double mean() const { return param0; }
+
+private:
+    Type type;
+    double param0;
+    double param1;
+};
+
+struct Device {
+    int id;
+    // one forward at a time on a device
+    std::mutex computeMutex;
+    std::mt19937 rng;
+    // one dma transfer at a time on a device
+    std::mutex dmaMutex;
+    std::mutex memMutex;
+    size_t usedBytes = 0;
+    size_t peakBytes = 0;
+};
+
+struct Config {
+    int deviceNum = 1;
+    // 0 means unlimited
+    double copyMBps = 0;
+    LatencyDistribution latency;
+    unsigned seed = 0;
+    // reported by bm_get_chipid, decides the native store mode of int8 tensors
+    unsigned chipId = 0x1684;
+};
+
+const Config& config();
+Device* getDevice(int devid);
+Device* getDevice(bm_handle_t handle);
+
+void* memPtr(const bm_device_mem_t& mem);
+// waits until the copy of bytes would be done at the configured bandwidth
+void throttleCopy(bm_handle_t handle, size_t bytes, void* dst, const void* src);
+
+}
+}
+
+struct bm_context {
+    int devid;
+};
+
+#endif // BMSIMDEVICE_H
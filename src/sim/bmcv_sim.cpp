@@ -0,0 +1,605 @@
+#include <stdio.h>
+#include <string.h>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include "bmcv_api.h"
+#include "BMSimDevice.h"
+
+struct bm_image_private {
+    bm_handle_t handle;
+    int planeNum;
+    int strides[3];
+    int rows[3];
+    bm_device_mem_t mems[3];
+    bool attached;
+    // allocated by bm_image_alloc_dev_mem, released with the image
+    bool ownMem;
+    bm_device_mem_t ownBlock;
+    // allocated by bm_image_alloc_contiguous_mem, released by bm_image_free_contiguous_mem
+    bool ownContiguous;
+    bm_device_mem_t contiguousBlock;
+};
+
+namespace bm {
+namespace sim {
+
+static int dataSize(bm_image_data_format_ext dtype) {
+    switch(dtype){
+    case DATA_TYPE_EXT_FLOAT32: return 4;
+    case DATA_TYPE_EXT_1N_BYTE:
+    case DATA_TYPE_EXT_1N_BYTE_SIGNED: return 1;
+    default: return 0;
+    }
+}
+
+// planes of an image, strides are in bytes
+static bool planeLayout(bm_image_format_ext format, int height, int width, int ds,
+                        int& planeNum, int* strides, int* rows) {
+    int halfW = (width+1)/2, halfH = (height+1)/2;
+    switch(format){
+    case FORMAT_YUV420P:
+        planeNum = 3;
+        strides[0] = width*ds; strides[1] = strides[2] = halfW*ds;
+        rows[0] = height; rows[1] = rows[2] = halfH;
+        return true;
+    case FORMAT_YUV422P:
+        planeNum = 3;
+        strides[0] = width*ds; strides[1] = strides[2] = halfW*ds;
+        rows[0] = rows[1] = rows[2] = height;
+        return true;
+    case FORMAT_YUV444P:
+    case FORMAT_RGBP_SEPARATE:
+    case FORMAT_BGRP_SEPARATE:
+        planeNum = 3;
+        strides[0] = strides[1] = strides[2] = width*ds;
+        rows[0] = rows[1] = rows[2] = height;
+        return true;
+    case FORMAT_NV12:
+    case FORMAT_NV21:
+        planeNum = 2;
+        strides[0] = width*ds; strides[1] = halfW*2*ds;
+        rows[0] = height; rows[1] = halfH;
+        return true;
+    case FORMAT_NV16:
+    case FORMAT_NV61:
+        planeNum = 2;
+        strides[0] = width*ds; strides[1] = halfW*2*ds;
+        rows[0] = rows[1] = height;
+        return true;
+    case FORMAT_NV24:
+        planeNum = 2;
+        strides[0] = width*ds; strides[1] = width*2*ds;
+        rows[0] = rows[1] = height;
+        return true;
+    case FORMAT_RGB_PLANAR:
+    case FORMAT_BGR_PLANAR:
+        planeNum = 1;
+        strides[0] = width*ds;
+        rows[0] = height*3;
+        return true;
+    case FORMAT_RGB_PACKED:
+    case FORMAT_BGR_PACKED:
+        planeNum = 1;
+        strides[0] = width*3*ds;
+        rows[0] = height;
+        return true;
+    case FORMAT_GRAY:
+        planeNum = 1;
+        strides[0] = width*ds;
+        rows[0] = height;
+        return true;
+    default:
+        return false;
+    }
+}
+
+static size_t planeBytes(const bm_image& image, int plane) {
+    return (size_t)image.image_private->strides[plane]*image.image_private->rows[plane];
+}
+
+static size_t imageBytes(const bm_image& image) {
+    size_t bytes = 0;
+    for(int i=0; i<image.image_private->planeNum; i++) bytes += planeBytes(image, i);
+    return bytes;
+}
+
+static void attachBlock(bm_image& image, unsigned long long addr) {
+    auto priv = image.image_private;
+    for(int i=0; i<priv->planeNum; i++){
+        priv->mems[i] = bm_mem_from_device(addr, planeBytes(image, i));
+        addr += planeBytes(image, i);
+    }
+    priv->attached = true;
+}
+
+static bool isYUV(bm_image_format_ext format) {
+    return format <= FORMAT_NV24;
+}
+
+static unsigned char* elemPtr(const bm_image& image, int plane, int row, int col) {
+    auto priv = image.image_private;
+    return (unsigned char*)memPtr(priv->mems[plane]) + (size_t)row*priv->strides[plane] + (size_t)col*dataSize(image.data_type);
+}
+
+static float readElem(const bm_image& image, const unsigned char* ptr) {
+    switch(image.data_type){
+    case DATA_TYPE_EXT_FLOAT32: return *(const float*)ptr;
+    case DATA_TYPE_EXT_1N_BYTE_SIGNED: return *(const signed char*)ptr;
+    default: return *ptr;
+    }
+}
+
+static void writeElem(const bm_image& image, unsigned char* ptr, float value) {
+    switch(image.data_type){
+    case DATA_TYPE_EXT_FLOAT32:
+        *(float*)ptr = value;
+        break;
+    case DATA_TYPE_EXT_1N_BYTE_SIGNED:
+        *(signed char*)ptr = (signed char)std::max(-128.f, std::min(127.f, std::round(value)));
+        break;
+    default:
+        *ptr = (unsigned char)std::max(0.f, std::min(255.f, std::round(value)));
+        break;
+    }
+}
+
+// (plane, row, col) of a chroma sample, u=0 or v=1
+static void chromaPos(bm_image_format_ext format, int x, int y, int uv, int& plane, int& row, int& col) {
+    switch(format){
+    case FORMAT_YUV420P: plane = 1+uv; row = y/2; col = x/2; break;
+    case FORMAT_YUV422P: plane = 1+uv; row = y; col = x/2; break;
+    case FORMAT_YUV444P: plane = 1+uv; row = y; col = x; break;
+    case FORMAT_NV12: plane = 1; row = y/2; col = x/2*2 + uv; break;
+    case FORMAT_NV21: plane = 1; row = y/2; col = x/2*2 + 1-uv; break;
+    case FORMAT_NV16: plane = 1; row = y; col = x/2*2 + uv; break;
+    case FORMAT_NV61: plane = 1; row = y; col = x/2*2 + 1-uv; break;
+    default: plane = 1; row = y; col = x*2 + uv; break;
+    }
+}
+
+// (plane, row, col) of channel c(0-R, 1-G, 2-B) of an rgb or gray image
+static void rgbPos(const bm_image& image, int x, int y, int c, int& plane, int& row, int& col) {
+    auto format = image.image_format;
+    bool bgr = format == FORMAT_BGR_PLANAR || format == FORMAT_BGR_PACKED || format == FORMAT_BGRP_SEPARATE;
+    int ch = bgr? 2-c: c;
+    switch(format){
+    case FORMAT_RGB_PLANAR:
+    case FORMAT_BGR_PLANAR: plane = 0; row = ch*image.height + y; col = x; break;
+    case FORMAT_RGB_PACKED:
+    case FORMAT_BGR_PACKED: plane = 0; row = y; col = x*3 + ch; break;
+    case FORMAT_RGBP_SEPARATE:
+    case FORMAT_BGRP_SEPARATE: plane = ch; row = y; col = x; break;
+    default: plane = 0; row = y; col = x; break;
+    }
+}
+
+static void readPixel(const bm_image& image, int x, int y, float* rgb) {
+    if(isYUV(image.image_format)){
+        int plane, row, col;
+        float Y = readElem(image, elemPtr(image, 0, y, x)) - 16;
+        chromaPos(image.image_format, x, y, 0, plane, row, col);
+        float U = readElem(image, elemPtr(image, plane, row, col)) - 128;
+        chromaPos(image.image_format, x, y, 1, plane, row, col);
+        float V = readElem(image, elemPtr(image, plane, row, col)) - 128;
+        rgb[0] = 1.164f*Y + 1.596f*V;
+        rgb[1] = 1.164f*Y - 0.813f*V - 0.391f*U;
+        rgb[2] = 1.164f*Y + 2.018f*U;
+    } else if(image.image_format == FORMAT_GRAY){
+        rgb[0] = rgb[1] = rgb[2] = readElem(image, elemPtr(image, 0, y, x));
+    } else {
+        for(int c=0; c<3; c++){
+            int plane, row, col;
+            rgbPos(image, x, y, c, plane, row, col);
+            rgb[c] = readElem(image, elemPtr(image, plane, row, col));
+        }
+    }
+}
+
+static void writePixel(const bm_image& image, int x, int y, const float* rgb) {
+    if(isYUV(image.image_format)){
+        float Y = 0.257f*rgb[0] + 0.504f*rgb[1] + 0.098f*rgb[2] + 16;
+        writeElem(image, elemPtr(image, 0, y, x), Y);
+        // chroma is taken from the top-left pixel of each subsampled block
+        bool hSub = image.image_format != FORMAT_YUV444P && image.image_format != FORMAT_NV24;
+        bool vSub = image.image_format == FORMAT_YUV420P || image.image_format == FORMAT_NV12 || image.image_format == FORMAT_NV21;
+        if((hSub && x%2) || (vSub && y%2)) return;
+        float U = -0.148f*rgb[0] - 0.291f*rgb[1] + 0.439f*rgb[2] + 128;
+        float V = 0.439f*rgb[0] - 0.368f*rgb[1] - 0.071f*rgb[2] + 128;
+        int plane, row, col;
+        chromaPos(image.image_format, x, y, 0, plane, row, col);
+        writeElem(image, elemPtr(image, plane, row, col), U);
+        chromaPos(image.image_format, x, y, 1, plane, row, col);
+        writeElem(image, elemPtr(image, plane, row, col), V);
+    } else if(image.image_format == FORMAT_GRAY){
+        writeElem(image, elemPtr(image, 0, y, x), 0.299f*rgb[0] + 0.587f*rgb[1] + 0.114f*rgb[2]);
+    } else {
+        for(int c=0; c<3; c++){
+            int plane, row, col;
+            rgbPos(image, x, y, c, plane, row, col);
+            writeElem(image, elemPtr(image, plane, row, col), rgb[c]);
+        }
+    }
+}
+
+static bool usable(const bm_image& image) {
+    return image.image_private && image.image_private->attached && dataSize(image.data_type)>0;
+}
+
+static void fillRect(const bm_image& image, int x0, int y0, int w, int h, const float* rgb) {
+    for(int y=std::max(y0, 0); y<std::min(y0+h, image.height); y++){
+        for(int x=std::max(x0, 0); x<std::min(x0+w, image.width); x++){
+            writePixel(image, x, y, rgb);
+        }
+    }
+}
+
+static void sample(const bm_image& src, const bmcv_rect_t& rect, float sx, float sy,
+                   bmcv_resize_algorithm algorithm, float* rgb) {
+    if(algorithm == BMCV_INTER_NEAREST){
+        int x = std::min(rect.start_x + (int)sx, rect.start_x + rect.crop_w - 1);
+        int y = std::min(rect.start_y + (int)sy, rect.start_y + rect.crop_h - 1);
+        readPixel(src, x, y, rgb);
+        return;
+    }
+    // bilinear with pixel centers aligned, bicubic falls back to it
+    float fx = std::max(0.f, std::min(sx - 0.5f, rect.crop_w - 1.f));
+    float fy = std::max(0.f, std::min(sy - 0.5f, rect.crop_h - 1.f));
+    int x0 = (int)fx, y0 = (int)fy;
+    int x1 = std::min(x0+1, rect.crop_w-1), y1 = std::min(y0+1, rect.crop_h-1);
+    float ax = fx - x0, ay = fy - y0;
+    float p00[3], p01[3], p10[3], p11[3];
+    readPixel(src, rect.start_x + x0, rect.start_y + y0, p00);
+    readPixel(src, rect.start_x + x1, rect.start_y + y0, p01);
+    readPixel(src, rect.start_x + x0, rect.start_y + y1, p10);
+    readPixel(src, rect.start_x + x1, rect.start_y + y1, p11);
+    for(int c=0; c<3; c++){
+        rgb[c] = (p00[c]*(1-ax) + p01[c]*ax)*(1-ay) + (p10[c]*(1-ax) + p11[c]*ax)*ay;
+    }
+}
+
+// resizes rect of src into (dstX, dstY, dstW, dstH) of dst
+static bm_status_t resizeInto(const bm_image& src, const bmcv_rect_t& rect, const bm_image& dst,
+                              int dstX, int dstY, int dstW, int dstH, bmcv_resize_algorithm algorithm) {
+    if(!usable(src) || !usable(dst) || rect.crop_w<=0 || rect.crop_h<=0 || rect.start_x<0 || rect.start_y<0 ||
+            rect.start_x + rect.crop_w > src.width || rect.start_y + rect.crop_h > src.height ||
+            dstW<=0 || dstH<=0 || dstX<0 || dstY<0 || dstX + dstW > dst.width || dstY + dstH > dst.height){
+        return BM_ERR_PARAM;
+    }
+    float scaleX = (float)rect.crop_w/dstW, scaleY = (float)rect.crop_h/dstH;
+    float rgb[3];
+    for(int y=0; y<dstH; y++){
+        for(int x=0; x<dstW; x++){
+            sample(src, rect, (x+0.5f)*scaleX, (y+0.5f)*scaleY, algorithm, rgb);
+            writePixel(dst, dstX + x, dstY + y, rgb);
+        }
+    }
+    return BM_SUCCESS;
+}
+
+static bm_status_t vpp(const bm_image& src, const bmcv_rect_t* rect, const bmcv_padding_atrr_t* padding,
+                       const bm_image& dst, bmcv_resize_algorithm algorithm) {
+    bmcv_rect_t fullRect = {0, 0, src.width, src.height};
+    if(!rect) rect = &fullRect;
+    if(!padding){
+        return resizeInto(src, *rect, dst, 0, 0, dst.width, dst.height, algorithm);
+    }
+    if(padding->if_memset){
+        float color[3] = {(float)padding->padding_r, (float)padding->padding_g, (float)padding->padding_b};
+        fillRect(dst, 0, 0, dst.width, dst.height, color);
+    }
+    return resizeInto(src, *rect, dst, padding->dst_crop_stx, padding->dst_crop_sty,
+                      padding->dst_crop_w, padding->dst_crop_h, algorithm);
+}
+
+}
+}
+
+using namespace bm::sim;
+
+extern "C" {
+
+bm_status_t bm_image_create(bm_handle_t handle, int img_h, int img_w,
+                            bm_image_format_ext image_format, bm_image_data_format_ext data_type,
+                            bm_image *image, int *stride)
+{
+    int ds = dataSize(data_type);
+    int planeNum, strides[3], rows[3];
+    if(!image || img_h<=0 || img_w<=0 || ds==0 || !planeLayout(image_format, img_h, img_w, ds, planeNum, strides, rows)){
+        return BM_NOT_SUPPORTED;
+    }
+    auto priv = new bm_image_private;
+    memset(priv, 0, sizeof(*priv));
+    priv->handle = handle;
+    priv->planeNum = planeNum;
+    for(int i=0; i<planeNum; i++){
+        priv->strides[i] = stride && stride[i]>0? stride[i]: strides[i];
+        priv->rows[i] = rows[i];
+    }
+    image->width = img_w;
+    image->height = img_h;
+    image->image_format = image_format;
+    image->data_type = data_type;
+    image->image_private = priv;
+    return BM_SUCCESS;
+}
+
+bm_status_t bm_image_destroy(bm_image image)
+{
+    auto priv = image.image_private;
+    if(!priv) return BM_ERR_PARAM;
+    if(priv->ownMem){
+        bm_free_device(priv->handle, priv->ownBlock);
+    }
+    delete priv;
+    return BM_SUCCESS;
+}
+
+bm_handle_t bm_image_get_handle(bm_image *image)
+{
+    return image->image_private? image->image_private->handle: nullptr;
+}
+
+int bm_image_get_plane_num(bm_image image)
+{
+    return image.image_private? image.image_private->planeNum: 0;
+}
+
+bm_status_t bm_image_get_stride(bm_image image, int *stride)
+{
+    if(!image.image_private) return BM_ERR_PARAM;
+    for(int i=0; i<image.image_private->planeNum; i++) stride[i] = image.image_private->strides[i];
+    return BM_SUCCESS;
+}
+
+bm_status_t bm_image_get_byte_size(bm_image image, int *size)
+{
+    if(!image.image_private) return BM_ERR_PARAM;
+    for(int i=0; i<image.image_private->planeNum; i++) size[i] = planeBytes(image, i);
+    return BM_SUCCESS;
+}
+
+bm_status_t bm_image_get_device_mem(bm_image image, bm_device_mem_t *mem)
+{
+    if(!image.image_private || !image.image_private->attached) return BM_ERR_PARAM;
+    for(int i=0; i<image.image_private->planeNum; i++) mem[i] = image.image_private->mems[i];
+    return BM_SUCCESS;
+}
+
+bool bm_image_is_attached(bm_image image)
+{
+    return image.image_private && image.image_private->attached;
+}
+
+bm_status_t bm_image_alloc_dev_mem(bm_image image, int heap_id)
+{
+    auto priv = image.image_private;
+    if(!priv || priv->attached) return BM_ERR_PARAM;
+    auto ret = bm_malloc_device_byte(priv->handle, &priv->ownBlock, imageBytes(image));
+    if(ret != BM_SUCCESS) return ret;
+    priv->ownMem = true;
+    attachBlock(image, bm_mem_get_device_addr(priv->ownBlock));
+    return BM_SUCCESS;
+}
+
+bm_status_t bm_image_attach(bm_image image, bm_device_mem_t *device_memory)
+{
+    auto priv = image.image_private;
+    if(!priv) return BM_ERR_PARAM;
+    for(int i=0; i<priv->planeNum; i++) priv->mems[i] = device_memory[i];
+    priv->attached = true;
+    return BM_SUCCESS;
+}
+
+bm_status_t bm_image_detach(bm_image image)
+{
+    auto priv = image.image_private;
+    if(!priv) return BM_ERR_PARAM;
+    if(priv->ownMem){
+        bm_free_device(priv->handle, priv->ownBlock);
+        priv->ownMem = false;
+    }
+    priv->attached = false;
+    return BM_SUCCESS;
+}
+
+bm_status_t bm_image_attach_contiguous_mem(int image_num, bm_image *images, bm_device_mem_t dmem)
+{
+    size_t total = 0;
+    for(int i=0; i<image_num; i++){
+        if(!images[i].image_private) return BM_ERR_PARAM;
+        total += imageBytes(images[i]);
+    }
+    if(total > bm_mem_get_device_size(dmem)) return BM_ERR_PARAM;
+    auto addr = bm_mem_get_device_addr(dmem);
+    for(int i=0; i<image_num; i++){
+        attachBlock(images[i], addr);
+        addr += imageBytes(images[i]);
+    }
+    return BM_SUCCESS;
+}
+
+bm_status_t bm_image_dettach_contiguous_mem(int image_num, bm_image *images)
+{
+    for(int i=0; i<image_num; i++){
+        if(images[i].image_private) images[i].image_private->attached = false;
+    }
+    return BM_SUCCESS;
+}
+
+bm_status_t bm_image_alloc_contiguous_mem(int image_num, bm_image *images, int heap_id)
+{
+    if(image_num<=0 || !images[0].image_private) return BM_ERR_PARAM;
+    size_t total = 0;
+    for(int i=0; i<image_num; i++){
+        if(!images[i].image_private || images[i].image_private->attached) return BM_ERR_PARAM;
+        total += imageBytes(images[i]);
+    }
+    auto priv = images[0].image_private;
+    auto ret = bm_malloc_device_byte(priv->handle, &priv->contiguousBlock, total);
+    if(ret != BM_SUCCESS) return ret;
+    priv->ownContiguous = true;
+    return bm_image_attach_contiguous_mem(image_num, images, priv->contiguousBlock);
+}
+
+bm_status_t bm_image_free_contiguous_mem(int image_num, bm_image *images)
+{
+    if(image_num<=0 || !images[0].image_private || !images[0].image_private->ownContiguous) return BM_ERR_PARAM;
+    auto priv = images[0].image_private;
+    bm_free_device(priv->handle, priv->contiguousBlock);
+    priv->ownContiguous = false;
+    return bm_image_dettach_contiguous_mem(image_num, images);
+}
+
+bm_status_t bm_image_get_contiguous_device_mem(int image_num, bm_image *images, bm_device_mem_t *mem)
+{
+    if(image_num<=0 || !bm_image_is_attached(images[0])) return BM_ERR_PARAM;
+    size_t total = 0;
+    auto start = bm_mem_get_device_addr(images[0].image_private->mems[0]);
+    for(int i=0; i<image_num; i++){
+        if(!bm_image_is_attached(images[i]) ||
+                bm_mem_get_device_addr(images[i].image_private->mems[0]) != start + total){
+            return BM_ERR_PARAM;
+        }
+        total += imageBytes(images[i]);
+    }
+    *mem = bm_mem_from_device(start, total);
+    return BM_SUCCESS;
+}
+
+bm_status_t bm_image_copy_host_to_device(bm_image image, void *buffers[])
+{
+    if(!bm_image_is_attached(image)) return BM_ERR_PARAM;
+    auto priv = image.image_private;
+    for(int i=0; i<priv->planeNum; i++){
+        throttleCopy(priv->handle, planeBytes(image, i), memPtr(priv->mems[i]), buffers[i]);
+    }
+    return BM_SUCCESS;
+}
+
+bm_status_t bm_image_copy_device_to_host(bm_image image, void *buffers[])
+{
+    if(!bm_image_is_attached(image)) return BM_ERR_PARAM;
+    auto priv = image.image_private;
+    for(int i=0; i<priv->planeNum; i++){
+        throttleCopy(priv->handle, planeBytes(image, i), buffers[i], memPtr(priv->mems[i]));
+    }
+    return BM_SUCCESS;
+}
+
+bm_status_t bmcv_image_convert_to(bm_handle_t handle, int input_num, bmcv_convert_to_attr convert_to_attr,
+                                  bm_image *input, bm_image *output)
+{
+    const float alpha[3] = {convert_to_attr.alpha_0, convert_to_attr.alpha_1, convert_to_attr.alpha_2};
+    const float beta[3] = {convert_to_attr.beta_0, convert_to_attr.beta_1, convert_to_attr.beta_2};
+    for(int n=0; n<input_num; n++){
+        auto& src = input[n];
+        auto& dst = output[n];
+        if(!usable(src) || !usable(dst) || src.image_format != dst.image_format ||
+                src.width != dst.width || src.height != dst.height || isYUV(src.image_format)){
+            return BM_ERR_PARAM;
+        }
+        auto priv = src.image_private;
+        int ds = dataSize(src.data_type);
+        // channels are counted in memory order, as the hardware does
+        for(int plane=0; plane<priv->planeNum; plane++){
+            for(int row=0; row<priv->rows[plane]; row++){
+                int cols = dst.image_private->strides[plane]/dataSize(dst.data_type);
+                cols = std::min(cols, priv->strides[plane]/ds);
+                if(src.image_format == FORMAT_RGB_PACKED || src.image_format == FORMAT_BGR_PACKED) {
+                    cols = std::min(cols, src.width*3);
+                } else {
+                    cols = std::min(cols, src.width);
+                }
+                for(int col=0; col<cols; col++){
+                    int c = 0;
+                    if(src.image_format == FORMAT_RGB_PLANAR || src.image_format == FORMAT_BGR_PLANAR) c = row/src.height;
+                    else if(src.image_format == FORMAT_RGB_PACKED || src.image_format == FORMAT_BGR_PACKED) c = col%3;
+                    else if(priv->planeNum == 3) c = plane;
+                    auto value = readElem(src, elemPtr(src, plane, row, col));
+                    writeElem(dst, elemPtr(dst, plane, row, col), value*alpha[c] + beta[c]);
+                }
+            }
+        }
+    }
+    return BM_SUCCESS;
+}
+
+bm_status_t bmcv_image_storage_convert(bm_handle_t handle, int image_num, bm_image *input, bm_image *output)
+{
+    for(int n=0; n<image_num; n++){
+        auto& src = input[n];
+        auto& dst = output[n];
+        if(!usable(src) || !usable(dst) || src.width != dst.width || src.height != dst.height){
+            return BM_ERR_PARAM;
+        }
+        float rgb[3];
+        for(int y=0; y<src.height; y++){
+            for(int x=0; x<src.width; x++){
+                readPixel(src, x, y, rgb);
+                writePixel(dst, x, y, rgb);
+            }
+        }
+    }
+    return BM_SUCCESS;
+}
+
+bm_status_t bmcv_image_copy_to(bm_handle_t handle, bmcv_copy_to_atrr_t copy_to_attr, bm_image input, bm_image output)
+{
+    if(!usable(input) || !usable(output) || copy_to_attr.start_x<0 || copy_to_attr.start_y<0 ||
+            copy_to_attr.start_x + input.width > output.width || copy_to_attr.start_y + input.height > output.height){
+        return BM_ERR_PARAM;
+    }
+    if(copy_to_attr.if_padding){
+        float color[3] = {(float)copy_to_attr.padding_r, (float)copy_to_attr.padding_g, (float)copy_to_attr.padding_b};
+        fillRect(output, 0, 0, output.width, output.height, color);
+    }
+    float rgb[3];
+    for(int y=0; y<input.height; y++){
+        for(int x=0; x<input.width; x++){
+            readPixel(input, x, y, rgb);
+            writePixel(output, copy_to_attr.start_x + x, copy_to_attr.start_y + y, rgb);
+        }
+    }
+    return BM_SUCCESS;
+}
+
+bm_status_t bmcv_image_vpp_basic(bm_handle_t handle, int in_img_num, bm_image *input, bm_image *output,
+                                 int *crop_num_vec, bmcv_rect_t *crop_rect, bmcv_padding_atrr_t *padding_attr,
+                                 bmcv_resize_algorithm algorithm)
+{
+    int outIndex = 0;
+    for(int i=0; i<in_img_num; i++){
+        int cropNum = crop_num_vec? crop_num_vec[i]: 1;
+        for(int k=0; k<cropNum; k++, outIndex++){
+            auto ret = vpp(input[i], crop_rect? &crop_rect[outIndex]: nullptr,
+                           padding_attr? &padding_attr[outIndex]: nullptr, output[outIndex], algorithm);
+            if(ret != BM_SUCCESS) return ret;
+        }
+    }
+    return BM_SUCCESS;
+}
+
+bm_status_t bmcv_image_vpp_convert(bm_handle_t handle, int output_num, bm_image input, bm_image *output,
+                                   bmcv_rect_t *crop_rect, bmcv_resize_algorithm algorithm)
+{
+    for(int i=0; i<output_num; i++){
+        auto ret = vpp(input, crop_rect? &crop_rect[i]: nullptr, nullptr, output[i], algorithm);
+        if(ret != BM_SUCCESS) return ret;
+    }
+    return BM_SUCCESS;
+}
+
+bm_status_t bmcv_image_vpp_convert_padding(bm_handle_t handle, int output_num, bm_image input, bm_image *output,
+                                           bmcv_padding_atrr_t *padding_attr, bmcv_rect_t *crop_rect,
+                                           bmcv_resize_algorithm algorithm)
+{
+    for(int i=0; i<output_num; i++){
+        auto ret = vpp(input, crop_rect? &crop_rect[i]: nullptr, padding_attr? &padding_attr[i]: nullptr,
+                       output[i], algorithm);
+        if(ret != BM_SUCCESS) return ret;
+    }
+    return BM_SUCCESS;
+}
+
+}
@@ -0,0 +1,298 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cmath>
+#include <map>
+#include <chrono>
+#include <thread>
+#include <sstream>
+#include "BMEnv.h"
+#include "BMSimDevice.h"
+
+namespace bm {
+namespace sim {
+
+LatencyDistribution::LatencyDistribution(double value): type(CONST), param0(value), param1(0) {}
+
+bool LatencyDistribution::parse(const std::string &spec, LatencyDistribution &dist)
+{
+    auto pos = spec.find(':');
+    std::string name = pos == std::string::npos? "const": spec.substr(0, pos);
+    std::string params = pos == std::string::npos? spec: spec.substr(pos+1);
+    for(auto& c: params) if(c == ',') c = ' ';
+    std::istringstream iss(params);
+    double p0 = 0, p1 = 0;
+    if(!(iss >> p0) || p0 < 0) return false;
+    if(name == "const"){
+        dist.type = CONST;
+    } else {
+        if(!(iss >> p1) || p1 < 0) return false;
+        if(name == "normal") dist.type = NORMAL;
+        else if(name == "lognormal") dist.type = LOGNORMAL;
+        else if(name == "uniform" && p1 >= p0) dist.type = UNIFORM;
+        else return false;
+    }
+    dist.param0 = p0;
+    dist.param1 = p1;
+    return true;
+}
+
+double LatencyDistribution::sample(std::mt19937 &rng) const
+{
+    double value = param0;
+    switch(type){
+    case NORMAL:
+        value = std::normal_distribution<double>(param0, param1)(rng);
+        break;
+    case LOGNORMAL: {
+        if(param0 <= 0) break;
+        // mu and sigma of the underlying normal distribution from the mean and stddev
+        double sigma2 = std::log(1 + param1*param1/(param0*param0));
+        double mu = std::log(param0) - sigma2/2;
+        value = std::lognormal_distribution<double>(mu, std::sqrt(sigma2))(rng);
+        break;
+    }
+    case UNIFORM:
+        value = std::uniform_real_distribution<double>(param0, param1)(rng);
+        break;
+    default:
+        break;
+    }
+    return value < 0? 0: value;
+}
+
+static Config loadConfig() {
+    Config cfg;
+    if(auto str = getenv(BM_SIM_DEVICE_NUM)){
+        cfg.deviceNum = atoi(str);
+    }
+    if(auto str = getenv(BM_SIM_COPY_MBPS)){
+        cfg.copyMBps = atof(str);
+    }
+    if(auto str = getenv(BM_SIM_LATENCY_US)){
+        if(!LatencyDistribution::parse(str, cfg.latency)){
+            fprintf(stderr, "[bmsim] invalid %s='%s', ignored\n", BM_SIM_LATENCY_US, str);
+        }
+    }
+    if(auto str = getenv(BM_SIM_SEED)){
+        cfg.seed = atoi(str);
+    }
+    if(auto str = getenv(BM_SIM_CHIP_ID)){
+        cfg.chipId = strtoul(str, nullptr, 0);
+    }
+    return cfg;
+}
+
+const Config &config()
+{
+    static Config cfg = loadConfig();
+    return cfg;
+}
+
+Device *getDevice(int devid)
+{
+    static std::vector<std::unique_ptr<Device>> devices = [](){
+        std::vector<std::unique_ptr<Device>> devices;
+        for(int i=0; i<config().deviceNum; i++){
+            devices.emplace_back(new Device);
+            devices.back()->id = i;
+            devices.back()->rng.seed(config().seed + i);
+        }
+        return devices;
+    }();
+    if(devid<0 || devid>=(int)devices.size()) return nullptr;
+    return devices[devid].get();
+}
+
+Device *getDevice(bm_handle_t handle)
+{
+    return handle? getDevice(handle->devid): nullptr;
+}
+
+void *memPtr(const bm_device_mem_t &mem)
+{
+    return (void*)mem.u.device.device_addr;
+}
+
+void throttleCopy(bm_handle_t handle, size_t bytes, void *dst, const void *src)
+{
+    auto device = getDevice(handle);
+    if(!device){
+        memcpy(dst, src, bytes);
+        return;
+    }
+    std::lock_guard<std::mutex> guard(device->dmaMutex);
+    auto start = std::chrono::steady_clock::now();
+    memcpy(dst, src, bytes);
+    auto mbps = config().copyMBps;
+    if(mbps > 0){
+        auto us = (long long)(bytes/mbps);
+        std::this_thread::sleep_until(start + std::chrono::microseconds(us));
+    }
+}
+
+}
+}
+
+using namespace bm::sim;
+
+extern "C" {
+
+bm_status_t bm_dev_getcount(int *count)
+{
+    *count = config().deviceNum;
+    return BM_SUCCESS;
+}
+
+bm_status_t bm_dev_request(bm_handle_t *handle, int devid)
+{
+    if(!getDevice(devid)) return BM_ERR_PARAM;
+    *handle = new bm_context{devid};
+    return BM_SUCCESS;
+}
+
+void bm_dev_free(bm_handle_t handle)
+{
+    delete handle;
+}
+
+int bm_get_devid(bm_handle_t handle)
+{
+    return handle->devid;
+}
+
+bm_status_t bm_get_chipid(bm_handle_t handle, unsigned int *p_chipid)
+{
+    *p_chipid = config().chipId;
+    return BM_SUCCESS;
+}
+
+bm_status_t bm_malloc_device_byte(bm_handle_t handle, bm_device_mem_t *pmem, unsigned int size)
+{
+    auto device = getDevice(handle);
+    if(!device) return BM_ERR_PARAM;
+    void* ptr = nullptr;
+    if(posix_memalign(&ptr, 64, size? size: 1) != 0) return BM_ERR_NOMEM;
+    memset(pmem, 0, sizeof(*pmem));
+    pmem->u.device.device_addr = (unsigned long)ptr;
+    pmem->flags.u.mem_type = BM_MEM_TYPE_DEVICE;
+    pmem->size = size;
+    std::lock_guard<std::mutex> guard(device->memMutex);
+    device->usedBytes += size;
+    device->peakBytes = std::max(device->peakBytes, device->usedBytes);
+    return BM_SUCCESS;
+}
+
+bm_status_t bm_malloc_device_byte_heap(bm_handle_t handle, bm_device_mem_t *pmem, int heap_id, unsigned int size)
+{
+    return bm_malloc_device_byte(handle, pmem, size);
+}
+
+void bm_free_device(bm_handle_t handle, bm_device_mem_t mem)
+{
+    auto device = getDevice(handle);
+    if(!device || !memPtr(mem)) return;
+    free(memPtr(mem));
+    std::lock_guard<std::mutex> guard(device->memMutex);
+    device->usedBytes -= mem.size;
+}
+
+unsigned long long bm_mem_get_device_addr(struct bm_mem_desc mem)
+{
+    return mem.u.device.device_addr;
+}
+
+void bm_mem_set_device_addr(struct bm_mem_desc *pmem, unsigned long long addr)
+{
+    pmem->u.device.device_addr = addr;
+}
+
+unsigned int bm_mem_get_device_size(struct bm_mem_desc mem)
+{
+    return mem.size;
+}
+
+void bm_mem_set_device_size(struct bm_mem_desc *pmem, unsigned int size)
+{
+    pmem->size = size;
+}
+
+bm_device_mem_t bm_mem_from_device(unsigned long long device_addr, unsigned int len)
+{
+    bm_device_mem_t mem;
+    memset(&mem, 0, sizeof(mem));
+    mem.u.device.device_addr = device_addr;
+    mem.flags.u.mem_type = BM_MEM_TYPE_DEVICE;
+    mem.size = len;
+    return mem;
+}
+
+bm_device_mem_t bm_mem_null(void)
+{
+    bm_device_mem_t mem;
+    memset(&mem, 0, sizeof(mem));
+    mem.flags.u.mem_type = BM_MEM_TYPE_INVALID;
+    return mem;
+}
+
+bm_status_t bm_memcpy_s2d_partial_offset(bm_handle_t handle, bm_device_mem_t dst, void *src, unsigned int size, unsigned int offset)
+{
+    if(!memPtr(dst) || (size_t)offset + size > dst.size) return BM_ERR_PARAM;
+    throttleCopy(handle, size, (char*)memPtr(dst) + offset, src);
+    return BM_SUCCESS;
+}
+
+bm_status_t bm_memcpy_s2d_partial(bm_handle_t handle, bm_device_mem_t dst, void *src, unsigned int size)
+{
+    return bm_memcpy_s2d_partial_offset(handle, dst, src, size, 0);
+}
+
+bm_status_t bm_memcpy_s2d(bm_handle_t handle, bm_device_mem_t dst, void *src)
+{
+    return bm_memcpy_s2d_partial_offset(handle, dst, src, dst.size, 0);
+}
+
+bm_status_t bm_memcpy_d2s_partial_offset(bm_handle_t handle, void *dst, bm_device_mem_t src, unsigned int size, unsigned int offset)
+{
+    if(!memPtr(src) || (size_t)offset + size > src.size) return BM_ERR_PARAM;
+    throttleCopy(handle, size, dst, (char*)memPtr(src) + offset);
+    return BM_SUCCESS;
+}
+
+bm_status_t bm_memcpy_d2s_partial(bm_handle_t handle, void *dst, bm_device_mem_t src, unsigned int size)
+{
+    return bm_memcpy_d2s_partial_offset(handle, dst, src, size, 0);
+}
+
+bm_status_t bm_memcpy_d2s(bm_handle_t handle, void *dst, bm_device_mem_t src)
+{
+    return bm_memcpy_d2s_partial_offset(handle, dst, src, src.size, 0);
+}
+
+bm_status_t bm_memcpy_d2d_byte(bm_handle_t handle, bm_device_mem_t dst, size_t dst_offset,
+                               bm_device_mem_t src, size_t src_offset, size_t size)
+{
+    if(!memPtr(dst) || !memPtr(src) || dst_offset + size > dst.size || src_offset + size > src.size){
+        return BM_ERR_PARAM;
+    }
+    // on-device copies do not go through the host link
+    memmove((char*)memPtr(dst) + dst_offset, (char*)memPtr(src) + src_offset, size);
+    return BM_SUCCESS;
+}
+
+bm_status_t bm_memset_device(bm_handle_t handle, const int value, bm_device_mem_t mem)
+{
+    if(!memPtr(mem)) return BM_ERR_PARAM;
+    // value is a 32-bit pattern
+    auto data = (int*)memPtr(mem);
+    for(size_t i=0; i<mem.size/sizeof(int); i++) data[i] = value;
+    return BM_SUCCESS;
+}
+
+bm_status_t bm_thread_sync(bm_handle_t handle)
+{
+    // launches are synchronous in the simulator
+    return BM_SUCCESS;
+}
+
+}
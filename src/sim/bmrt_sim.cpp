@@ -0,0 +1,318 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <thread>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <memory>
+#include "bmruntime_interface.h"
+#include "BMSimDevice.h"
+
+// A simulated bmodel is a text file, one network per 'net' line:
+//   # comment
+//   net resnet50
+//   latency_us normal:5000,500
+//   input data int8 0.0078125 4x3x224x224
+//   output prob float32 1 4x1000
+// latency_us is optional and overrides BMSERVICE_SIM_LATENCY_US for the network.
+
+namespace bm {
+namespace sim {
+
+struct Network {
+    std::string name;
+    std::vector<std::string> inputNames;
+    std::vector<std::string> outputNames;
+    std::vector<const char*> inputNamePtrs;
+    std::vector<const char*> outputNamePtrs;
+    std::vector<bm_data_type_t> inputDtypes;
+    std::vector<bm_data_type_t> outputDtypes;
+    std::vector<float> inputScales;
+    std::vector<float> outputScales;
+    std::vector<bm_shape_t> inputShapes;
+    std::vector<bm_shape_t> outputShapes;
+    std::vector<size_t> maxInputBytes;
+    std::vector<size_t> maxOutputBytes;
+    bm_stage_info_t stage;
+    bm_net_info_t info;
+    LatencyDistribution latency;
+
+    // pointers in info refer to the vectors, so it is built after all of them are filled
+    void build() {
+        inputNamePtrs.clear();
+        outputNamePtrs.clear();
+        for(auto& n: inputNames) inputNamePtrs.push_back(n.c_str());
+        for(auto& n: outputNames) outputNamePtrs.push_back(n.c_str());
+        maxInputBytes.clear();
+        maxOutputBytes.clear();
+        for(size_t i=0; i<inputShapes.size(); i++){
+            maxInputBytes.push_back(bmrt_shape_count(&inputShapes[i])*bmrt_data_type_size(inputDtypes[i]));
+        }
+        for(size_t i=0; i<outputShapes.size(); i++){
+            maxOutputBytes.push_back(bmrt_shape_count(&outputShapes[i])*bmrt_data_type_size(outputDtypes[i]));
+        }
+        stage.input_shapes = inputShapes.data();
+        stage.output_shapes = outputShapes.data();
+        memset(&info, 0, sizeof(info));
+        info.name = name.c_str();
+        info.is_dynamic = false;
+        info.input_num = inputNames.size();
+        info.input_names = inputNamePtrs.data();
+        info.input_dtypes = inputDtypes.data();
+        info.input_scales = inputScales.data();
+        info.output_num = outputNames.size();
+        info.output_names = outputNamePtrs.data();
+        info.output_dtypes = outputDtypes.data();
+        info.output_scales = outputScales.data();
+        info.stage_num = 1;
+        info.stages = &stage;
+        info.max_input_bytes = maxInputBytes.data();
+        info.max_output_bytes = maxOutputBytes.data();
+    }
+};
+
+struct Runtime {
+    bm_handle_t handle;
+    std::vector<std::unique_ptr<Network>> nets;
+    Network* find(const char* name) {
+        for(auto& net: nets){
+            if(net->name == name) return net.get();
+        }
+        return nullptr;
+    }
+};
+
+static bool parseDtype(const std::string& str, bm_data_type_t& dtype) {
+    static const char* names[] = {"float32", "float16", "int8", "uint8", "int16", "uint16", "int32", "uint32", "bfloat16"};
+    for(size_t i=0; i<sizeof(names)/sizeof(names[0]); i++){
+        if(str == names[i]){
+            dtype = (bm_data_type_t)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool parseShape(const std::string& str, bm_shape_t& shape) {
+    memset(&shape, 0, sizeof(shape));
+    std::istringstream iss(str);
+    std::string dim;
+    while(std::getline(iss, dim, 'x')){
+        if(dim.empty() || shape.num_dims >= BM_MAX_DIMS_NUM) return false;
+        shape.dims[shape.num_dims++] = atoi(dim.c_str());
+        if(shape.dims[shape.num_dims-1] <= 0) return false;
+    }
+    return shape.num_dims>0;
+}
+
+static bool parseModel(const std::string& text, std::vector<std::unique_ptr<Network>>& nets) {
+    std::istringstream lines(text);
+    std::string line;
+    size_t lineNo = 0;
+    while(std::getline(lines, line)){
+        lineNo++;
+        std::istringstream iss(line);
+        std::string key;
+        if(!(iss >> key) || key[0] == '#') continue;
+        bool ok = true;
+        if(key == "net"){
+            nets.emplace_back(new Network);
+            nets.back()->latency = config().latency;
+            ok = (bool)(iss >> nets.back()->name);
+        } else if(nets.empty()){
+            ok = false;
+        } else if(key == "latency_us"){
+            std::string spec;
+            ok = (iss >> spec) && LatencyDistribution::parse(spec, nets.back()->latency);
+        } else if(key == "input" || key == "output"){
+            std::string name, dtypeStr, shapeStr;
+            float scale = 1;
+            bm_data_type_t dtype;
+            bm_shape_t shape;
+            ok = (iss >> name >> dtypeStr >> scale >> shapeStr) &&
+                    parseDtype(dtypeStr, dtype) && parseShape(shapeStr, shape);
+            if(ok){
+                auto& net = *nets.back();
+                (key == "input"? net.inputNames: net.outputNames).push_back(name);
+                (key == "input"? net.inputDtypes: net.outputDtypes).push_back(dtype);
+                (key == "input"? net.inputScales: net.outputScales).push_back(scale);
+                (key == "input"? net.inputShapes: net.outputShapes).push_back(shape);
+            }
+        } else {
+            ok = false;
+        }
+        if(!ok){
+            fprintf(stderr, "[bmsim] invalid model line %d: %s\n", (int)lineNo, line.c_str());
+            return false;
+        }
+    }
+    for(auto& net: nets){
+        if(net->inputNames.empty() || net->outputNames.empty()){
+            fprintf(stderr, "[bmsim] network '%s' has no input or output\n", net->name.c_str());
+            return false;
+        }
+        net->build();
+    }
+    return !nets.empty();
+}
+
+}
+}
+
+using namespace bm::sim;
+
+extern "C" {
+
+void* bmrt_create(bm_handle_t bm_handle)
+{
+    if(!getDevice(bm_handle)) return nullptr;
+    auto runtime = new Runtime;
+    runtime->handle = bm_handle;
+    return runtime;
+}
+
+void bmrt_destroy(void* p_bmrt)
+{
+    delete (Runtime*)p_bmrt;
+}
+
+void* bmrt_get_bm_handle(void* p_bmrt)
+{
+    return ((Runtime*)p_bmrt)->handle;
+}
+
+bool bmrt_load_bmodel_data(void* p_bmrt, const void * bmodel_data, size_t size)
+{
+    auto runtime = (Runtime*)p_bmrt;
+    std::vector<std::unique_ptr<Network>> nets;
+    if(!parseModel(std::string((const char*)bmodel_data, size), nets)){
+        fprintf(stderr, "[bmsim] not a simulated bmodel, see src/sim/bmrt_sim.cpp for the format\n");
+        return false;
+    }
+    for(auto& net: nets){
+        if(runtime->find(net->name.c_str())){
+            fprintf(stderr, "[bmsim] network '%s' is already loaded\n", net->name.c_str());
+            return false;
+        }
+    }
+    for(auto& net: nets){
+        runtime->nets.push_back(std::move(net));
+    }
+    return true;
+}
+
+bool bmrt_load_bmodel(void* p_bmrt, const char *bmodel_path)
+{
+    std::ifstream ifs(bmodel_path);
+    if(!ifs) return false;
+    std::stringstream ss;
+    ss << ifs.rdbuf();
+    auto text = ss.str();
+    return bmrt_load_bmodel_data(p_bmrt, text.data(), text.size());
+}
+
+int bmrt_get_network_number(void* p_bmrt)
+{
+    return ((Runtime*)p_bmrt)->nets.size();
+}
+
+void bmrt_get_network_names(void* p_bmrt, const char*** network_names)
+{
+    auto runtime = (Runtime*)p_bmrt;
+    auto names = (const char**)malloc(sizeof(const char*)*(runtime->nets.size()+1));
+    for(size_t i=0; i<runtime->nets.size(); i++){
+        names[i] = runtime->nets[i]->name.c_str();
+    }
+    *network_names = names;
+}
+
+const bm_net_info_t* bmrt_get_network_info(void* p_bmrt, const char* net_name)
+{
+    auto net = ((Runtime*)p_bmrt)->find(net_name);
+    return net? &net->info: nullptr;
+}
+
+bool bmrt_launch_tensor_ex(void* p_bmrt, const char * net_name, const bm_tensor_t input_tensors[], int input_num,
+                           bm_tensor_t output_tensors[], int output_num, bool user_mem, bool user_stmode)
+{
+    auto runtime = (Runtime*)p_bmrt;
+    auto net = runtime->find(net_name);
+    auto device = getDevice(runtime->handle);
+    if(!net || !device || input_num != net->info.input_num || output_num != net->info.output_num){
+        return false;
+    }
+    // without user_stmode every tensor is taken as BM_STORE_1N, as bmrt does
+    for(int i=0; i<input_num; i++){
+        auto tensor = input_tensors[i];
+        if(!user_stmode) tensor.st_mode = BM_STORE_1N;
+        if(bm_mem_get_device_size(tensor.device_mem) < bmrt_tensor_device_size(&tensor)){
+            fprintf(stderr, "[bmsim] input #%d of '%s' is smaller than its shape\n", i, net_name);
+            return false;
+        }
+    }
+    for(int i=0; i<output_num; i++){
+        auto& tensor = output_tensors[i];
+        tensor.dtype = net->outputDtypes[i];
+        if(!user_stmode) tensor.st_mode = BM_STORE_1N;
+        auto bytes = bmrt_tensor_device_size(&tensor);
+        if(!user_mem || bm_mem_get_device_size(tensor.device_mem) == 0){
+            if(bm_malloc_device_byte(runtime->handle, &tensor.device_mem, bytes) != BM_SUCCESS) return false;
+        } else if(bm_mem_get_device_size(tensor.device_mem) < bytes){
+            fprintf(stderr, "[bmsim] output #%d of '%s' is smaller than its shape\n", i, net_name);
+            return false;
+        }
+    }
+    std::lock_guard<std::mutex> guard(device->computeMutex);
+    auto start = std::chrono::steady_clock::now();
+    auto latencyUs = net->latency.sample(device->rng);
+    // outputs do not depend on inputs, zeros keep the post-processing deterministic
+    for(int i=0; i<output_num; i++){
+        memset(memPtr(output_tensors[i].device_mem), 0, bmrt_tensor_device_size(&output_tensors[i]));
+    }
+    std::this_thread::sleep_until(start + std::chrono::microseconds((long long)latencyUs));
+    return true;
+}
+
+uint64_t bmrt_shape_count(const bm_shape_t* shape)
+{
+    uint64_t count = 1;
+    for(int i=0; i<shape->num_dims; i++){
+        count *= shape->dims[i];
+    }
+    return count;
+}
+
+size_t bmrt_data_type_size(bm_data_type_t dtype)
+{
+    switch(dtype){
+    case BM_FLOAT32:
+    case BM_INT32:
+    case BM_UINT32:
+        return 4;
+    case BM_FLOAT16:
+    case BM_BFLOAT16:
+    case BM_INT16:
+    case BM_UINT16:
+        return 2;
+    default:
+        return 1;
+    }
+}
+
+size_t bmrt_tensor_bytesize(const bm_tensor_t* tensor)
+{
+    return bmrt_shape_count(&tensor->shape)*bmrt_data_type_size(tensor->dtype);
+}
+
+size_t bmrt_tensor_device_size(const bm_tensor_t* tensor)
+{
+    auto bytes = bmrt_tensor_bytesize(tensor);
+    if(tensor->st_mode == BM_STORE_1N || tensor->shape.num_dims == 0) return bytes;
+    size_t n = tensor->shape.dims[0];
+    size_t align = tensor->st_mode == BM_STORE_4N? 4: 2;
+    return bytes/n*((n + align - 1)/align*align);
+}
+
+}
@@ -0,0 +1,158 @@
+#ifndef BMCV_API_H
+#define BMCV_API_H
+
+// Simulated bmcv: the subset of libbmcv used by BMService, built with -DBM_SIMULATE=ON.
+// Images are processed on the host, which is enough to run the pipelines but not to measure bmcv.
+
+#include <stdbool.h>
+#include "bmlib_runtime.h"
+
+#ifdef __cplusplus
+#define BMCV_DEFAULT(value) = value
+extern "C" {
+#else
+#define BMCV_DEFAULT(value)
+#endif
+
+#ifndef FFALIGN
+#define FFALIGN(x, a) (((x) + (a)-1) & ~((a)-1))
+#endif
+
+#define BMCV_HEAP0_ID 0
+#define BMCV_HEAP1_ID 1
+#define BMCV_HEAP_ANY 2
+#define BMCV_IMAGE_FOR_IN BMCV_HEAP1_ID
+#define BMCV_IMAGE_FOR_OUT BMCV_HEAP0_ID
+
+typedef enum bm_image_format_ext_ {
+    FORMAT_YUV420P,
+    FORMAT_YUV422P,
+    FORMAT_YUV444P,
+    FORMAT_NV12,
+    FORMAT_NV21,
+    FORMAT_NV16,
+    FORMAT_NV61,
+    FORMAT_NV24,
+    FORMAT_RGB_PLANAR,
+    FORMAT_BGR_PLANAR,
+    FORMAT_RGB_PACKED,
+    FORMAT_BGR_PACKED,
+    FORMAT_RGBP_SEPARATE,
+    FORMAT_BGRP_SEPARATE,
+    FORMAT_GRAY,
+    FORMAT_COMPRESSED
+} bm_image_format_ext;
+
+typedef enum bm_image_data_format_ext_ {
+    DATA_TYPE_EXT_FLOAT32,
+    DATA_TYPE_EXT_1N_BYTE,
+    DATA_TYPE_EXT_4N_BYTE,
+    DATA_TYPE_EXT_1N_BYTE_SIGNED,
+    DATA_TYPE_EXT_4N_BYTE_SIGNED
+} bm_image_data_format_ext;
+
+typedef enum bmcv_resize_algorithm_ {
+    BMCV_INTER_NEAREST = 0,
+    BMCV_INTER_LINEAR = 1,
+    BMCV_INTER_BICUBIC = 2
+} bmcv_resize_algorithm;
+
+struct bm_image_private;
+
+typedef struct bm_image {
+    int width;
+    int height;
+    bm_image_format_ext image_format;
+    bm_image_data_format_ext data_type;
+    struct bm_image_private *image_private;
+} bm_image;
+
+typedef struct {
+    unsigned char r;
+    unsigned char g;
+    unsigned char b;
+} bmcv_color_t;
+
+typedef struct bmcv_rect {
+    int start_x;
+    int start_y;
+    int crop_w;
+    int crop_h;
+} bmcv_rect_t;
+
+typedef struct bmcv_convert_to_attr_s {
+    float alpha_0;
+    float beta_0;
+    float alpha_1;
+    float beta_1;
+    float alpha_2;
+    float beta_2;
+} bmcv_convert_to_attr;
+
+typedef struct bmcv_padding_atrr_s {
+    unsigned int dst_crop_stx;
+    unsigned int dst_crop_sty;
+    unsigned int dst_crop_w;
+    unsigned int dst_crop_h;
+    unsigned char padding_r;
+    unsigned char padding_g;
+    unsigned char padding_b;
+    int if_memset;
+} bmcv_padding_atrr_t;
+
+typedef struct bmcv_copy_to_atrr_s {
+    int start_x;
+    int start_y;
+    unsigned char padding_r;
+    unsigned char padding_g;
+    unsigned char padding_b;
+    int if_padding;
+} bmcv_copy_to_atrr_t;
+
+bm_status_t bm_image_create(bm_handle_t handle, int img_h, int img_w,
+                            bm_image_format_ext image_format, bm_image_data_format_ext data_type,
+                            bm_image *image, int *stride BMCV_DEFAULT(NULL));
+bm_status_t bm_image_destroy(bm_image image);
+bm_handle_t bm_image_get_handle(bm_image *image);
+int bm_image_get_plane_num(bm_image image);
+bm_status_t bm_image_get_stride(bm_image image, int *stride);
+bm_status_t bm_image_get_byte_size(bm_image image, int *size);
+bm_status_t bm_image_get_device_mem(bm_image image, bm_device_mem_t *mem);
+bool bm_image_is_attached(bm_image image);
+
+bm_status_t bm_image_alloc_dev_mem(bm_image image, int heap_id BMCV_DEFAULT(BMCV_HEAP_ANY));
+bm_status_t bm_image_attach(bm_image image, bm_device_mem_t *device_memory);
+bm_status_t bm_image_detach(bm_image image);
+bm_status_t bm_image_alloc_contiguous_mem(int image_num, bm_image *images, int heap_id BMCV_DEFAULT(BMCV_HEAP_ANY));
+bm_status_t bm_image_free_contiguous_mem(int image_num, bm_image *images);
+bm_status_t bm_image_attach_contiguous_mem(int image_num, bm_image *images, bm_device_mem_t dmem);
+bm_status_t bm_image_dettach_contiguous_mem(int image_num, bm_image *images);
+bm_status_t bm_image_get_contiguous_device_mem(int image_num, bm_image *images, bm_device_mem_t *mem);
+
+bm_status_t bm_image_copy_host_to_device(bm_image image, void *buffers[]);
+bm_status_t bm_image_copy_device_to_host(bm_image image, void *buffers[]);
+
+bm_status_t bmcv_image_convert_to(bm_handle_t handle, int input_num, bmcv_convert_to_attr convert_to_attr,
+                                  bm_image *input, bm_image *output);
+bm_status_t bmcv_image_storage_convert(bm_handle_t handle, int image_num, bm_image *input, bm_image *output);
+bm_status_t bmcv_image_copy_to(bm_handle_t handle, bmcv_copy_to_atrr_t copy_to_attr, bm_image input, bm_image output);
+bm_status_t bmcv_image_vpp_basic(bm_handle_t handle, int in_img_num, bm_image *input, bm_image *output,
+                                 int *crop_num_vec BMCV_DEFAULT(NULL),
+                                 bmcv_rect_t *crop_rect BMCV_DEFAULT(NULL),
+                                 bmcv_padding_atrr_t *padding_attr BMCV_DEFAULT(NULL),
+                                 bmcv_resize_algorithm algorithm BMCV_DEFAULT(BMCV_INTER_LINEAR));
+bm_status_t bmcv_image_vpp_convert(bm_handle_t handle, int output_num, bm_image input, bm_image *output,
+                                   bmcv_rect_t *crop_rect BMCV_DEFAULT(NULL),
+                                   bmcv_resize_algorithm algorithm BMCV_DEFAULT(BMCV_INTER_LINEAR));
+bm_status_t bmcv_image_vpp_convert_padding(bm_handle_t handle, int output_num, bm_image input, bm_image *output,
+                                           bmcv_padding_atrr_t *padding_attr,
+                                           bmcv_rect_t *crop_rect BMCV_DEFAULT(NULL),
+                                           bmcv_resize_algorithm algorithm BMCV_DEFAULT(BMCV_INTER_LINEAR));
+
+#ifdef __cplusplus
+}
+#endif
+
+#undef BMCV_DEFAULT
+
+#endif // BMCV_API_H
@@ -0,0 +1,90 @@
+#ifndef BMRUNTIME_INTERFACE_H
+#define BMRUNTIME_INTERFACE_H
+
+// Simulated bmruntime: the subset of libbmrt used by BMService, built with -DBM_SIMULATE=ON.
+// A simulated "bmodel" is a text file describing the networks, see src/sim/bmrt_sim.cpp
+
+#include "bmlib_runtime.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum bm_data_type_e {
+    BM_FLOAT32 = 0,
+    BM_FLOAT16 = 1,
+    BM_INT8 = 2,
+    BM_UINT8 = 3,
+    BM_INT16 = 4,
+    BM_UINT16 = 5,
+    BM_INT32 = 6,
+    BM_UINT32 = 7,
+    BM_BFLOAT16 = 8
+} bm_data_type_t;
+
+typedef enum bm_store_mode_e {
+    BM_STORE_1N = 0,
+    BM_STORE_2N = 1,
+    BM_STORE_4N = 2
+} bm_store_mode_t;
+
+#define BM_MAX_DIMS_NUM 8
+
+typedef struct bm_shape_s {
+    int num_dims;
+    int dims[BM_MAX_DIMS_NUM];
+} bm_shape_t;
+
+typedef struct bm_tensor_s {
+    bm_data_type_t dtype;
+    bm_shape_t shape;
+    bm_device_mem_t device_mem;
+    bm_store_mode_t st_mode;
+} bm_tensor_t;
+
+typedef struct bm_stage_info_s {
+    bm_shape_t *input_shapes;
+    bm_shape_t *output_shapes;
+} bm_stage_info_t;
+
+typedef struct bm_net_info_s {
+    const char* name;
+    bool is_dynamic;
+    int input_num;
+    char const** input_names;
+    bm_data_type_t* input_dtypes;
+    float* input_scales;
+    int output_num;
+    char const** output_names;
+    bm_data_type_t* output_dtypes;
+    float* output_scales;
+    int stage_num;
+    bm_stage_info_t* stages;
+    size_t* max_input_bytes;
+    size_t* max_output_bytes;
+} bm_net_info_t;
+
+void* bmrt_create(bm_handle_t bm_handle);
+void bmrt_destroy(void* p_bmrt);
+void* bmrt_get_bm_handle(void* p_bmrt);
+bool bmrt_load_bmodel(void* p_bmrt, const char *bmodel_path);
+bool bmrt_load_bmodel_data(void* p_bmrt, const void * bmodel_data, size_t size);
+int bmrt_get_network_number(void* p_bmrt);
+// the names array is allocated by malloc, and should be released by free
+void bmrt_get_network_names(void* p_bmrt, const char*** network_names);
+const bm_net_info_t* bmrt_get_network_info(void* p_bmrt, const char* net_name);
+bool bmrt_launch_tensor_ex(void* p_bmrt, const char * net_name, const bm_tensor_t input_tensors[], int input_num,
+                           bm_tensor_t output_tensors[], int output_num, bool user_mem, bool user_stmode);
+
+uint64_t bmrt_shape_count(const bm_shape_t* shape);
+size_t bmrt_data_type_size(bm_data_type_t dtype);
+size_t bmrt_tensor_bytesize(const bm_tensor_t* tensor);
+size_t bmrt_tensor_device_size(const bm_tensor_t* tensor);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BMRUNTIME_INTERFACE_H
@@ -1,8 +1,11 @@
 #include <fstream>
 #include "jsonxx.h"
+#ifndef BM_SIM_WITHOUT_OPENCV
 #include "opencv2/opencv.hpp"
+#endif
 #include "BMCommonUtils.h"
 #include "BMDetectUtils.h"
+#include "BMImageUtils.h"
 #include "BMLog.h"
 
 namespace  bm {
@@ -150,10 +153,17 @@ std::map<std::string, std::vector<DetectBox> > readCocoDatasetBBox(const std::st
 
 void drawDetectBoxEx(bm_image &bmImage, const std::vector<DetectBox> &boxes, const std::vector<DetectBox> &trueBoxes, const std::string &saveName)
 {
+#ifdef BM_SIM_WITHOUT_OPENCV
+    BMLOG(WARNING, "cannot draw boxes to '%s': built without OpenCV", saveName.c_str());
+#else
     //Draw a rectangle displaying the bounding box
     cv::Mat cvImage;
+#ifdef BM_SIMULATE
+    simImageToMat(bmImage, cvImage);
+#else
     auto status =cv::bmcv::toMAT(&bmImage, cvImage, true);
     BM_ASSERT_EQ(status, BM_SUCCESS);
+#endif
 
     size_t borderWidth = 2;
     if(!trueBoxes.empty()){
@@ -206,7 +216,7 @@ void drawDetectBoxEx(bm_image &bmImage, const std::vector<DetectBox> &boxes, con
         fullPath = fullPath.substr(fullPath.size()-4-8);
     }
     cv::imwrite(fullPath, cvImage);
-
+#endif
 }
 
 void drawDetectBox(bm_image &bmImage, const std::vector<DetectBox> &boxes, const std::string &saveName)   // Draw the predicted bounding box
@@ -1,7 +1,9 @@
 #include <stdio.h>
 #include <math.h>
 #include<vector>
+#ifndef BM_SIM_WITHOUT_OPENCV
 #include <opencv2/opencv.hpp>
+#endif
 #include <fstream>
 #include <cassert>
 #include "BMImageUtils.h"
@@ -89,8 +91,69 @@ std::vector<int> calcImageStride(int height, int width,
     }
     return stride;
 }
+#if defined(BM_SIMULATE) && !defined(BM_SIM_WITHOUT_OPENCV)
+void simImageToMat(bm_image &bmImage, cv::Mat &cvImage)
+{
+    auto handle = bm_image_get_handle(&bmImage);
+    bm_image bgrImage;
+    bm_image_create(handle, bmImage.height, bmImage.width, FORMAT_BGR_PACKED, DATA_TYPE_EXT_1N_BYTE, &bgrImage);
+    bm_image_alloc_dev_mem(bgrImage, BMCV_IMAGE_FOR_OUT);
+    auto ret = bmcv_image_storage_convert(handle, 1, &bmImage, &bgrImage);
+    BM_ASSERT_EQ(ret, BM_SUCCESS);
+    cvImage.create(bmImage.height, bmImage.width, CV_8UC3);
+    void* buffers[] = {cvImage.data};
+    bm_image_copy_device_to_host(bgrImage, buffers);
+    bm_image_destroy(bgrImage);
+}
+#endif
+
+#ifndef BM_SIM_WITHOUT_OPENCV
+// uploads a BGR image decoded on host with aligned stride
+static bm_image uploadAlignedImage(bm_handle_t handle, const cv::Mat& cvImage)
+{
+    bm_image alignedImage;
+    int stride[3] = {FFALIGN(cvImage.cols*3, 64), 0, 0};
+    bm_image_create(handle, cvImage.rows, cvImage.cols, FORMAT_BGR_PACKED, DATA_TYPE_EXT_1N_BYTE,
+                    &alignedImage, stride);
+    bm_image_alloc_dev_mem(alignedImage, BMCV_IMAGE_FOR_IN);
+    std::vector<unsigned char> buffer((size_t)stride[0]*cvImage.rows);
+    for(int row=0; row<cvImage.rows; row++){
+        memcpy(&buffer[(size_t)row*stride[0]], cvImage.ptr(row), cvImage.cols*3);
+    }
+    void* buffers[] = {buffer.data()};
+    bm_image_copy_host_to_device(alignedImage, buffers);
+    return alignedImage;
+}
+#endif
+
+bool decodeAlignedImage(bm_handle_t handle, const void *data, size_t size, bm_image &image)
+{
+#if defined(BM_SIM_WITHOUT_OPENCV)
+    BMLOG(ERROR, "cannot decode images: built without OpenCV");
+    return false;
+#else
+    cv::Mat buffer(1, size, CV_8UC1, (void*)data);
+    auto cvImage = cv::imdecode(buffer, cv::ImreadModes::IMREAD_COLOR);
+    if(cvImage.empty()){
+        BMLOG(ERROR, "cannot decode the image of %d bytes", size);
+        return false;
+    }
+    image = uploadAlignedImage(handle, cvImage);
+    return true;
+#endif
+}
+
 bm_image readAlignedImage(bm_handle_t handle, const std::string &name)
 {
+#if defined(BM_SIM_WITHOUT_OPENCV)
+    BMLOG(FATAL, "cannot read '%s': built without OpenCV", name.c_str());
+    return bm_image();
+#elif defined(BM_SIMULATE)
+    // the simulated bmcv has no cv::bmcv, decode on host and upload with aligned stride
+    auto cvImage = cv::imread(name, cv::ImreadModes::IMREAD_COLOR);
+    BM_ASSERT(!cvImage.empty(), "cannot read '%s'", name.c_str());
+    return uploadAlignedImage(handle, cvImage);
+#else
 //    TimeRecorder r;
 //    r.record("read");
     auto cvImage = cv::imread(name, cv::ImreadModes::IMREAD_COLOR, cv::bmcv::getId(handle));
@@ -119,6 +182,7 @@ bm_image readAlignedImage(bm_handle_t handle, const std::string &name)
     bm_image_destroy(bmImage);
 //    r.show();
     return alignedImage;
+#endif
 }
 
 void centralCropAndResize(bm_handle_t handle,
@@ -176,9 +240,17 @@ void dumpImage(bm_image& bmImage, const std::string& name){
 }
 
 void saveImage(bm_image& bmImage, const std::string& name){
+#if defined(BM_SIM_WITHOUT_OPENCV)
+    BMLOG(WARNING, "cannot save '%s': built without OpenCV", name.c_str());
+#else
     cv::Mat cvImage;
+#ifdef BM_SIMULATE
+    simImageToMat(bmImage, cvImage);
+#else
     cv::bmcv::toMAT(&bmImage, cvImage);
+#endif
     cv::imwrite(name, cvImage);
+#endif
 }
 
 static bool split_id_and_label(const std::string& line, size_t& id, std::string& label){
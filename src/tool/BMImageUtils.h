@@ -4,6 +4,10 @@
 #include<map>
 #include "bmcv_api.h"
 
+#if defined(BM_SIMULATE) && !defined(BM_SIM_WITHOUT_OPENCV)
+namespace cv { class Mat; }
+#endif
+
 //#define FFALIGN(x, n) ((((x)+((n)-1))/(n))*(n))
 
 namespace bm {
@@ -14,6 +18,8 @@ std::vector<int> calcImageStride(
         int align_bytes = 1);
 
 bm_image readAlignedImage(bm_handle_t handle, const std::string& name);
+// decodes jpeg/png/... bytes on host into an aligned BGR image, returns false for broken data
+bool decodeAlignedImage(bm_handle_t handle, const void* data, size_t size, bm_image& image);
 
 // for inceptionv3
 void centralCropAndResize(bm_handle_t handle,
@@ -27,6 +33,10 @@ void aspectScaleAndPad(bm_handle_t handle,
                           bmcv_color_t padColor);
 
 void saveImage(bm_image& bmImage, const std::string& name = "image.jpg");
+#if defined(BM_SIMULATE) && !defined(BM_SIM_WITHOUT_OPENCV)
+// the simulated bmcv has no cv::bmcv::toMAT, converts to a BGR Mat through host memory
+void simImageToMat(bm_image& bmImage, cv::Mat& cvImage);
+#endif
 void dumpImage(bm_image& bmImage, const std::string& name = "image.txt");
 
 std::map<size_t, std::string> loadLabels(const std::string& filename);
@@ -0,0 +1,61 @@
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+#include "BMCommonUtils.h"
+
+using namespace bm;
+
+TEST(LatencyHistogramTest, bucketBounds)
+{
+    for(uint64_t v: {0ull, 1ull, 31ull, 32ull, 33ull, 100ull, 1000ull, 123456ull, 1ull<<35}){
+        auto index = LatencyHistogram::bucketIndex(v);
+        ASSERT_LT(index, LatencyHistogram::BUCKET_NUM);
+        auto upper = LatencyHistogram::bucketValue(index);
+        ASSERT_GE(upper, v);
+        // relative error is bounded by the sub-bucket resolution
+        ASSERT_LE(upper - v, v >> LatencyHistogram::SUB_BITS);
+        if(index > 0){
+            ASSERT_LT(LatencyHistogram::bucketValue(index-1), v);
+        }
+    }
+}
+
+TEST(LatencyHistogramTest, percentiles)
+{
+    LatencyHistogram hist;
+    for(uint64_t v=1; v<=1000; v++){
+        hist.record(v);
+    }
+    ASSERT_EQ(hist.count(), 1000);
+    ASSERT_EQ(hist.sum(), 500500);
+    ASSERT_EQ(hist.max(), 1000);
+    auto p50 = hist.percentile(50);
+    ASSERT_GE(p50, 500);
+    ASSERT_LE(p50, 500 + 500/32);
+    ASSERT_GE(hist.percentile(99.9), 999);
+    ASSERT_EQ(hist.percentile(100), 1000);
+    LatencyHistogram empty;
+    ASSERT_EQ(empty.percentile(50), 0);
+}
+
+TEST(LatencyHistogramTest, mergeThreads)
+{
+    const size_t threadNum = 4;
+    std::vector<std::unique_ptr<LatencyHistogram>> hists;
+    std::vector<std::thread> threads;
+    for(size_t t=0; t<threadNum; t++){
+        hists.emplace_back(new LatencyHistogram);
+        auto hist = hists.back().get();
+        threads.emplace_back([hist, t](){
+            for(uint64_t v=0; v<10000; v++) hist->record(t*10000 + v);
+        });
+    }
+    for(auto& t: threads) t.join();
+    LatencyHistogram merged;
+    for(auto& h: hists) merged.merge(*h);
+    ASSERT_EQ(merged.count(), threadNum*10000);
+    ASSERT_EQ(merged.max(), threadNum*10000-1);
+    auto p50 = merged.percentile(50);
+    ASSERT_GE(p50, 19999);
+    ASSERT_LE(p50, 19999 + 19999/32);
+}
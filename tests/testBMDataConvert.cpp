@@ -0,0 +1,190 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <vector>
+#include "BMDataConvert.h"
+
+using namespace bm;
+
+static std::vector<SimdLevel> supportedLevels()
+{
+    std::vector<SimdLevel> levels;
+    for(auto level: {SIMD_SSE4, SIMD_AVX2, SIMD_AVX512, SIMD_NEON}){
+        if(isSimdSupported(level)) levels.push_back(level);
+    }
+    return levels;
+}
+
+template<typename T>
+static void checkDequantize()
+{
+    std::mt19937 rng(3);
+    std::vector<T> src(4099);
+    for(auto& v: src) v = (T)rng();
+    std::vector<float> expected(src.size()), actual(src.size());
+    // 1.f/3 and the small scale are not exactly representable, products round differently from a fused op
+    for(float scale: {1.f, 0.0078125f, 1.f/3, -0.75f, 1.2345e-30f}){
+        for(auto level: supportedLevels()){
+            // odd offsets and lengths cover unaligned loads and all tail sizes
+            for(size_t offset: {0, 1, 7}){
+                for(size_t num: {0, 1, 15, 16, 17, 31, 33, 64, 100, 4092}){
+                    dequantize(src.data()+offset, expected.data(), num, scale, SIMD_SCALAR);
+                    std::fill(actual.begin(), actual.end(), -1.f);
+                    dequantize(src.data()+offset, actual.data(), num, scale, level);
+                    ASSERT_EQ(0, memcmp(expected.data(), actual.data(), num*sizeof(float)))
+                            << simdLevelName(level) << " scale=" << scale << " offset=" << offset << " num=" << num;
+                    EXPECT_EQ(actual[num], -1.f);
+                }
+            }
+        }
+    }
+}
+
+TEST(BMDataConvertTest, dequantizeInt8)
+{
+    checkDequantize<int8_t>();
+}
+
+TEST(BMDataConvertTest, dequantizeUint8)
+{
+    checkDequantize<uint8_t>();
+}
+
+TEST(BMDataConvertTest, levels)
+{
+    EXPECT_TRUE(isSimdSupported(SIMD_SCALAR));
+    EXPECT_TRUE(isSimdSupported(getSimdLevel()));
+    EXPECT_STREQ(simdLevelName(SIMD_AVX2), "avx2");
+}
+
+static std::vector<float> specialFloats()
+{
+    std::vector<uint32_t> bits = {
+        0x00000000, 0x80000000, 0x3f800000, 0x7f800000, 0xff800000, // 0, -0, 1, inf, -inf
+        0x7fc00000, 0x7f800001, 0xffa5a5a5,                         // quiet and signaling NaNs
+        0x477fe000, 0x477fefff, 0x477ff000, 0x477ff001, 0x7f7fffff, // around the fp16 max 65504
+        0x38800000, 0x387fffff, 0x33800000, 0x33000000, 0x33000001, // fp16 min normal, subnormals, 2^-25
+        0x33c00000, 0x34200000, 0x00000001, 0x3f808000, 0x3f818000, // fp16 subnormal and bf16 ties
+    };
+    std::vector<float> values(bits.size());
+    memcpy(values.data(), bits.data(), bits.size()*sizeof(float));
+    std::mt19937 rng(5);
+    for(int i=0; i<4000; i++){
+        uint32_t b = rng();
+        float f;
+        memcpy(&f, &b, sizeof(f));
+        values.push_back(f);
+        // values in the fp16 range
+        values.push_back(std::uniform_real_distribution<float>(-70000, 70000)(rng));
+        values.push_back(std::uniform_real_distribution<float>(-1e-4f, 1e-4f)(rng));
+    }
+    return values;
+}
+
+TEST(BMDataConvertTest, fp16)
+{
+    std::vector<uint16_t> all(65536);
+    for(size_t i=0; i<all.size(); i++) all[i] = i;
+    std::vector<float> expected(all.size()), actual(all.size());
+    fp16ToFloat(all.data(), expected.data(), all.size(), SIMD_SCALAR);
+    EXPECT_EQ(expected[0x3c00], 1.f);
+    EXPECT_EQ(expected[0x7bff], 65504.f);
+    EXPECT_EQ(expected[0x0001], 5.9604645e-8f);
+    EXPECT_EQ(expected[0xc000], -2.f);
+    EXPECT_TRUE(std::isinf(expected[0x7c00]));
+
+    // every non-NaN half survives the round trip
+    std::vector<uint16_t> back(all.size());
+    floatToFp16(expected.data(), back.data(), back.size(), SIMD_SCALAR);
+    for(size_t i=0; i<all.size(); i++){
+        if((i & 0x7c00) == 0x7c00 && (i & 0x3ff)) continue;
+        ASSERT_EQ(back[i], all[i]) << i;
+    }
+
+    auto values = specialFloats();
+    std::vector<uint16_t> expectedHalf(values.size()), actualHalf(values.size());
+    floatToFp16(values.data(), expectedHalf.data(), values.size(), SIMD_SCALAR);
+    EXPECT_EQ(expectedHalf[10], 0x7c00);   // 65520 rounds to inf
+    EXPECT_EQ(expectedHalf[9], 0x7bff);
+    EXPECT_EQ(expectedHalf[16], 0);        // 2^-25 ties to even zero
+    EXPECT_EQ(expectedHalf[17], 1);
+    for(auto level: supportedLevels()){
+        fp16ToFloat(all.data(), actual.data(), all.size(), level);
+        ASSERT_EQ(0, memcmp(expected.data(), actual.data(), all.size()*sizeof(float))) << simdLevelName(level);
+        for(size_t offset: {0, 3}){
+            size_t num = values.size() - offset;
+            floatToFp16(values.data()+offset, actualHalf.data(), num, level);
+            ASSERT_EQ(0, memcmp(expectedHalf.data()+offset, actualHalf.data(), num*sizeof(uint16_t))) << simdLevelName(level);
+        }
+    }
+}
+
+TEST(BMDataConvertTest, bf16)
+{
+    std::vector<uint16_t> all(65536);
+    for(size_t i=0; i<all.size(); i++) all[i] = i;
+    std::vector<float> expected(all.size()), actual(all.size());
+    bf16ToFloat(all.data(), expected.data(), all.size(), SIMD_SCALAR);
+    EXPECT_EQ(expected[0x3f80], 1.f);
+
+    auto values = specialFloats();
+    std::vector<uint16_t> expectedBf16(values.size()), actualBf16(values.size());
+    floatToBf16(values.data(), expectedBf16.data(), values.size(), SIMD_SCALAR);
+    EXPECT_EQ(expectedBf16[2], 0x3f80);
+    EXPECT_EQ(expectedBf16[6], 0x7fc0);    // signaling NaN is quieted
+    EXPECT_EQ(expectedBf16[21], 0x3f80);   // tie rounds to even
+    EXPECT_EQ(expectedBf16[22], 0x3f82);
+    for(auto level: supportedLevels()){
+        bf16ToFloat(all.data(), actual.data(), all.size(), level);
+        ASSERT_EQ(0, memcmp(expected.data(), actual.data(), all.size()*sizeof(float))) << simdLevelName(level);
+        for(size_t offset: {0, 3}){
+            size_t num = values.size() - offset;
+            floatToBf16(values.data()+offset, actualBf16.data(), num, level);
+            ASSERT_EQ(0, memcmp(expectedBf16.data()+offset, actualBf16.data(), num*sizeof(uint16_t))) << simdLevelName(level);
+        }
+    }
+}
+
+template<typename T, size_t LANES>
+static void checkPack(void (*pack)(const T*, T*, size_t, size_t, SimdLevel),
+                      void (*unpack)(const T*, T*, size_t, size_t, SimdLevel))
+{
+    std::mt19937 rng(7);
+    for(size_t batch: {1, 2, 3, 4, 5, 7, 8, 9}){
+        for(size_t inner: {1, 7, 8, 15, 16, 17, 33, 150}){
+            size_t groups = (batch+LANES-1)/LANES;
+            std::vector<T> src(batch*inner);
+            for(auto& v: src) v = (T)rng();
+            std::vector<T> expected(groups*LANES*inner, (T)-1);
+            pack(src.data(), expected.data(), batch, inner, SIMD_SCALAR);
+            for(size_t b=0; b<groups*LANES; b++){
+                for(size_t i=0; i<inner; i++){
+                    T v = b<batch? src[b*inner+i]: 0;
+                    ASSERT_EQ(expected[((b/LANES)*inner+i)*LANES+b%LANES], v) << b << " " << i;
+                }
+            }
+            for(auto level: supportedLevels()){
+                std::vector<T> packed(expected.size(), (T)-1);
+                pack(src.data(), packed.data(), batch, inner, level);
+                ASSERT_EQ(packed, expected) << simdLevelName(level) << " batch=" << batch << " inner=" << inner;
+                // the padding samples are not written back
+                std::vector<T> back(src.size()+1, (T)-1);
+                unpack(packed.data(), back.data(), batch, inner, level);
+                ASSERT_EQ(0, memcmp(back.data(), src.data(), src.size()*sizeof(T)))
+                        << simdLevelName(level) << " batch=" << batch << " inner=" << inner;
+                EXPECT_EQ(back.back(), (T)-1);
+            }
+        }
+    }
+}
+
+TEST(BMDataConvertTest, pack4N)
+{
+    checkPack<uint8_t, 4>(pack4N, unpack4N);
+}
+
+TEST(BMDataConvertTest, pack2N)
+{
+    checkPack<uint16_t, 2>(pack2N, unpack2N);
+}
@@ -0,0 +1,270 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <fstream>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include "bmruntime_interface.h"
+#include "interface.h"
+
+static std::string writeModel(int latency_us)
+{
+    char path[] = "/tmp/testBMInterface_XXXXXX";
+    int fd = mkstemp(path);
+    close(fd);
+    std::ofstream(path) << "net slownet\n"
+                           "latency_us " << latency_us << "\n"
+                           "input data float32 1 1x4\n"
+                           "output prob float32 1 1x4\n";
+    return path;
+}
+
+// a network whose forward runs far longer than the watchdog timeout
+static std::string writeSlowModel()
+{
+    return writeModel(300000);
+}
+
+static unsigned int putTask(unsigned int runner)
+{
+    float data[4] = {1, 2, 3, 4};
+    tensor_data_t input = {};
+    input.dims = 2;
+    input.shape[0] = 1;
+    input.shape[1] = 4;
+    input.dtype = BM_FLOAT32;
+    input.data = (unsigned char*)data;
+    return runner_put_input(runner, 1, &input, 1);
+}
+
+static int waitTask(unsigned int runner, unsigned int task, unsigned int& valid)
+{
+    tensor_data_t* outputs = nullptr;
+    unsigned int num = 0;
+    valid = 1;
+    int res = runner_wait_task(runner, task, 5000, &outputs, &num, &valid);
+    if(res == 0) runner_release_output(num, outputs);
+    return res;
+}
+
+TEST(BMInterfaceTest, startInvalidModel)
+{
+    // its slot is given back, so the runners started later are not limited by it
+    for(int i=0; i<300; i++){
+        ASSERT_EQ(runner_start("/nonexistent.bmodel"), INVALID_RUNNER_ID);
+    }
+    auto path = writeModel(0);
+    auto runner = runner_start(path.c_str());
+    EXPECT_NE(runner, INVALID_RUNNER_ID);
+    runner_stop(runner);
+    unlink(path.c_str());
+}
+
+TEST(BMInterfaceTest, watchdogFailTask)
+{
+    auto path = writeSlowModel();
+    auto runner = runner_start(path.c_str());
+    runner_set_watchdog(runner, 50, 1);
+    auto start = std::chrono::steady_clock::now();
+    auto task = putTask(runner);
+    unsigned int valid;
+    // the failed output keeps the id of the stalled task
+    ASSERT_EQ(waitTask(runner, task, valid), 0);
+    EXPECT_EQ(valid, 0u);
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(250));
+    // the late result of the stalled task is discarded
+    runner_set_watchdog(runner, 0, 0);
+    auto next = putTask(runner);
+    ASSERT_EQ(waitTask(runner, next, valid), 0);
+    EXPECT_EQ(valid, 1u);
+    runner_stop(runner);
+    unlink(path.c_str());
+}
+
+TEST(BMInterfaceTest, watchdogFailDevice)
+{
+    auto path = writeSlowModel();
+    auto runner = runner_start(path.c_str());
+    runner_set_watchdog(runner, 50, 2);
+    auto stalled = putTask(runner);
+    auto waiting = putTask(runner);
+    unsigned int valid;
+    ASSERT_EQ(waitTask(runner, stalled, valid), 0);
+    EXPECT_EQ(valid, 0u);
+    // taken out of the forward queue of the failed device
+    ASSERT_EQ(waitTask(runner, waiting, valid), 0);
+    EXPECT_EQ(valid, 0u);
+    // the device takes tasks again once the stalled forward returns
+    runner_set_watchdog(runner, 0, 0);
+    unsigned int tasks[3];
+    for(auto& task: tasks) task = putTask(runner);
+    for(auto task: tasks){
+        ASSERT_EQ(waitTask(runner, task, valid), 0);
+        EXPECT_EQ(valid, 1u);
+    }
+    runner_stop(runner);
+    unlink(path.c_str());
+}
+
+TEST(BMInterfaceTest, getOutputIntoInvalidTask)
+{
+    auto path = writeSlowModel();
+    auto runner = runner_start(path.c_str());
+    auto first = putTask(runner);
+    float data[4] = {};
+    tensor_data_t input = {};
+    input.dims = 2;
+    input.shape[0] = 1;
+    input.shape[1] = 4;
+    input.dtype = BM_FLOAT32;
+    input.data = (unsigned char*)data;
+    // expires while the first task is in forward
+    auto expired = runner_put_input_with_timeout(runner, 1, &input, 1, 1);
+    float result[4];
+    tensor_data_t output = {};
+    output.data = (unsigned char*)result;
+    unsigned int capacity = sizeof(result);
+    unsigned int task = 0, valid = 0;
+    ASSERT_EQ(runner_get_output_into(runner, &task, &valid, &output, &capacity, 1), 1);
+    EXPECT_EQ(task, first);
+    EXPECT_EQ(valid, 1u);
+    // comes out without outputs, but with its id
+    ASSERT_EQ(runner_get_output_into(runner, &task, &valid, &output, &capacity, 1), 0);
+    EXPECT_EQ(task, expired);
+    EXPECT_EQ(valid, 0u);
+    runner_stop(runner);
+    EXPECT_EQ(runner_get_output_into(runner, &task, &valid, &output, &capacity, 1), -1);
+    unlink(path.c_str());
+}
+
+TEST(BMInterfaceTest, getOutputIntoCapacity)
+{
+    auto path = writeModel(1000);
+    auto runner = runner_start(path.c_str());
+    auto small = putTask(runner);
+    auto fitting = putTask(runner);
+    float result[4];
+    tensor_data_t output = {};
+    output.data = (unsigned char*)result;
+    unsigned int capacity = sizeof(result) - 1;
+    unsigned int task = 0, valid = 0;
+    // the shape tells the bytes needed
+    ASSERT_EQ(runner_get_output_into(runner, &task, &valid, &output, &capacity, 1), -3);
+    EXPECT_EQ(task, small);
+    ASSERT_EQ(output.dims, 2u);
+    EXPECT_EQ(output.shape[1], 4u);
+    capacity = sizeof(result);
+    ASSERT_EQ(runner_get_output_into(runner, &task, &valid, &output, &capacity, 1), 1);
+    EXPECT_EQ(task, fitting);
+    EXPECT_EQ(valid, 1u);
+    runner_stop(runner);
+    unlink(path.c_str());
+}
+
+TEST(BMInterfaceTest, cancel)
+{
+    auto path = writeSlowModel();
+    auto runner = runner_start(path.c_str());
+    auto first = putTask(runner);
+    auto second = putTask(runner);
+    // the second one waits for the forward of the first one
+    EXPECT_EQ(runner_cancel(runner, second), 0);
+    unsigned int valid;
+    ASSERT_EQ(waitTask(runner, second, valid), 0);
+    EXPECT_EQ(valid, 0u);
+    ASSERT_EQ(waitTask(runner, first, valid), 0);
+    EXPECT_EQ(valid, 1u);
+    EXPECT_EQ(runner_cancel(runner, first), -1);
+    EXPECT_EQ(runner_cancel(runner, second), -1);
+    runner_stop(runner);
+    unlink(path.c_str());
+}
+
+TEST(BMInterfaceTest, cancelManyInFlight)
+{
+    auto path = writeModel(0);
+    auto runner = runner_start(path.c_str());
+    // more tasks than the slots of the cancel table are kept unpopped
+    std::vector<unsigned int> tasks(4100);
+    for(auto& task: tasks) task = putTask(runner);
+    EXPECT_EQ(runner_cancel(runner, tasks.front()), 0);
+    EXPECT_EQ(runner_cancel(runner, tasks.back()), 0);
+    for(size_t i=0; i<tasks.size(); i++){
+        unsigned int task, num, valid;
+        auto outputs = runner_get_output(runner, &task, &num, &valid);
+        runner_release_output(num, outputs);
+    }
+    EXPECT_EQ(runner_cancel(runner, tasks.front()), -1);
+    EXPECT_EQ(runner_cancel(runner, tasks.back()), -1);
+    runner_stop(runner);
+    unlink(path.c_str());
+}
+
+TEST(BMInterfaceTest, waitTaskFromThreads)
+{
+    auto path = writeModel(1000);
+    auto runner = runner_start(path.c_str());
+    // each thread waits for its own tasks, while the others pop them too
+    std::vector<std::thread> threads;
+    std::vector<int> failed(4, 0);
+    for(size_t i=0; i<failed.size(); i++){
+        threads.emplace_back([&, i]{
+            for(int t=0; t<50; t++){
+                unsigned int valid;
+                if(waitTask(runner, putTask(runner), valid) != 0 || !valid) failed[i]++;
+            }
+        });
+    }
+    for(auto& thread: threads) thread.join();
+    for(auto num: failed) EXPECT_EQ(num, 0);
+    runner_stop(runner);
+    unlink(path.c_str());
+}
+
+TEST(BMInterfaceTest, waitTaskNotInFlight)
+{
+    auto path = writeModel(1000);
+    auto runner = runner_start(path.c_str());
+    unsigned int valid;
+    auto task = putTask(runner);
+    EXPECT_EQ(waitTask(runner, task+100, valid), -1);
+    EXPECT_EQ(waitTask(runner, INVALID_TASK_ID, valid), -1);
+    // taken by runner_get_output
+    unsigned int popped, num;
+    auto outputs = runner_get_output(runner, &popped, &num, &valid);
+    runner_release_output(num, outputs);
+    EXPECT_EQ(popped, task);
+    EXPECT_EQ(waitTask(runner, task, valid), -1);
+    runner_stop(runner);
+    unlink(path.c_str());
+}
+
+TEST(BMInterfaceTest, inferAll)
+{
+    auto path = writeModel(1000);
+    auto runner = runner_start(path.c_str());
+    // more tasks than the input queue holds
+    const unsigned int num = 64;
+    std::vector<float> data(num*4);
+    for(unsigned int i=0; i<data.size(); i++) data[i] = i;
+    std::vector<tensor_data_t> inputs(num);
+    std::vector<unsigned int> input_nums(num, 1);
+    for(unsigned int t=0; t<num; t++){
+        inputs[t].dims = 2;
+        inputs[t].shape[0] = 1;
+        inputs[t].shape[1] = 4;
+        inputs[t].dtype = BM_FLOAT32;
+        inputs[t].data = (unsigned char*)&data[t*4];
+    }
+    std::vector<tensor_data_t*> outputs(num);
+    std::vector<unsigned int> output_nums(num), valids(num);
+    EXPECT_EQ(runner_infer_all(runner, num, input_nums.data(), inputs.data(),
+                               outputs.data(), output_nums.data(), valids.data()), (int)num);
+    for(unsigned int t=0; t<num; t++){
+        EXPECT_EQ(valids[t], 1u);
+        ASSERT_EQ(output_nums[t], 1u);
+        runner_release_output(output_nums[t], outputs[t]);
+    }
+    runner_stop(runner);
+    unlink(path.c_str());
+}
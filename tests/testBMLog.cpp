@@ -0,0 +1,51 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <thread>
+#include <vector>
+#include "BMLog.h"
+
+using namespace bm;
+
+TEST(BMLogTest, asyncOrder)
+{
+    set_log_level(INFO);
+    testing::internal::CaptureStdout();
+    BMLOG(INFO, "first %d", 1);
+    std::thread t([]() { BMLOG(INFO, "second %d", 2); });
+    t.join();
+    BMLOG(DEBUG, "hidden");
+    flush_log();
+    auto output = testing::internal::GetCapturedStdout();
+    auto first = output.find("first 1");
+    auto second = output.find("second 2");
+    ASSERT_NE(first, std::string::npos);
+    ASSERT_NE(second, std::string::npos);
+    ASSERT_LT(first, second);
+    ASSERT_EQ(output.find("hidden"), std::string::npos);
+}
+
+TEST(BMLogTest, levelCheckBeforeFormat)
+{
+    set_log_level(WARNING);
+    int evaluated = 0;
+    auto arg = [&evaluated]() { return ++evaluated; };
+    BMLOG(INFO, "value=%d", arg());
+    ASSERT_EQ(evaluated, 0);
+    set_log_level(INFO);
+}
+
+TEST(BMLogTest, rateLimit)
+{
+    testing::internal::CaptureStdout();
+    for (int i = 0; i < 100; ++i)
+        BMLOG_EVERY_MS(INFO, 100000, "hot path %d", i);
+    flush_log();
+    auto output = testing::internal::GetCapturedStdout();
+    ASSERT_NE(output.find("hot path 0"), std::string::npos);
+    ASSERT_EQ(output.find("hot path 1"), std::string::npos);
+}
+
+TEST(BMLogTest, fatalThrows)
+{
+    ASSERT_THROW(BMLOG(FATAL, "fatal %d", 1), std::runtime_error);
+}
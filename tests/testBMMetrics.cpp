@@ -0,0 +1,93 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <thread>
+#include <fstream>
+#include <sstream>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "BMMetrics.h"
+#include "BMQueue.h"
+
+using namespace bm;
+
+static std::string httpGet(int port, const std::string& path)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    if(connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0){
+        close(fd);
+        return "";
+    }
+    std::string request = "GET " + path + " HTTP/1.0\r\n\r\n";
+    send(fd, request.data(), request.size(), 0);
+    std::string response;
+    char buffer[1024];
+    ssize_t n;
+    while((n = recv(fd, buffer, sizeof(buffer), 0)) > 0){
+        response.append(buffer, n);
+    }
+    close(fd);
+    return response;
+}
+
+TEST(BMMetricsTest, textFormat)
+{
+    MetricsWriter writer;
+    writer.gauge("queue_size", "queue size", {{"queue", "in\"put"}}, 3);
+    writer.counter("pushed_total", "pushed", {}, 10);
+    writer.gauge("queue_size", "queue size", {{"queue", "output"}}, 1);
+    writer.summary("latency_us", "latency", {{"device", "0"}}, {{0.5, 100}, {0.99, 200}}, 1500, 10);
+    auto text = writer.str();
+    ASSERT_EQ(text,
+              "# HELP queue_size queue size\n"
+              "# TYPE queue_size gauge\n"
+              "queue_size{queue=\"in\\\"put\"} 3\n"
+              "queue_size{queue=\"output\"} 1\n"
+              "# HELP pushed_total pushed\n"
+              "# TYPE pushed_total counter\n"
+              "pushed_total 10\n"
+              "# HELP latency_us latency\n"
+              "# TYPE latency_us summary\n"
+              "latency_us{device=\"0\",quantile=\"0.5\"} 100\n"
+              "latency_us{device=\"0\",quantile=\"0.99\"} 200\n"
+              "latency_us_sum{device=\"0\"} 1500\n"
+              "latency_us_count{device=\"0\"} 10\n");
+}
+
+TEST(BMMetricsTest, exporters)
+{
+    BMQueue<int> queue;
+    queue.push(1);
+    queue.push(2);
+    auto& metrics = BMMetrics::instance();
+    auto id = metrics.addCollector([&queue](MetricsWriter& writer){
+        writer.gauge("test_queue_size", "test queue", {}, queue.size());
+        writer.counter("test_queue_pushed_total", "test queue", {}, queue.pushedNum());
+    });
+    auto port = metrics.startHttp(0);
+    ASSERT_GT(port, 0);
+    auto response = httpGet(port, "/metrics");
+    ASSERT_NE(response.find("200 OK"), std::string::npos);
+    ASSERT_NE(response.find("test_queue_size 2\n"), std::string::npos);
+    ASSERT_NE(response.find("test_queue_pushed_total 2\n"), std::string::npos);
+    ASSERT_NE(httpGet(port, "/other").find("404"), std::string::npos);
+
+    std::string path = "/tmp/bmservice_metrics_test.prom";
+    unlink(path.c_str());
+    metrics.startFileDump(path, 100);
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    metrics.stop();
+    std::ifstream file(path);
+    std::stringstream content;
+    content << file.rdbuf();
+    ASSERT_NE(content.str().find("test_queue_size 2\n"), std::string::npos);
+    unlink(path.c_str());
+
+    metrics.removeCollector(id);
+    ASSERT_EQ(metrics.render().find("test_queue_size"), std::string::npos);
+}
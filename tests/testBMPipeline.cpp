@@ -47,7 +47,7 @@ TEST_F(BMPipelineTest, join)
 {
     size_t round = 10;
     std::thread t([this, round]() {
-        for (int i = 0; i < round; ++i)
+        for (size_t i = 0; i < round; ++i)
             pool->push(1);
         pool->join();
     });
@@ -57,6 +57,21 @@ TEST_F(BMPipelineTest, join)
     t.join();
 }
 
+TEST_F(BMPipelineTest, pause)
+{
+    pool->pause(0);
+    ASSERT_TRUE(pool->push(0));
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    int value;
+    ASSERT_FALSE(pool->pop(value));
+    // woken up at once, not polling
+    auto start = TimerClock::now();
+    pool->pause(0, false);
+    ASSERT_TRUE(pool->waitAndPop(value));
+    ASSERT_EQ(value, 2);
+    ASSERT_LT(usBetween(start, TimerClock::now()), 40*1000);
+}
+
 TEST_F(BMPipelineTest, emptyDeconstruct)
 {
     std::function<ContextPtr (size_t)>  contextInitializer = [](size_t i) {
@@ -82,3 +97,41 @@ TEST_F(BMPipelineTest, emptyDeconstruct)
 }
 
 
+
+TEST(BMPipelinePoolInit, parallelContexts)
+{
+    struct Context { int index; };
+    using PipelinePool = BMPipelinePool<InType, OutType, Context>;
+    size_t num = 4;
+    std::function<std::shared_ptr<Context> (size_t)>  contextInitializer = [](size_t i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        auto ptr = std::make_shared<Context>();
+        ptr->index = i;
+        return ptr;
+    };
+    auto start = TimerClock::now();
+    PipelinePool pool(num, contextInitializer);
+    ASSERT_LT(usBetween(start, TimerClock::now()), 200*1000*num);
+    for (size_t i = 0; i < num; ++i)
+        ASSERT_EQ(pool.getPipeLineContext(i).index, i);
+}
+
+TEST(BMPipelinePoolInit, failedContexts)
+{
+    struct Context { int index; };
+    using PipelinePool = BMPipelinePool<InType, OutType, Context>;
+    std::function<std::shared_ptr<Context> (size_t)>  contextInitializer = [](size_t i) {
+        if (i % 2) throw std::runtime_error("bad device");
+        auto ptr = std::make_shared<Context>();
+        ptr->index = i;
+        return ptr;
+    };
+    try {
+        PipelinePool pool(4, contextInitializer);
+        FAIL();
+    } catch (std::runtime_error &e) {
+        std::string msg = e.what();
+        ASSERT_NE(msg.find("#1"), std::string::npos);
+        ASSERT_NE(msg.find("#3"), std::string::npos);
+    }
+}
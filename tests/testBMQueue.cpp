@@ -31,3 +31,21 @@ TEST_F(BMQueueTest, pushAndPop)
     ASSERT_EQ(value, 1);
     ASSERT_TRUE(q0.empty());
 }
+
+TEST_F(BMQueueTest, pushFront)
+{
+    bm::BMQueue<int> q1(2);
+    q1.push(1);
+    q1.push(2);
+    int value;
+    ASSERT_TRUE(q1.tryPop(value));
+    q1.push(3);
+    // given back to the head, even if the queue is full
+    q1.pushFront(value);
+    ASSERT_EQ(q1.size(), 3u);
+    for(int expected: {1, 2, 3}){
+        ASSERT_TRUE(q1.tryPop(value));
+        ASSERT_EQ(value, expected);
+    }
+    ASSERT_TRUE(q1.empty());
+}
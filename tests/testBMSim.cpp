@@ -0,0 +1,458 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <vector>
+#include <unistd.h>
+#include "bmcv_api.h"
+#include "BMDataConvert.h"
+#include "BMDevicePool.h"
+#include "BMEnv.h"
+#include "BMSimDevice.h"
+
+using namespace bm;
+
+TEST(BMSimTest, latencyDistribution)
+{
+    sim::LatencyDistribution dist;
+    std::mt19937 rng(1);
+    ASSERT_TRUE(sim::LatencyDistribution::parse("5000", dist));
+    EXPECT_EQ(dist.sample(rng), 5000);
+    ASSERT_TRUE(sim::LatencyDistribution::parse("uniform:100,200", dist));
+    for(int i=0; i<100; i++){
+        auto v = dist.sample(rng);
+        EXPECT_GE(v, 100);
+        EXPECT_LE(v, 200);
+    }
+    ASSERT_TRUE(sim::LatencyDistribution::parse("lognormal:1000,300", dist));
+    double sum = 0;
+    for(int i=0; i<10000; i++) sum += dist.sample(rng);
+    EXPECT_NEAR(sum/10000, 1000, 30);
+    EXPECT_FALSE(sim::LatencyDistribution::parse("normal:100", dist));
+    EXPECT_FALSE(sim::LatencyDistribution::parse("uniform:200,100", dist));
+    EXPECT_FALSE(sim::LatencyDistribution::parse("gamma:1,2", dist));
+}
+
+TEST(BMSimTest, memcpy)
+{
+    bm_handle_t handle;
+    ASSERT_EQ(bm_dev_request(&handle, 0), BM_SUCCESS);
+    bm_device_mem_t mem;
+    ASSERT_EQ(bm_malloc_device_byte(handle, &mem, 1024), BM_SUCCESS);
+    std::vector<unsigned char> src(1024), dst(1024);
+    for(size_t i=0; i<src.size(); i++) src[i] = i;
+    ASSERT_EQ(bm_memcpy_s2d(handle, mem, src.data()), BM_SUCCESS);
+    ASSERT_EQ(bm_memcpy_d2s_partial_offset(handle, dst.data(), mem, 512, 512), BM_SUCCESS);
+    EXPECT_EQ(0, memcmp(dst.data(), src.data()+512, 512));
+    EXPECT_NE(bm_memcpy_d2s_partial_offset(handle, dst.data(), mem, 512, 513), BM_SUCCESS);
+    bm_free_device(handle, mem);
+    bm_dev_free(handle);
+}
+
+TEST(BMSimTest, imageConvert)
+{
+    bm_handle_t handle;
+    ASSERT_EQ(bm_dev_request(&handle, 0), BM_SUCCESS);
+    const int height = 4, width = 6;
+    bm_image packed, planar, resized;
+    bm_image_create(handle, height, width, FORMAT_BGR_PACKED, DATA_TYPE_EXT_1N_BYTE, &packed);
+    bm_image_create(handle, height, width, FORMAT_RGB_PLANAR, DATA_TYPE_EXT_FLOAT32, &planar);
+    bm_image_create(handle, height/2, width/2, FORMAT_BGR_PACKED, DATA_TYPE_EXT_1N_BYTE, &resized);
+    ASSERT_EQ(bm_image_alloc_dev_mem(packed, BMCV_HEAP_ANY), BM_SUCCESS);
+    ASSERT_EQ(bm_image_alloc_dev_mem(planar, BMCV_HEAP_ANY), BM_SUCCESS);
+    ASSERT_EQ(bm_image_alloc_dev_mem(resized, BMCV_HEAP_ANY), BM_SUCCESS);
+
+    std::vector<unsigned char> bgr(height*width*3);
+    for(size_t i=0; i<bgr.size(); i++) bgr[i] = i%3*100;
+    void* buffers[] = {bgr.data()};
+    ASSERT_EQ(bm_image_copy_host_to_device(packed, buffers), BM_SUCCESS);
+
+    ASSERT_EQ(bmcv_image_storage_convert(handle, 1, &packed, &planar), BM_SUCCESS);
+    std::vector<float> rgb(height*width*3);
+    buffers[0] = rgb.data();
+    ASSERT_EQ(bm_image_copy_device_to_host(planar, buffers), BM_SUCCESS);
+    EXPECT_EQ(rgb[0], 200);
+    EXPECT_EQ(rgb[height*width], 100);
+    EXPECT_EQ(rgb[2*height*width], 0);
+
+    bmcv_rect_t rect = {0, 0, width, height};
+    ASSERT_EQ(bmcv_image_vpp_convert(handle, 1, packed, &resized, &rect), BM_SUCCESS);
+    std::vector<unsigned char> small(height*width*3/4);
+    buffers[0] = small.data();
+    ASSERT_EQ(bm_image_copy_device_to_host(resized, buffers), BM_SUCCESS);
+    for(size_t i=0; i<small.size(); i++) EXPECT_EQ(small[i], i%3*100);
+
+    bm_image_destroy(packed);
+    bm_image_destroy(planar);
+    bm_image_destroy(resized);
+    bm_dev_free(handle);
+}
+
+TEST(BMSimTest, forward)
+{
+    char path[] = "/tmp/testBMSim_XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_GE(fd, 0);
+    close(fd);
+    std::ofstream(path) << "# two inputs, one output\n"
+                           "net simnet\n"
+                           "latency_us 20000\n"
+                           "input data uint8 0.5 4x3x8x8\n"
+                           "input mask float32 1 4x8\n"
+                           "output prob float32 1 4x10\n";
+
+    BMDeviceContext context(0, path);
+    auto net = context.getNetwork();
+    ASSERT_EQ(net->getNetInfo()->input_num, 2);
+    EXPECT_EQ(net->getBatchSize(), 4);
+    auto inTensors = net->createInputTensors();
+    auto outTensors = net->createOutputTensors();
+    for(auto& t: inTensors) context.allocMemForTensor(t);
+    std::vector<uint8_t> data(4*3*8*8, 1);
+    std::vector<float> mask(4*8, 1);
+    inTensors[0]->fill_device_mem(data.data(), data.size());
+    inTensors[1]->fill_device_mem(mask.data(), mask.size()*sizeof(float));
+
+    auto start = std::chrono::steady_clock::now();
+    net->forward(inTensors, outTensors);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    EXPECT_GE(elapsed, std::chrono::milliseconds(20));
+    ASSERT_EQ(outTensors[0]->get_elem_num(), 40);
+    auto prob = outTensors[0]->get_float_data();
+    for(size_t i=0; i<40; i++) EXPECT_EQ(prob[i], 0);
+    unlink(path);
+}
+
+TEST(BMSimTest, tensorFloatData)
+{
+    bm_handle_t handle;
+    ASSERT_EQ(bm_dev_request(&handle, 0), BM_SUCCESS);
+    bm_tensor_t raw = {};
+    raw.dtype = BM_INT8;
+    raw.shape.num_dims = 2;
+    raw.shape.dims[0] = 3;
+    raw.shape.dims[1] = 50;
+    ASSERT_EQ(bm_malloc_device_byte(handle, &raw.device_mem, 150), BM_SUCCESS);
+    BMTensor tensor(handle, "out", 0.25, &raw, false);
+    std::vector<int8_t> data(150);
+    for(size_t i=0; i<data.size(); i++) data[i] = (int8_t)(i*7);
+    tensor.fill_device_mem(data.data(), data.size());
+
+    auto all = tensor.get_float_data();
+    for(size_t i=0; i<data.size(); i++) EXPECT_EQ(all[i], data[i]*0.25f);
+
+    // the second row only, into a caller buffer
+    std::vector<float> row(60, -1);
+    EXPECT_EQ(tensor.get_float_data(row.data(), 50, 50), 50);
+    for(size_t i=0; i<50; i++) EXPECT_EQ(row[i], data[50+i]*0.25f);
+    EXPECT_EQ(row[50], -1);
+    EXPECT_EQ(tensor.get_float_data(row.data(), 140), 10);
+    EXPECT_EQ(tensor.get_float_data(row.data(), 150), 0);
+    bm_free_device(handle, raw.device_mem);
+    bm_dev_free(handle);
+}
+
+TEST(BMSimTest, tensorHalfData)
+{
+    bm_handle_t handle;
+    ASSERT_EQ(bm_dev_request(&handle, 0), BM_SUCCESS);
+    std::vector<float> values = {1, -2, 0.5, 65504, 3.140625};
+    std::vector<uint16_t> half(values.size()), bf16(values.size());
+    floatToFp16(values.data(), half.data(), values.size());
+    floatToBf16(values.data(), bf16.data(), values.size());
+    for(auto dtype: {BM_FLOAT16, BM_BFLOAT16}){
+        bm_tensor_t raw = {};
+        raw.dtype = dtype;
+        raw.shape.num_dims = 1;
+        raw.shape.dims[0] = values.size();
+        ASSERT_EQ(bm_malloc_device_byte(handle, &raw.device_mem, values.size()*2), BM_SUCCESS);
+        BMTensor tensor(handle, "out", 1, &raw, false);
+        EXPECT_EQ(tensor.get_dtype_len(), 2);
+        tensor.fill_device_mem(dtype == BM_FLOAT16? half.data(): bf16.data(), values.size()*2);
+        auto data = tensor.get_float_data();
+        for(size_t i=0; i<values.size(); i++){
+            // 65504 is not exact in bf16
+            if(dtype == BM_BFLOAT16 && i == 3) continue;
+            EXPECT_EQ(data[i], values[i]);
+        }
+        bm_free_device(handle, raw.device_mem);
+    }
+    bm_dev_free(handle);
+}
+
+TEST(BMSimTest, tensorStoreMode)
+{
+    bm_handle_t handle;
+    ASSERT_EQ(bm_dev_request(&handle, 0), BM_SUCCESS);
+    const size_t batch = 6, inner = 37;
+    bm_tensor_t raw = {};
+    raw.dtype = BM_INT8;
+    raw.st_mode = BM_STORE_4N;
+    raw.shape.num_dims = 2;
+    raw.shape.dims[0] = batch;
+    raw.shape.dims[1] = inner;
+    BMTensor tensor(handle, "in", 0.5, &raw, false);
+    EXPECT_EQ(tensor.get_mem_size(), 8*inner);
+    EXPECT_EQ(tensor.get_host_mem_size(), batch*inner);
+    ASSERT_EQ(bm_malloc_device_byte(handle, &raw.device_mem, tensor.get_mem_size()), BM_SUCCESS);
+
+    std::vector<int8_t> data(batch*inner);
+    for(size_t i=0; i<data.size(); i++) data[i] = (int8_t)(i*13);
+    ASSERT_TRUE(tensor.fill_device_mem(data.data(), data.size()));
+    std::vector<uint8_t> expected(8*inner), device(8*inner);
+    pack4N((const uint8_t*)data.data(), expected.data(), batch, inner);
+    ASSERT_EQ(bm_memcpy_d2s(handle, device.data(), raw.device_mem), BM_SUCCESS);
+    EXPECT_EQ(device, expected);
+    EXPECT_EQ(0, memcmp(tensor.get_raw_data(), data.data(), data.size()));
+
+    // a single sample shares its group with others, which are kept
+    std::vector<int8_t> sample(inner, 7);
+    ASSERT_TRUE(tensor.fill_device_mem(sample.data(), inner, 2*inner));
+    std::copy(sample.begin(), sample.end(), data.begin()+2*inner);
+    std::vector<int8_t> host(data.size());
+    EXPECT_EQ(tensor.fill_host_mem(host.data(), host.size()+10), data.size());
+    EXPECT_EQ(host, data);
+    EXPECT_FALSE(tensor.fill_device_mem(sample.data(), inner, 3));
+
+    // ranges crossing groups
+    std::vector<float> values(100);
+    EXPECT_EQ(tensor.get_float_data(values.data(), 3*inner+5, 100), 100);
+    for(size_t i=0; i<100; i++) EXPECT_EQ(values[i], data[3*inner+5+i]*0.5f);
+    EXPECT_EQ(tensor.get_float_data(values.data(), 5*inner+30), 7);
+    for(size_t i=0; i<7; i++) EXPECT_EQ(values[i], data[5*inner+30+i]*0.5f);
+    bm_free_device(handle, raw.device_mem);
+
+    raw.dtype = BM_INT16;
+    raw.st_mode = BM_STORE_2N;
+    raw.shape.dims[0] = 3;
+    ASSERT_EQ(bm_malloc_device_byte(handle, &raw.device_mem, tensor.get_mem_size()), BM_SUCCESS);
+    EXPECT_EQ(tensor.get_mem_size(), 4*inner*2);
+    std::vector<int16_t> shorts(3*inner), back(3*inner);
+    for(size_t i=0; i<shorts.size(); i++) shorts[i] = (int16_t)(i*1000);
+    ASSERT_TRUE(tensor.fill_device_mem(shorts.data(), shorts.size()*2));
+    EXPECT_EQ(tensor.fill_host_mem(back.data(), back.size()*2), back.size()*2);
+    EXPECT_EQ(back, shorts);
+    // no valid sample is left to read
+    tensor.set_batch(0);
+    EXPECT_EQ(tensor.fill_host_mem(back.data(), back.size()*2), 0);
+    EXPECT_EQ(tensor.host_view().shape[0], 0u);
+    bm_free_device(handle, raw.device_mem);
+    bm_dev_free(handle);
+}
+
+TEST(BMSimTest, nativeStoreMode)
+{
+    char path[] = "/tmp/testBMSim_XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_GE(fd, 0);
+    close(fd);
+    std::ofstream(path) << "net int8net\n"
+                           "latency_us 0\n"
+                           "input data int8 0.5 3x2x5\n"
+                           "output cls int8 0.25 3x10\n"
+                           "output prob float32 1 3x10\n";
+    {
+        BMDeviceContext context(0, path);
+        auto net = context.getNetwork();
+        EXPECT_EQ(net->nativeStoreMode(BM_INT8), BM_STORE_4N);
+        EXPECT_EQ(net->nativeStoreMode(BM_UINT16), BM_STORE_2N);
+        EXPECT_EQ(net->nativeStoreMode(BM_FLOAT32), BM_STORE_1N);
+        EXPECT_EQ(net->createInputTensors()[0]->get_store_mode(), BM_STORE_1N);
+        EXPECT_EQ(net->createOutputTensors()[0]->get_store_mode(), BM_STORE_1N);
+        auto inTensors = net->createInputTensors(true);
+        auto outTensors = net->createOutputTensors(true);
+        EXPECT_EQ(inTensors[0]->get_store_mode(), BM_STORE_4N);
+        EXPECT_EQ(outTensors[0]->get_store_mode(), BM_STORE_4N);
+        EXPECT_EQ(outTensors[1]->get_store_mode(), BM_STORE_1N);
+        for(auto& t: inTensors) context.allocMemForTensor(t);
+        for(auto& t: outTensors) context.allocMemForTensor(t);
+        EXPECT_EQ(outTensors[0]->get_mem_size(), 40);
+        std::vector<int8_t> data(30, 1);
+        ASSERT_TRUE(inTensors[0]->fill_device_mem(data.data(), data.size()));
+        ASSERT_TRUE(net->forward(inTensors, outTensors));
+        auto cls = outTensors[0]->get_float_data();
+        for(size_t i=0; i<30; i++) EXPECT_EQ(cls[i], 0);
+    }
+    unlink(path);
+}
+
+TEST(BMSimTest, tailBatch)
+{
+    char path[] = "/tmp/testBMSim_XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_GE(fd, 0);
+    close(fd);
+    std::ofstream(path) << "net tailnet\n"
+                           "latency_us 0\n"
+                           "input data float32 1 4x6\n"
+                           "output cls int8 0.5 4x10\n"
+                           "output prob float32 1 4x10\n";
+    BMDeviceContext context(0, path);
+    auto net = context.getNetwork();
+    auto inTensors = net->createInputTensors();
+    // cls is 4N, whose padding samples stay on device
+    auto outTensors = net->createOutputTensors(true);
+    for(auto& t: inTensors) context.allocMemForTensor(t);
+    for(auto& t: outTensors) context.allocMemForTensor(t);
+    std::vector<float> data(4*6, 1);
+    for(size_t batch: {3, 4, 1}){
+        ASSERT_TRUE(inTensors[0]->fill_device_mem(data.data(), batch*6*sizeof(float)));
+        inTensors[0]->set_batch(batch);
+        ASSERT_TRUE(net->forward(inTensors, outTensors));
+        // the network still runs with 4 samples
+        EXPECT_EQ(inTensors[0]->shape(0), 4);
+        for(auto& t: outTensors){
+            EXPECT_EQ(t->shape(0), batch);
+            EXPECT_EQ(t->get_elem_num(), batch*10);
+        }
+        EXPECT_EQ(outTensors[0]->get_host_mem_size(), batch*10);
+        EXPECT_EQ(outTensors[0]->get_mem_size(), 4*10);
+        std::vector<float> prob(40);
+        EXPECT_EQ(outTensors[1]->fill_host_mem(prob.data(), prob.size()*sizeof(float)), batch*10*sizeof(float));
+        EXPECT_EQ(outTensors[0]->get_float_data(prob.data(), 0), batch*10);
+    }
+    unlink(path);
+}
+
+TEST(BMSimTest, tensorView)
+{
+    std::vector<float> data(3*4*5);
+    for(size_t i=0; i<data.size(); i++) data[i] = i;
+    bm_shape_t shape = {3, {3, 4, 5}};
+    TensorView view(data.data(), BM_FLOAT32, shape);
+    EXPECT_EQ(view.elem_num(), 60);
+    EXPECT_EQ(view.strides[0], 20);
+    EXPECT_TRUE(view.is_contiguous());
+    auto rows = view.slice(1, 3);
+    EXPECT_EQ(rows.shape[0], 2);
+    EXPECT_EQ(rows.ptr<float>()[0], 20);
+    auto sample = rows[1];
+    EXPECT_EQ(sample.dims, 2);
+    EXPECT_EQ(sample.ptr<float>()[7], 47);
+    EXPECT_EQ(sample[3].ptr<float>()[4], 59);
+    EXPECT_THROW(view.slice(2, 4), std::exception);
+
+    bm_handle_t handle;
+    ASSERT_EQ(bm_dev_request(&handle, 0), BM_SUCCESS);
+    for(auto st_mode: {BM_STORE_1N, BM_STORE_4N}){
+        bm_tensor_t raw = {};
+        raw.dtype = BM_INT8;
+        raw.st_mode = st_mode;
+        raw.shape = {2, {5, 9}};
+        BMTensor tensor(handle, "out", 0.5, &raw, false);
+        ASSERT_EQ(bm_malloc_device_byte(handle, &raw.device_mem, tensor.get_mem_size()), BM_SUCCESS);
+        std::vector<int8_t> values(45);
+        for(size_t i=0; i<values.size(); i++) values[i] = i;
+        ASSERT_TRUE(tensor.fill_device_mem(values.data(), values.size()));
+        auto host = tensor.host_view(3);
+        EXPECT_EQ(host.dtype, BM_INT8);
+        EXPECT_EQ(host.shape[0], 2);
+        EXPECT_EQ(host.shape[1], 9);
+        EXPECT_EQ(host[1].ptr<int8_t>()[2], 4*9+2);
+        auto floats = tensor.float_view(1, 2);
+        EXPECT_EQ(floats.dtype, BM_FLOAT32);
+        EXPECT_EQ(floats.elem_num(), 9);
+        for(size_t i=0; i<9; i++) EXPECT_EQ(floats.ptr<float>()[i], (9+i)*0.5f);
+        EXPECT_EQ(tensor.float_view(4, 10).shape[0], 1);
+        bm_free_device(handle, raw.device_mem);
+    }
+    bm_dev_free(handle);
+}
+
+TEST(BMSimTest, taskControl)
+{
+    char path[] = "/tmp/testBMSim_XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_GE(fd, 0);
+    close(fd);
+    std::ofstream(path) << "net ctlnet\n"
+                           "latency_us 20000\n"
+                           "input data float32 1 1x4\n"
+                           "output prob float32 1 1x4\n";
+    std::atomic_int preNum(0), postNum(0);
+    BMDevicePool<int, int> runner(path, [&](const int&, const TensorVec&, ContextPtr){
+        preNum++;
+        return true;
+    }, [&](const int& in, const TensorVec&, int& out, ContextPtr){
+        postNum++;
+        out = in;
+        return true;
+    }, {0});
+    runner.setExpiredOutputFunc([](const int& in, int& out){ out = -in; });
+    runner.start();
+
+    auto cancelled = std::make_shared<TaskControl>();
+    cancelled->cancelled = true;
+    auto expired = std::make_shared<TaskControl>();
+    expired->deadline = std::chrono::steady_clock::now() - std::chrono::milliseconds(1);
+    ASSERT_TRUE(runner.push(1));
+    ASSERT_TRUE(runner.push(2, cancelled));
+    ASSERT_TRUE(runner.push(3, expired));
+    ASSERT_TRUE(runner.push(4, std::make_shared<TaskControl>()));
+    std::map<int, bool> results;
+    ProcessStatInfo stat("ctlnet");
+    for(int i=0; i<4; i++){
+        int out;
+        ProcessStatus status;
+        ASSERT_TRUE(runner.waitAndPop(out, status));
+        results[out] = status.valid;
+        EXPECT_EQ(status.expired, out<0);
+        stat.update(status);
+    }
+    EXPECT_EQ(results, (std::map<int, bool>{{1, true}, {-2, false}, {-3, false}, {4, true}}));
+    EXPECT_EQ(preNum, 2);
+    EXPECT_EQ(postNum, 2);
+    EXPECT_EQ(stat.getExpiredNum(), 2);
+
+    // expires while the task before it is in forward
+    auto late = std::make_shared<TaskControl>();
+    late->deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(10);
+    ASSERT_TRUE(runner.push(5));
+    ASSERT_TRUE(runner.push(6, late));
+    for(int i=0; i<2; i++){
+        int out;
+        ProcessStatus status;
+        ASSERT_TRUE(runner.waitAndPop(out, status));
+        EXPECT_EQ(out, i==0? 5: -6);
+    }
+    // the late task passes pre-process, but not forward
+    EXPECT_EQ(preNum, 4);
+    EXPECT_EQ(postNum, 3);
+    runner.join();
+    unlink(path);
+}
+
+TEST(BMSimTest, defaultWarmUp)
+{
+    char path[] = "/tmp/testBMSim_XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_GE(fd, 0);
+    close(fd);
+    std::ofstream(path) << "net warmnet\n"
+                           "latency_us 1000\n"
+                           "input data float32 1 1x4\n"
+                           "output prob float32 1 1x4\n";
+    std::atomic_int preNum(0), postNum(0);
+    BMDevicePool<int, int> runner(path, [&](const int&, const TensorVec&, ContextPtr){
+        preNum++;
+        return true;
+    }, [&](const int& in, const TensorVec&, int& out, ContextPtr){
+        postNum++;
+        out = in;
+        return true;
+    }, {0});
+    // no WarmUpInputFunc, the warm-up tasks forward zero inputs without the pre/post-process functions
+    runner.setWarmUp(3);
+    runner.start();
+    EXPECT_EQ(preNum, 0);
+    EXPECT_EQ(postNum, 0);
+    ASSERT_TRUE(runner.push(7));
+    int out;
+    ProcessStatus status;
+    ASSERT_TRUE(runner.waitAndPop(out, status));
+    EXPECT_EQ(out, 7);
+    EXPECT_FALSE(status.warmUp);
+    EXPECT_EQ(preNum, 1);
+    runner.join();
+    unlink(path);
+}